@@ -1,105 +1,615 @@
 #include "bloom_filter.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <immintrin.h>
 
-int BloomFilter_Init(unsigned char** &BF)
+XTagFPParams XTAG_FP = {XTAG_FP_VERSION, XTAG_FP_COEFFS};
+const BloomParams BF_LEGACY_PARAMS = {N_HASH, N_BF_BITS, MAX_BF_BIN_SIZE, BF_LAYOUT_PARTITIONED};
+
+static inline uint64_t BloomFilter_PartWords(const BloomFilter &BF)
+{
+    return BF.n_bits >> 6;
+}
+
+static inline uint64_t BloomFilter_TotalWords(const BloomFilter &BF)
+{
+    return (BF.layout == BF_LAYOUT_BLOCKED) ? BloomFilter_PartWords(BF) : BF.n_hash*BloomFilter_PartWords(BF);
+}
+
+static inline void BloomFilter_SetBit(BloomFilter &BF, unsigned int k, uint64_t idx)
+{
+    BF.words[k*BloomFilter_PartWords(BF) + (idx >> 6)] |= (1ULL << (idx & 63));
+}
+
+static inline bool BloomFilter_GetBit(const BloomFilter &BF, unsigned int k, uint64_t idx)
 {
-    BF = new unsigned char* [N_HASH];
-    for(unsigned int k=0;k<N_HASH;++k){
-        BF[k] = new unsigned char [MAX_BF_BIN_SIZE];
-        ::memset(BF[k],0x00,MAX_BF_BIN_SIZE);
+    return (BF.words[k*BloomFilter_PartWords(BF) + (idx >> 6)] >> (idx & 63)) & 1;
+}
+
+static inline void BloomFilter_BlockMask(uint64_t *mask, const unsigned int *bit_idx, unsigned int n_hash)
+{
+    ::memset(mask,0x00,8*sizeof(uint64_t));
+    for(unsigned int j=0;j<n_hash;++j){
+        unsigned int b = bit_idx[j];
+        mask[b >> 6] |= (1ULL << (b & 63));
+    }
+}
+
+static inline bool BloomFilter_BlockContains(const uint64_t *blk, const uint64_t *mask)
+{
+    //All mask bits set in the 64B block
+#if defined(__AVX2__)
+    __m256i b0 = _mm256_load_si256((const __m256i *)blk);
+    __m256i b1 = _mm256_load_si256((const __m256i *)(blk + 4));
+    __m256i m0 = _mm256_loadu_si256((const __m256i *)mask);
+    __m256i m1 = _mm256_loadu_si256((const __m256i *)(mask + 4));
+    return _mm256_testc_si256(b0, m0) & _mm256_testc_si256(b1, m1);
+#else
+    uint64_t miss = 0;
+    for(unsigned int w=0;w<8;++w){
+        miss |= mask[w] & ~blk[w];
     }
+    return miss == 0;
+#endif
+}
+
+static void BloomFilter_Release(BloomFilter &BF)
+{
+    if(BF.map != NULL){
+        munmap(BF.map, BF.map_len);
+    }
+    else{
+        free(BF.words);
+    }
+    BF.words = nullptr;
+    BF.map = NULL;
+    BF.map_len = 0;
+}
+
+static double BloomParams_BlockedFPR(double lambda, unsigned int k)
+{
+    // Elements per block are Poisson(lambda); a block holding i of them has
+    // each bit set with probability 1 - (1 - 1/512)^(k i)
+    if(lambda <= 0.0){
+        return 0.0;
+    }
+    double fpr = 0.0;
+    double spread = 12.0*std::sqrt(lambda) + 32.0;
+    unsigned int i_min = (unsigned int)std::max(0.0, lambda - spread);
+    unsigned int i_max = (unsigned int)(lambda + spread);
+    for(unsigned int i=i_min;i<=i_max;++i){
+        double p_i = std::exp(-lambda + i*std::log(lambda) - std::lgamma(i + 1.0));
+        double fill = -std::expm1((double)k*i*std::log1p(-1.0/BF_BLOCK_BITS));
+        fpr += p_i * std::pow(fill, (double)k);
+    }
+    return fpr;
+}
+
+int BloomParams_Size(BloomParams &P, uint64_t n_items, double target_fpr, unsigned int n_hash, unsigned int layout)
+{
+    // Partitioned filter: with k partitions of m bits, FPR = (1 - e^(-n/m))^k.
+    // Blocked filter: see BloomParams_BlockedFPR.
+    // k = round(-log2 FPR) unless given; the size is the smallest power of two meeting the target.
+    if((target_fpr <= 0.0) || (target_fpr >= 1.0)){
+        return -1;
+    }
+
+    unsigned int k_max = (layout == BF_LAYOUT_BLOCKED) ? BF_BLOCKED_MAX_HASH : BF_MAX_HASH;
+    unsigned int k = n_hash;
+    if(k == 0){
+        k = (unsigned int)std::lround(-std::log2(target_fpr));
+    }
+    k = std::max(1u, std::min(k, k_max));
+
+    uint64_t n = std::max<uint64_t>(n_items,1);
+    unsigned int bits;
+
+    if(layout == BF_LAYOUT_BLOCKED){
+        bits = 0;
+        while((bits < BF_MAX_INDEX_BITS) && (BloomParams_BlockedFPR((double)n / (double)(1ULL << bits), k) > target_fpr)){
+            bits++;
+        }
+        P.n_bits = (uint64_t)BF_BLOCK_BITS << bits;
+    }
+    else{
+        double fill = -std::log1p(-std::pow(target_fpr, 1.0/k));     //n/m per partition
+        double m = std::max((double)n / fill, 1.0);
+
+        bits = BF_MIN_INDEX_BITS;
+        while((bits < BF_MAX_INDEX_BITS) && ((double)(1ULL << bits) < m)){
+            bits++;
+        }
+        P.n_bits = 1ULL << bits;
+    }
+
+    P.n_hash = k;
+    P.index_bits = bits;
+    P.layout = layout;
     return 0;
 }
 
-int BloomFilter_Set(unsigned char** &BF, unsigned int* indices)
+double BloomParams_FPR(const BloomParams &P, uint64_t n_items)
 {
-    // indices[k] <= 2048
-    for(unsigned int k=0;k<N_HASH;++k){
-        BF[k][indices[k]] = 0x01;
+    if(P.layout == BF_LAYOUT_BLOCKED){
+        return BloomParams_BlockedFPR((double)n_items / (double)(1ULL << P.index_bits), P.n_hash);
     }
+    return std::pow(-std::expm1(-(double)n_items / (double)P.n_bits), (double)P.n_hash);
+}
+
+int BloomFilter_Init(BloomFilter &BF, const BloomParams &P)
+{
+    BF.n_hash = P.n_hash;
+    BF.index_bits = P.index_bits;
+    BF.n_bits = P.n_bits;
+    BF.layout = P.layout;
+    BF.n_items = 0;
+    BF.map = NULL;
+    BF.map_len = 0;
+
+    size_t n_bytes = BloomFilter_TotalWords(BF)*sizeof(uint64_t);
+    BF.words = (uint64_t *)aligned_alloc(64, (n_bytes + 63) & ~(size_t)63);
+    ::memset(BF.words,0x00,n_bytes);
     return 0;
 }
 
-int BloomFilter_Set_N(unsigned char** &BF, unsigned int** indices, int n_idx)
+unsigned int BloomFilter_IndexCount(const BloomFilter &BF)
 {
-    for(unsigned int k=0;k<N_HASH;++k){
-        BF[k][indices[k][n_idx]] = 0x01;
+    return (BF.layout == BF_LAYOUT_BLOCKED) ? BF.n_hash + 1 : BF.n_hash;
+}
+
+int BloomFilter_Set(BloomFilter &BF, unsigned int* indices)
+{
+    if(BF.layout == BF_LAYOUT_BLOCKED){
+        uint64_t *blk = BF.words + 8*(uint64_t)indices[0];
+        for(unsigned int j=0;j<BF.n_hash;++j){
+            blk[indices[1+j] >> 6] |= (1ULL << (indices[1+j] & 63));
+        }
     }
+    else{
+        for(unsigned int k=0;k<BF.n_hash;++k){
+            BloomFilter_SetBit(BF, k, indices[k]);
+        }
+    }
+    BF.n_items++;
     return 0;
 }
 
-int BloomFilter_Match(unsigned char** &BF, unsigned int* indices, bool* is_present)
+int BloomFilter_Set_N(BloomFilter &BF, unsigned int** indices, int n_idx)
+{
+    unsigned int idx[BF_MAX_HASH+1];
+    for(unsigned int k=0;k<BloomFilter_IndexCount(BF);++k){
+        idx[k] = indices[k][n_idx];
+    }
+    return BloomFilter_Set(BF, idx);
+}
+
+int BloomFilter_Match(const BloomFilter &BF, unsigned int* indices, bool* is_present)
 {
     bool is_in_part = true;
-    for(size_t k=0;k<N_HASH;++k){
-        is_in_part &= ((BF[k])[indices[k]] == 0x01);
+    if(BF.layout == BF_LAYOUT_BLOCKED){
+        uint64_t mask[8];
+        BloomFilter_BlockMask(mask, indices+1, BF.n_hash);
+        is_in_part = BloomFilter_BlockContains(BF.words + 8*(uint64_t)indices[0], mask);
+    }
+    else{
+        for(size_t k=0;k<BF.n_hash;++k){
+            is_in_part &= BloomFilter_GetBit(BF, k, indices[k]);
+        }
     }
     *is_present = is_in_part;
     return 0;
 }
 
-int BloomFilter_Match_N(unsigned char** &BF, unsigned int** indices, unsigned int n_words, bool* is_present)
+int BloomFilter_Match_N(const BloomFilter &BF, unsigned int** indices, unsigned int n_words, bool* is_present)
 {
     bool is_in_part = true;
-    for(size_t k=0;k<N_HASH;++k){
-        for(size_t l=0;l<n_words;++l){
-            is_in_part &= ((BF[k])[indices[k][l]] == 0x01);
+    if(BF.layout == BF_LAYOUT_BLOCKED){
+        unsigned int bit_idx[BF_MAX_HASH];
+        uint64_t mask[8];
+        for(size_t l=0;(l<n_words) && is_in_part;++l){
+            for(unsigned int j=0;j<BF.n_hash;++j){
+                bit_idx[j] = indices[1+j][l];
+            }
+            BloomFilter_BlockMask(mask, bit_idx, BF.n_hash);
+            is_in_part = BloomFilter_BlockContains(BF.words + 8*(uint64_t)indices[0][l], mask);
+        }
+    }
+    else{
+        for(size_t k=0;k<BF.n_hash;++k){
+            for(size_t l=0;l<n_words;++l){
+                is_in_part &= BloomFilter_GetBit(BF, k, indices[k][l]);
+            }
         }
     }
     *is_present = is_in_part;
     return 0;
 }
 
-int BloomFilter_Clean(unsigned char** &BF)
+int BloomFilter_InitShard(BloomFilter &shard, const BloomFilter &BF)
+{
+    BloomParams P = {BF.n_hash, BF.index_bits, BF.n_bits, BF.layout};
+    return BloomFilter_Init(shard, P);
+}
+
+int BloomFilter_Merge(BloomFilter &BF, const BloomFilter *const *shards, unsigned int n_shards)
+{
+    // OR same-shaped shards into BF. Threads own disjoint 4KB word ranges and
+    // fold every shard into theirs, so there is no write sharing and the
+    // result is independent of how elements were spread over shards.
+    uint64_t n_words = BloomFilter_TotalWords(BF);
+    for(unsigned int s=0;s<n_shards;++s){
+        if((shards[s]->layout != BF.layout) || (shards[s]->n_hash != BF.n_hash) || (shards[s]->n_bits != BF.n_bits)){
+            return -1;
+        }
+    }
+
+    const uint64_t chunk = 512;
+    int64_t n_chunks = (int64_t)((n_words + chunk - 1) / chunk);
+
+    #pragma omp parallel for schedule(static)
+    for(int64_t c=0;c<n_chunks;++c){
+        uint64_t w = c*chunk;
+        uint64_t w_end = std::min<uint64_t>(w + chunk, n_words);
+#if defined(__AVX2__)
+        for(;w+4<=w_end;w+=4){
+            __m256i acc = _mm256_load_si256((const __m256i *)(BF.words + w));
+            for(unsigned int s=0;s<n_shards;++s){
+                acc = _mm256_or_si256(acc, _mm256_load_si256((const __m256i *)(shards[s]->words + w)));
+            }
+            _mm256_store_si256((__m256i *)(BF.words + w), acc);
+        }
+#endif
+        for(;w<w_end;++w){
+            uint64_t acc = BF.words[w];
+            for(unsigned int s=0;s<n_shards;++s){
+                acc |= shards[s]->words[w];
+            }
+            BF.words[w] = acc;
+        }
+    }
+
+    for(unsigned int s=0;s<n_shards;++s){
+        BF.n_items += shards[s]->n_items;
+    }
+    return 0;
+}
+
+int BloomFilter_Clean(BloomFilter &BF)
+{
+    BloomFilter_Release(BF);
+    return 0;
+}
+
+double BloomFilter_FillRatio(const BloomFilter &BF)
+{
+    uint64_t n_words = BloomFilter_TotalWords(BF);
+    uint64_t n_set = 0;
+    for(uint64_t w=0;w<n_words;++w){
+        n_set += __builtin_popcountll(BF.words[w]);
+    }
+    return (n_words == 0) ? 0.0 : (double)n_set / (double)(64*n_words);
+}
+
+double BloomFilter_FillFPR(const BloomFilter &BF)
+{
+    // FPR of a random non-member given the actual bits: product of the
+    // partition fill ratios, or the mean over blocks of (block fill)^k
+    double fpr;
+    if(BF.layout == BF_LAYOUT_BLOCKED){
+        uint64_t n_blocks = BloomFilter_TotalWords(BF) >> 3;
+        double sum = 0.0;
+        for(uint64_t b=0;b<n_blocks;++b){
+            unsigned int n_set = 0;
+            for(unsigned int w=0;w<8;++w){
+                n_set += __builtin_popcountll(BF.words[8*b+w]);
+            }
+            sum += std::pow((double)n_set / BF_BLOCK_BITS, (double)BF.n_hash);
+        }
+        fpr = (n_blocks == 0) ? 0.0 : sum / (double)n_blocks;
+    }
+    else{
+        uint64_t part_words = BloomFilter_PartWords(BF);
+        fpr = 1.0;
+        for(unsigned int k=0;k<BF.n_hash;++k){
+            uint64_t n_set = 0;
+            for(uint64_t w=0;w<part_words;++w){
+                n_set += __builtin_popcountll(BF.words[k*part_words+w]);
+            }
+            fpr *= (double)n_set / (double)BF.n_bits;
+        }
+    }
+    return fpr;
+}
+
+static inline void BloomFilter_PrefetchProbe(const BloomFilter &BF, unsigned int** indices, size_t p)
+{
+    if(BF.layout == BF_LAYOUT_BLOCKED){
+        __builtin_prefetch(BF.words + 8*(uint64_t)indices[0][p], 0, 1);
+    }
+    else{
+        for(unsigned int k=0;k<BF.n_hash;++k){
+            __builtin_prefetch(BF.words + k*BloomFilter_PartWords(BF) + (indices[k][p] >> 6), 0, 1);
+        }
+    }
+}
+
+int BloomFilter_Match_Batch(const BloomFilter &BF, unsigned int** indices, unsigned int n_words, unsigned int n_cand, uint64_t* survivors)
 {
-    for(size_t k=0;k<N_HASH;++k){
-        delete [] BF[k];
+    // Probe p = c*n_words + l is term l of candidate c, i.e. entry p of each
+    // indices[j]. Lines for probe p + BF_PREFETCH_DIST are requested while
+    // probe p is resolved, so misses overlap instead of serialising.
+    // Bit c of survivors is set iff every term of candidate c is present.
+    size_t n_probes = (size_t)n_cand*n_words;
+    size_t p_ahead = std::min<size_t>(BF_PREFETCH_DIST, n_probes);
+
+    ::memset(survivors,0x00,((n_cand + 63) >> 6)*sizeof(uint64_t));
+    for(size_t p=0;p<p_ahead;++p){
+        BloomFilter_PrefetchProbe(BF, indices, p);
+    }
+
+    unsigned int bit_idx[BF_MAX_HASH];
+    uint64_t mask[8];
+    size_t p = 0;
+    for(unsigned int c=0;c<n_cand;++c){
+        bool is_in_part = true;
+        for(unsigned int l=0;l<n_words;++l,++p){
+            if(p_ahead < n_probes){
+                BloomFilter_PrefetchProbe(BF, indices, p_ahead++);
+            }
+            if(!is_in_part){
+                continue;
+            }
+            if(BF.layout == BF_LAYOUT_BLOCKED){
+                for(unsigned int j=0;j<BF.n_hash;++j){
+                    bit_idx[j] = indices[1+j][p];
+                }
+                BloomFilter_BlockMask(mask, bit_idx, BF.n_hash);
+                is_in_part = BloomFilter_BlockContains(BF.words + 8*(uint64_t)indices[0][p], mask);
+            }
+            else{
+                for(unsigned int k=0;k<BF.n_hash;++k){
+                    is_in_part &= BloomFilter_GetBit(BF, k, indices[k][p]);
+                }
+            }
+        }
+        if(is_in_part){
+            survivors[c >> 6] |= (1ULL << (c & 63));
+        }
     }
-    delete [] BF;
     return 0;
 }
 
-int BloomFilter_WriteBFtoFile(std::string bloomfilter_file, unsigned char** &BF)
+unsigned int XTagFP_Message(const uint64_t *xtag, unsigned char *msg)
+{
+    unsigned int n_bytes = 2*XTAG_FP.n_coeffs;
+
+    for(unsigned int k=0;k<XTAG_FP.n_coeffs;++k){
+        msg[2*k] = static_cast<unsigned char>(xtag[k] & 0xFF);
+        msg[2*k+1] = static_cast<unsigned char>((xtag[k] >> 8) & 0xFF);
+    }
+    ::memset(msg+n_bytes,0x00,8);
+    return n_bytes + 8;
+}
+
+int BloomFilter_XTagIndices(const BloomFilter &BF, blake3_hasher *hasher, const uint64_t *xtag, unsigned int *indices)
 {
-    std::ofstream outputfile;
-    outputfile.open(bloomfilter_file,std::ios_base::out);
+    // One BLAKE3 over the fingerprint message, extended as an XOF.
+    // Partitioned: index j is the top index_bits of bytes 8j..8j+7 read big-endian.
+    // Blocked: the block is the top index_bits of bytes 0..7, then k 9-bit offsets.
+    unsigned char msg[XTAG_FP_MAX_MSG_BYTES];
+    unsigned char digest[8*BF_MAX_HASH];
+    unsigned int n_bytes = XTagFP_Message(xtag, msg);
+
+    blake3_hasher_init(hasher);
+    blake3_hasher_update(hasher,msg,n_bytes);
 
-    for(unsigned int i=0;i<N_HASH;++i){
-        for(unsigned int j=0;j<MAX_BF_BIN_SIZE;++j){
-            outputfile << std::hex << std::setw(2) << std::setfill('0') << (static_cast<int>(BF[i][j]) & 0xFF) << std::endl;
+    if(BF.layout == BF_LAYOUT_BLOCKED){
+        blake3_hasher_finalize(hasher,digest,8+2*BF.n_hash);
+
+        uint64_t v = 0;
+        for(unsigned int b=0;b<8;++b){
+            v = (v << 8) | digest[b];
+        }
+        indices[0] = (BF.index_bits == 0) ? 0 : (unsigned int)(v >> (64 - BF.index_bits));
+        for(unsigned int j=0;j<BF.n_hash;++j){
+            indices[1+j] = ((digest[8+2*j] << 8) | digest[9+2*j]) & (BF_BLOCK_BITS - 1);
         }
+        return 0;
     }
 
-    outputfile.close();
+    blake3_hasher_finalize(hasher,digest,8*BF.n_hash);
+
+    for(unsigned int j=0;j<BF.n_hash;++j){
+        uint64_t v = 0;
+        for(unsigned int b=0;b<8;++b){
+            v = (v << 8) | digest[8*j+b];
+        }
+        indices[j] = (unsigned int)(v >> (64 - BF.index_bits));
+    }
     return 0;
 }
 
-int BloomFilter_ReadBFfromFile(std::string bloomfilter_file, unsigned char** &BF)
+int BloomFilter_WriteBFtoFile(std::string bloomfilter_file, const BloomFilter &BF)
 {
+    BloomFileHeader hdr;
+    ::memset(&hdr,0x00,sizeof(hdr));
+    ::memcpy(hdr.magic,BF_FILE_MAGIC,8);
+    hdr.version = BF_FILE_VERSION;
+    hdr.hash_scheme = (BF.layout == BF_LAYOUT_BLOCKED) ? BF_HASH_BLOCKED_XOF : BF_HASH_BLAKE3_XOF;
+    hdr.n_hash = BF.n_hash;
+    hdr.index_bits = BF.index_bits;
+    hdr.n_bits = BF.n_bits;
+    hdr.fp_version = XTAG_FP.version;
+    hdr.fp_coeffs = XTAG_FP.n_coeffs;
+    hdr.n_words = BloomFilter_TotalWords(BF);
+    hdr.n_items = BF.n_items;
+    hdr.fill_ratio = BloomFilter_FillRatio(BF);
+
+    //Write aside and rename, so a search mapping the old file keeps a consistent view
+    std::string tmp_file = bloomfilter_file + ".tmp";
+    FILE *fp = fopen(tmp_file.c_str(),"wb");
+    if(fp == NULL){
+        std::cerr << "Cannot open bloom filter file " << tmp_file << std::endl;
+        return -1;
+    }
+    bool ok = (fwrite(&hdr,sizeof(hdr),1,fp) == 1)
+           && (fwrite(BF.words,sizeof(uint64_t),hdr.n_words,fp) == hdr.n_words);
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || (rename(tmp_file.c_str(),bloomfilter_file.c_str()) != 0)){
+        std::cerr << "Cannot write bloom filter file " << bloomfilter_file << std::endl;
+        unlink(tmp_file.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int XTagFP_Check(std::string bloomfilter_file)
+{
+    if((XTAG_FP.version != XTAG_FP_VERSION) || (XTAG_FP.n_coeffs == 0) || (XTAG_FP.n_coeffs > N_l)){
+        std::cerr << "Unsupported xtag fingerprint v" << XTAG_FP.version << " (" << XTAG_FP.n_coeffs << " coeffs) in " << bloomfilter_file << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+static int BloomFilter_MapFile(std::string bloomfilter_file, int fd, BloomFilter &BF)
+{
+    struct stat st;
+    if(fstat(fd,&st) != 0){
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED){
+        std::cerr << "Cannot map bloom filter file " << bloomfilter_file << std::endl;
+        return -1;
+    }
+
+    const BloomFileHeader *hdr = (const BloomFileHeader *)map;
+    size_t hdr_len = (hdr->version == 1) ? BF_FILE_V1_HEADER_BYTES : sizeof(BloomFileHeader);
+    bool valid = ((size_t)st.st_size >= hdr_len) && ((hdr->version == 1) || (hdr->version == BF_FILE_VERSION))
+              && (hdr->n_hash >= 1) && (hdr->index_bits <= BF_MAX_INDEX_BITS);
+    if(valid){
+        if(hdr->hash_scheme == BF_HASH_BLOCKED_XOF){
+            valid = (hdr->version >= 2) && (hdr->n_hash <= BF_BLOCKED_MAX_HASH)
+                 && (hdr->n_bits == ((uint64_t)BF_BLOCK_BITS << hdr->index_bits))
+                 && (hdr->n_words == (hdr->n_bits >> 6));
+        }
+        else{
+            valid = ((hdr->hash_scheme == BF_HASH_BLAKE3_XOF) || ((hdr->hash_scheme == BF_HASH_BLAKE3) && (hdr->n_hash == 1)))
+                 && (hdr->n_hash <= BF_MAX_HASH) && (hdr->index_bits >= BF_MIN_INDEX_BITS)
+                 && (hdr->n_bits == (1ULL << hdr->index_bits))
+                 && (hdr->n_words == hdr->n_hash*(hdr->n_bits >> 6));
+        }
+    }
+    valid = valid
+              && ((size_t)st.st_size == hdr_len + hdr->n_words*sizeof(uint64_t));
+    if(!valid){
+        std::cerr << "Bloom filter file " << bloomfilter_file << " has an invalid header or size" << std::endl;
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    XTAG_FP.version = hdr->fp_version;
+    XTAG_FP.n_coeffs = hdr->fp_coeffs;
+    if(XTagFP_Check(bloomfilter_file) != 0){
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    madvise(map, st.st_size, MADV_WILLNEED);
+
+    BF.n_hash = hdr->n_hash;
+    BF.index_bits = hdr->index_bits;
+    BF.layout = (hdr->hash_scheme == BF_HASH_BLOCKED_XOF) ? BF_LAYOUT_BLOCKED : BF_LAYOUT_PARTITIONED;
+    BF.n_bits = hdr->n_bits;
+    BF.n_items = hdr->n_items;
+    BF.words = (uint64_t *)((unsigned char *)map + hdr_len);
+    BF.map = map;
+    BF.map_len = st.st_size;
+    return 0;
+}
+
+static int BloomFilter_ReadTextFile(std::string bloomfilter_file, BloomFilter &BF)
+{
+    //Legacy format: one "%02x" line per bit, optionally preceded by "#xtag_fp <version> <n_coeffs>"
     std::ifstream inputfile;
     inputfile.open(bloomfilter_file,std::ios_base::in);
 
     std::string fline;
-    char temp[2];
+    char temp[3] = {0, 0, 0};
     const char *tstr;
     unsigned int n_hash = 0;
     unsigned int bf_idx = 0;
 
-    while(std::getline(inputfile,fline) && (n_hash < N_HASH)){
+    BloomFilter_Init(BF, BF_LEGACY_PARAMS);
+
+    //Files without a header predate the fingerprint parameters and use version 1
+    XTAG_FP.version = XTAG_FP_VERSION;
+    XTAG_FP.n_coeffs = XTAG_FP_COEFFS;
+
+    while(std::getline(inputfile,fline) && (n_hash < BF.n_hash)){
+        if(fline[0] == '#'){
+            std::istringstream hdr(fline.substr(1));
+            std::string key;
+            hdr >> key;
+            if(key == "xtag_fp"){
+                hdr >> XTAG_FP.version >> XTAG_FP.n_coeffs;
+                if(XTagFP_Check(bloomfilter_file) != 0){
+                    inputfile.close();
+                    return -1;
+                }
+            }
+            fline.clear();
+            continue;
+        }
         tstr = fline.data();
         temp[0] = tstr[0];
         temp[1] = tstr[1];
-        BF[n_hash][bf_idx] = std::strtoul(temp,nullptr,16) & 0xFF;
+        if(std::strtoul(temp,nullptr,16) & 0xFF){
+            BloomFilter_SetBit(BF, n_hash, bf_idx);
+        }
         fline.clear();
         bf_idx++;
-        if(bf_idx == MAX_BF_BIN_SIZE){
+        if(bf_idx == BF.n_bits){
             n_hash++;
             bf_idx = 0;
         }
     }
 
     inputfile.close();
+    return 0;
+}
+
+int BloomFilter_ReadBFfromFile(std::string bloomfilter_file, BloomFilter &BF)
+{
+    BloomFilter_Release(BF);
+
+    int fd = open(bloomfilter_file.c_str(), O_RDONLY);
+    if(fd < 0){
+        std::cerr << "Cannot open bloom filter file " << bloomfilter_file << std::endl;
+        return -1;
+    }
+
+    char magic[8];
+    bool is_binary = (pread(fd, magic, 8, 0) == 8) && (::memcmp(magic,BF_FILE_MAGIC,8) == 0);
+
+    int rc;
+    if(is_binary){
+        rc = BloomFilter_MapFile(bloomfilter_file, fd, BF);
+    }
+    else{
+        rc = BloomFilter_ReadTextFile(bloomfilter_file, BF);
+    }
+    close(fd);
 
-	return 0;
+	return rc;
 }
 
 
@@ -1,27 +1,134 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
 #include <cstring>
 #include <string>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
+#include <cstdint>
 #include "size_parameters.h"
 #include "utils.h"
+#include "./blake3/blake3.h"
+
+#define BF_MAX_HASH 32                      //Upper bound on k
+#define BF_MIN_INDEX_BITS 6                 //Partitions are at least one 64-bit word
+#define BF_MAX_INDEX_BITS 32
+#define BF_DEFAULT_FPR 1e-4
+
+#define XTAG_FP_VERSION 1
+#define XTAG_FP_COEFFS 16                   //Rounded xtag coefficients hashed into the XSet entry
+#define XTAG_FP_MAX_MSG_BYTES (2*N_l+8)
+
+/*
+ * XSet fingerprint definition, recorded in the filter file so search hashes
+ * xtags the same way setup did. Version 1 hashes the first n_coeffs rounded
+ * xtag coefficients as little-endian 16-bit words, then 7 zero bytes and a
+ * zero hash-function byte. Only those coefficients of yid.xtoken ever need to be
+ * computed.
+ */
+typedef struct {
+    unsigned int version;
+    unsigned int n_coeffs;
+} XTagFPParams;
+
+extern XTagFPParams XTAG_FP;
+
 
-#define N_HASH 1                    //Equal to N_Threads
-// #define MAX_BF_BIN_SIZE 1024
-// #define N_BF_BITS 10
+#define BF_FILE_MAGIC "OQXTBF01"
+#define BF_FILE_VERSION 2                   //v2: 64B header so the payload is cache-line aligned
+#define BF_FILE_V1_HEADER_BYTES 56
+#define BF_HASH_BLAKE3 1                    //Index j from BLAKE3(fingerprint msg || j), k = 1 only
+#define BF_HASH_BLAKE3_XOF 2                //Index j from bytes 8j..8j+7 of the BLAKE3 XOF of (msg || 0)
+#define BF_HASH_BLOCKED_XOF 3               //Block from XOF bytes 0..7, bit j of it from bytes 8+2j..9+2j (mod 512)
 
-#define MAX_BF_BIN_SIZE 131072
-#define N_BF_BITS 17
+#define BF_LAYOUT_PARTITIONED 0
+#define BF_LAYOUT_BLOCKED 1
+#define BF_BLOCK_BITS 512                   //One 64B cache line
+#define BF_BLOCKED_MAX_HASH 16
+#define BF_PREFETCH_DIST 16                 //Probes prefetched ahead in BloomFilter_Match_Batch
 
+/*
+ * Filter shape, derived at setup from the element count and a target
+ * false-positive rate and carried in the filter file.
+ *  - Partitioned: k partitions of 2^index_bits bits, index j of an element
+ *    addressing partition j. For k = 1 and 17 index bits the XOF scheme
+ *    yields the same indices as the original fixed-size filter.
+ *  - Blocked: 2^index_bits blocks of one cache line; all k bits of an
+ *    element fall in the block its first index selects, so a probe touches
+ *    one line whatever k is.
+ */
+typedef struct {
+    unsigned int n_hash;
+    unsigned int index_bits;
+    uint64_t n_bits;                        //Partitioned: per partition, 2^index_bits. Blocked: total
+    unsigned int layout;                    //BF_LAYOUT_*
+} BloomParams;
 
-int BloomFilter_Init(unsigned char** &BF);
-int BloomFilter_Set(unsigned char** &BF, unsigned int* indices);
-int BloomFilter_Set_N(unsigned char** &BF, unsigned int** indices, int n_idx);
-int BloomFilter_Match(unsigned char** &BF, unsigned int* indices, bool* is_present);
-int BloomFilter_Match_N(unsigned char** &BF, unsigned int** indices, unsigned int n_words, bool* is_present);
-int BloomFilter_Clean(unsigned char** &BF);
+extern const BloomParams BF_LEGACY_PARAMS;
+
+/*
+ * Binary XSet file: this 64B header, then the bit-packed filter as
+ * little-endian 64-bit words (BloomFilter layout). The payload starts
+ * 64B-aligned, so search maps the file and probes it in place, read-only
+ * and shared between processes. Version 1 files (56B header, partitioned
+ * only) are still read.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t hash_scheme;
+    uint32_t n_hash;                        //k
+    uint32_t index_bits;
+    uint64_t n_bits;                        //Bits per hash partition
+    uint32_t fp_version;                    //XTagFPParams in effect at setup
+    uint32_t fp_coeffs;
+    uint64_t n_words;
+    uint64_t n_items;                       //Elements inserted
+    double fill_ratio;                      //Set bits / total bits when written (0 in files predating it)
+} BloomFileHeader;
+
+/*
+ * In-memory filter, 64B-aligned. Partitioned: bit i of partition k is bit
+ * (i & 63) of words[k*(n_bits/64) + (i >> 6)]. Blocked: block b is
+ * words[8b..8b+7]. Per element the index vector holds k partition indices,
+ * or the block followed by k bit offsets (BloomFilter_IndexCount entries).
+ * words is either owned or points into a read-only mapping of a filter file.
+ */
+typedef struct {
+    uint64_t *words;
+    uint64_t n_bits;
+    unsigned int n_hash;
+    unsigned int index_bits;
+    unsigned int layout;
+    uint64_t n_items;
+    void *map;                              //Mapping base, NULL when words is heap-owned
+    size_t map_len;
+} BloomFilter;
+
+
+int BloomParams_Size(BloomParams &P, uint64_t n_items, double target_fpr, unsigned int n_hash = 0, unsigned int layout = BF_LAYOUT_PARTITIONED);
+double BloomParams_FPR(const BloomParams &P, uint64_t n_items);
+int BloomFilter_Init(BloomFilter &BF, const BloomParams &P = BF_LEGACY_PARAMS);
+unsigned int BloomFilter_IndexCount(const BloomFilter &BF);
+int BloomFilter_Set(BloomFilter &BF, unsigned int* indices);
+int BloomFilter_Set_N(BloomFilter &BF, unsigned int** indices, int n_idx);
+int BloomFilter_Match(const BloomFilter &BF, unsigned int* indices, bool* is_present);
+int BloomFilter_Match_N(const BloomFilter &BF, unsigned int** indices, unsigned int n_words, bool* is_present);
+int BloomFilter_Match_Batch(const BloomFilter &BF, unsigned int** indices, unsigned int n_words, unsigned int n_cand, uint64_t* survivors);
+int BloomFilter_InitShard(BloomFilter &shard, const BloomFilter &BF);
+int BloomFilter_Merge(BloomFilter &BF, const BloomFilter *const *shards, unsigned int n_shards);
+int BloomFilter_Clean(BloomFilter &BF);
+double BloomFilter_FillRatio(const BloomFilter &BF);
+double BloomFilter_FillFPR(const BloomFilter &BF);
+unsigned int XTagFP_Message(const uint64_t *xtag, unsigned char *msg);
+int XTagFP_Check(std::string xset_file);
+int BloomFilter_XTagIndices(const BloomFilter &BF, blake3_hasher *hasher, const uint64_t *xtag, unsigned int *indices);
 int Trapdoor_Set(int** &T, int** r1, int i_offset, int j_offset);
 int ZW_Set(int** &ZW, int** anew, int i_offset, int j_offset);
 
-int BloomFilter_WriteBFtoFile(std::string bloomfilter_file, unsigned char** &BF);
-int BloomFilter_ReadBFfromFile(std::string bloomfilter_file, unsigned char** &BF);
+int BloomFilter_WriteBFtoFile(std::string bloomfilter_file, const BloomFilter &BF);
+int BloomFilter_ReadBFfromFile(std::string bloomfilter_file, BloomFilter &BF);
+
+#endif // BLOOMFILTER_H
@@ -0,0 +1,173 @@
+#include "cuckoo_filter.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static inline uint32_t Cuckoo_Fingerprint(const CuckooFilter &CF, uint64_t key)
+{
+    uint32_t fp = (uint32_t)key & ((1u << CF.fp_bits) - 1);
+    return (fp == 0) ? 1 : fp;
+}
+
+static inline uint64_t Cuckoo_Bucket(const CuckooFilter &CF, uint64_t key)
+{
+    return (key >> 32) & (CF.n_buckets - 1);
+}
+
+static inline uint64_t Cuckoo_AltBucket(const CuckooFilter &CF, uint64_t bucket, uint32_t fp)
+{
+    // Involution in bucket for a fixed fingerprint, so either bucket finds the other
+    return (bucket ^ (((uint64_t)fp * 0xc4ceb9fe1a85ec53ULL) >> 32)) & (CF.n_buckets - 1);
+}
+
+static inline uint32_t Cuckoo_Get(const CuckooFilter &CF, uint64_t bucket, unsigned int slot)
+{
+    uint64_t i = bucket*CUCKOO_BUCKET_SLOTS + slot;
+    return (CF.fp_bits == 8) ? ((const uint8_t *)CF.table)[i] : ((const uint16_t *)CF.table)[i];
+}
+
+static inline void Cuckoo_Put(CuckooFilter &CF, uint64_t bucket, unsigned int slot, uint32_t fp)
+{
+    uint64_t i = bucket*CUCKOO_BUCKET_SLOTS + slot;
+    if(CF.fp_bits == 8){
+        ((uint8_t *)CF.table)[i] = (uint8_t)fp;
+    }
+    else{
+        ((uint16_t *)CF.table)[i] = (uint16_t)fp;
+    }
+}
+
+static inline bool Cuckoo_TryPut(CuckooFilter &CF, uint64_t bucket, uint32_t fp)
+{
+    for(unsigned int s=0;s<CUCKOO_BUCKET_SLOTS;++s){
+        if(Cuckoo_Get(CF, bucket, s) == 0){
+            Cuckoo_Put(CF, bucket, s, fp);
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool Cuckoo_Has(const CuckooFilter &CF, uint64_t bucket, uint32_t fp)
+{
+    bool hit = false;
+    for(unsigned int s=0;s<CUCKOO_BUCKET_SLOTS;++s){
+        hit |= (Cuckoo_Get(CF, bucket, s) == fp);
+    }
+    return hit;
+}
+
+unsigned int CuckooFilter_BucketBits(uint64_t n_items, double max_load)
+{
+    unsigned int bits = 1;
+    while((bits < CUCKOO_MAX_BUCKET_BITS) && ((double)CUCKOO_BUCKET_SLOTS * (double)(1ULL << bits) * max_load < (double)n_items)){
+        bits++;
+    }
+    return bits;
+}
+
+double CuckooFilter_DesignLoad(double target_fpr, unsigned int fp_bits)
+{
+    // Inverse of FPR ~ 2 x slots x load / (2^f - 1), clamped to [CUCKOO_MIN_LOAD, CUCKOO_MAX_LOAD]
+    double load = target_fpr * (double)((1u << fp_bits) - 1) / (2.0*CUCKOO_BUCKET_SLOTS);
+    return std::min(CUCKOO_MAX_LOAD, std::max(CUCKOO_MIN_LOAD, load));
+}
+
+int CuckooFilter_Init(CuckooFilter &CF, unsigned int bucket_bits, unsigned int fp_bits)
+{
+    if((bucket_bits == 0) || (bucket_bits > CUCKOO_MAX_BUCKET_BITS) || ((fp_bits != 8) && (fp_bits != 16))){
+        return -1;
+    }
+    CF.bucket_bits = bucket_bits;
+    CF.fp_bits = fp_bits;
+    CF.n_buckets = 1ULL << bucket_bits;
+    CF.n_items = 0;
+
+    size_t n_bytes = CuckooFilter_Bytes(CF);
+    CF.table = aligned_alloc(64, (n_bytes + 63) & ~(size_t)63);
+    ::memset(CF.table,0x00,n_bytes);
+    CF.owned = true;
+    return 0;
+}
+
+int CuckooFilter_Insert(CuckooFilter &CF, uint64_t key)
+{
+    uint32_t fp = Cuckoo_Fingerprint(CF, key);
+    uint64_t i1 = Cuckoo_Bucket(CF, key);
+    uint64_t i2 = Cuckoo_AltBucket(CF, i1, fp);
+
+    if(Cuckoo_TryPut(CF, i1, fp) || Cuckoo_TryPut(CF, i2, fp)){
+        CF.n_items++;
+        return 0;
+    }
+
+    //Both full: evict along a random walk; the state is derived from the key so builds are reproducible
+    uint64_t rng = key | 1;
+    uint64_t bucket = (key >> 63) ? i2 : i1;
+    for(int n=0;n<CUCKOO_MAX_KICKS;++n){
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        unsigned int slot = (unsigned int)(rng % CUCKOO_BUCKET_SLOTS);
+        uint32_t victim = Cuckoo_Get(CF, bucket, slot);
+        Cuckoo_Put(CF, bucket, slot, fp);
+        fp = victim;
+        bucket = Cuckoo_AltBucket(CF, bucket, fp);
+        if(Cuckoo_TryPut(CF, bucket, fp)){
+            CF.n_items++;
+            return 0;
+        }
+    }
+    return -1;                              //A fingerprint is now homeless; the table must be rebuilt
+}
+
+int CuckooFilter_Populate(CuckooFilter &CF, const uint64_t *keys, size_t n_keys)
+{
+    for(size_t i=0;i<n_keys;++i){
+        if(CuckooFilter_Insert(CF, keys[i]) != 0){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+bool CuckooFilter_Contain(const CuckooFilter &CF, uint64_t key)
+{
+    uint32_t fp = Cuckoo_Fingerprint(CF, key);
+    uint64_t i1 = Cuckoo_Bucket(CF, key);
+    uint64_t i2 = Cuckoo_AltBucket(CF, i1, fp);
+    return Cuckoo_Has(CF, i1, fp) || Cuckoo_Has(CF, i2, fp);
+}
+
+void CuckooFilter_Prefetch(const CuckooFilter &CF, uint64_t key)
+{
+    uint32_t fp = Cuckoo_Fingerprint(CF, key);
+    uint64_t i1 = Cuckoo_Bucket(CF, key);
+    uint64_t i2 = Cuckoo_AltBucket(CF, i1, fp);
+    size_t bucket_bytes = CUCKOO_BUCKET_SLOTS*(CF.fp_bits >> 3);
+    __builtin_prefetch((const unsigned char *)CF.table + i1*bucket_bytes, 0, 1);
+    __builtin_prefetch((const unsigned char *)CF.table + i2*bucket_bytes, 0, 1);
+}
+
+double CuckooFilter_FPR(const CuckooFilter &CF)
+{
+    // Each occupied slot of the two buckets matches with probability 1/(2^f - 1)
+    double occupied = 2.0*CUCKOO_BUCKET_SLOTS * (double)CF.n_items / ((double)CUCKOO_BUCKET_SLOTS * (double)CF.n_buckets);
+    return -std::expm1(occupied * std::log1p(-1.0 / (double)((1u << CF.fp_bits) - 1)));
+}
+
+size_t CuckooFilter_Bytes(const CuckooFilter &CF)
+{
+    return (size_t)CF.n_buckets * CUCKOO_BUCKET_SLOTS * (CF.fp_bits >> 3);
+}
+
+int CuckooFilter_Clean(CuckooFilter &CF)
+{
+    if(CF.owned){
+        free(CF.table);
+    }
+    CF.table = nullptr;
+    CF.owned = false;
+    return 0;
+}
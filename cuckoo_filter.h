@@ -0,0 +1,41 @@
+#ifndef CUCKOOFILTER_H
+#define CUCKOOFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define CUCKOO_BUCKET_SLOTS 4
+#define CUCKOO_MAX_KICKS 500                //Evictions before an insert fails
+#define CUCKOO_MAX_LOAD 0.95                //Highest occupancy the bucket count is sized for
+#define CUCKOO_MIN_LOAD 0.25                //Lowest design occupancy; below it the table grows for little FPR gain
+#define CUCKOO_MAX_BUCKET_BITS 32
+
+/*
+ * Cuckoo filter over 64-bit keys with partial-key cuckoo hashing: a key
+ * stores a nonzero fp_bits fingerprint in one of two 4-slot buckets, the
+ * second bucket derived from the first and the fingerprint alone. A probe
+ * reads two buckets. FPR is about 8 x load / 2^fp_bits; fp_bits is 8 or 16.
+ * Keys are expected to be hash outputs already: the low bits give the
+ * fingerprint, the high 32 bits the first bucket.
+ */
+typedef struct {
+    unsigned int bucket_bits;
+    unsigned int fp_bits;
+    uint64_t n_buckets;                     //2^bucket_bits
+    uint64_t n_items;
+    void *table;                            //n_buckets x CUCKOO_BUCKET_SLOTS fingerprints, 0 = empty, 64B-aligned
+    bool owned;                             //false when table points into a mapped file
+} CuckooFilter;
+
+unsigned int CuckooFilter_BucketBits(uint64_t n_items, double max_load = CUCKOO_MAX_LOAD);
+double CuckooFilter_DesignLoad(double target_fpr, unsigned int fp_bits);
+int CuckooFilter_Init(CuckooFilter &CF, unsigned int bucket_bits, unsigned int fp_bits);
+int CuckooFilter_Insert(CuckooFilter &CF, uint64_t key);
+int CuckooFilter_Populate(CuckooFilter &CF, const uint64_t *keys, size_t n_keys);
+bool CuckooFilter_Contain(const CuckooFilter &CF, uint64_t key);
+void CuckooFilter_Prefetch(const CuckooFilter &CF, uint64_t key);
+double CuckooFilter_FPR(const CuckooFilter &CF);
+size_t CuckooFilter_Bytes(const CuckooFilter &CF);
+int CuckooFilter_Clean(CuckooFilter &CF);
+
+#endif // CUCKOOFILTER_H
@@ -0,0 +1,288 @@
+#include "fuse_filter.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+static inline uint64_t Fuse_Murmur64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t Fuse_SplitMix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t Fuse_MulHi(uint64_t a, uint64_t b)
+{
+    return (uint64_t)(((unsigned __int128)a * b) >> 64);
+}
+
+static inline uint8_t Fuse_Mod3(uint8_t x)
+{
+    return (x > 2) ? x - 3 : x;
+}
+
+static inline uint32_t Fuse_Fingerprint(const FuseFilter &FF, uint64_t hash)
+{
+    return (uint32_t)(hash ^ (hash >> 32)) & ((1u << FF.fp_bits) - 1);
+}
+
+static inline uint32_t Fuse_Hash(const FuseFilter &FF, uint64_t index, uint64_t hash)
+{
+    // Slot `index` (0..2) of a key: segment from the high product, offset within it from 18-bit chunks of the hash
+    uint64_t h = Fuse_MulHi(hash, FF.segment_count_length);
+    h += index * FF.segment_length;
+    uint64_t hh = hash & ((1ULL << 36) - 1);
+    h ^= (hh >> (36 - 18*index)) & FF.segment_length_mask;
+    return (uint32_t)h;
+}
+
+static inline uint32_t Fuse_Get(const FuseFilter &FF, uint32_t i)
+{
+    return (FF.fp_bits == 8) ? ((const uint8_t *)FF.fingerprints)[i] : ((const uint16_t *)FF.fingerprints)[i];
+}
+
+static inline void Fuse_Put(FuseFilter &FF, uint32_t i, uint32_t v)
+{
+    if(FF.fp_bits == 8){
+        ((uint8_t *)FF.fingerprints)[i] = (uint8_t)v;
+    }
+    else{
+        ((uint16_t *)FF.fingerprints)[i] = (uint16_t)v;
+    }
+}
+
+int FuseFilter_Geometry(FuseFilter &FF, uint64_t n_items, unsigned int fp_bits)
+{
+    // Segment length and count as in the reference construction; the
+    // parameters are sensitive, e.g. round instead of floor slows building
+    if((n_items > UINT32_MAX) || ((fp_bits != 8) && (fp_bits != 16))){
+        return -1;
+    }
+    uint32_t size = (uint32_t)n_items;
+
+    FF.fp_bits = fp_bits;
+    FF.n_items = n_items;
+    FF.segment_length = (size == 0) ? 4 : (1u << (int)std::floor(std::log((double)size) / std::log(3.33) + 2.25));
+    if(FF.segment_length > FUSE_MAX_SEGMENT_LENGTH){
+        FF.segment_length = FUSE_MAX_SEGMENT_LENGTH;
+    }
+    FF.segment_length_mask = FF.segment_length - 1;
+
+    double size_factor = (size <= 1) ? 0.0 : std::fmax(1.125, 0.875 + 0.25*std::log(1000000.0) / std::log((double)size));
+    uint32_t capacity = (size <= 1) ? 0 : (uint32_t)std::round((double)size * size_factor);
+    uint32_t init_segment_count = (capacity + FF.segment_length - 1) / FF.segment_length - (FUSE_ARITY - 1);
+    FF.array_length = (init_segment_count + FUSE_ARITY - 1) * FF.segment_length;
+    FF.segment_count = (FF.array_length + FF.segment_length - 1) / FF.segment_length;
+    FF.segment_count = (FF.segment_count <= FUSE_ARITY - 1) ? 1 : FF.segment_count - (FUSE_ARITY - 1);
+    FF.array_length = (FF.segment_count + FUSE_ARITY - 1) * FF.segment_length;
+    FF.segment_count_length = FF.segment_count * FF.segment_length;
+    return 0;
+}
+
+int FuseFilter_Init(FuseFilter &FF, uint64_t n_items, unsigned int fp_bits)
+{
+    if(FuseFilter_Geometry(FF, n_items, fp_bits) != 0){
+        return -1;
+    }
+    size_t n_bytes = FuseFilter_Bytes(FF);
+    FF.seed = 0;
+    FF.fingerprints = aligned_alloc(64, (n_bytes + 63) & ~(size_t)63);
+    ::memset(FF.fingerprints,0x00,n_bytes);
+    FF.owned = true;
+    return 0;
+}
+
+int FuseFilter_Populate(FuseFilter &FF, const uint64_t *keys, size_t n_keys)
+{
+    // Hash keys into segment order, peel slots holding a single key onto a
+    // stack, then assign fingerprints in reverse peeling order. A failed
+    // peel retries with a fresh seed. Duplicate keys are tolerated.
+    if(n_keys > FF.n_items){
+        return -1;
+    }
+    uint32_t size = (uint32_t)n_keys;
+    uint32_t capacity = FF.array_length;
+    uint64_t rng_counter = 0x726b2b9d438b9d4dULL;
+    FF.seed = Fuse_SplitMix64(&rng_counter);
+
+    std::vector<uint64_t> reverse_order(size + 1, 0);
+    std::vector<uint32_t> alone(capacity);
+    std::vector<uint8_t> t2count(capacity, 0);
+    std::vector<uint8_t> reverse_h(size);
+    std::vector<uint64_t> t2hash(capacity, 0);
+
+    uint32_t block_bits = 1;
+    while((1u << block_bits) < FF.segment_count){
+        block_bits++;
+    }
+    uint32_t block = 1u << block_bits;
+    uint32_t mask_block = block - 1;
+    std::vector<uint32_t> start_pos(block);
+
+    uint32_t h012[5];
+    uint32_t stack_size = 0;
+    uint32_t duplicates = 0;
+    reverse_order[size] = 1;                //Sentinel for the segment-order placement
+
+    for(int loop=0;;++loop){
+        if(loop + 1 > FUSE_MAX_ITERATIONS){
+            ::memset(FF.fingerprints,0x00,FuseFilter_Bytes(FF));
+            return -1;
+        }
+
+        for(uint32_t i=0;i<block;++i){
+            start_pos[i] = (uint32_t)(((uint64_t)i * size) >> block_bits);
+        }
+        for(uint32_t i=0;i<size;++i){
+            uint64_t hash = Fuse_Murmur64(keys[i] + FF.seed);
+            uint32_t segment_index = (uint32_t)(hash >> (64 - block_bits));
+            while(reverse_order[start_pos[segment_index]] != 0){
+                segment_index = (segment_index + 1) & mask_block;
+            }
+            reverse_order[start_pos[segment_index]] = hash;
+            start_pos[segment_index]++;
+        }
+
+        bool error = false;
+        duplicates = 0;
+        for(uint32_t i=0;i<size;++i){
+            uint64_t hash = reverse_order[i];
+            uint32_t h0 = Fuse_Hash(FF, 0, hash);
+            uint32_t h1 = Fuse_Hash(FF, 1, hash);
+            uint32_t h2 = Fuse_Hash(FF, 2, hash);
+            t2count[h0] += 4;
+            t2hash[h0] ^= hash;
+            t2count[h1] += 4;
+            t2count[h1] ^= 1;
+            t2hash[h1] ^= hash;
+            t2count[h2] += 4;
+            t2count[h2] ^= 2;
+            t2hash[h2] ^= hash;
+
+            //Two identical hashes cancel in t2hash; drop the second copy
+            if((t2hash[h0] & t2hash[h1] & t2hash[h2]) == 0){
+                if(((t2hash[h0] == 0) && (t2count[h0] == 8)) || ((t2hash[h1] == 0) && (t2count[h1] == 8))
+                   || ((t2hash[h2] == 0) && (t2count[h2] == 8))){
+                    duplicates++;
+                    t2count[h0] -= 4;
+                    t2hash[h0] ^= hash;
+                    t2count[h1] -= 4;
+                    t2count[h1] ^= 1;
+                    t2hash[h1] ^= hash;
+                    t2count[h2] -= 4;
+                    t2count[h2] ^= 2;
+                    t2hash[h2] ^= hash;
+                }
+            }
+            error = error || (t2count[h0] < 4) || (t2count[h1] < 4) || (t2count[h2] < 4);
+        }
+
+        if(!error){
+            uint32_t q_size = 0;
+            for(uint32_t i=0;i<capacity;++i){
+                alone[q_size] = i;
+                q_size += ((t2count[i] >> 2) == 1) ? 1 : 0;
+            }
+
+            stack_size = 0;
+            while(q_size > 0){
+                q_size--;
+                uint32_t index = alone[q_size];
+                if((t2count[index] >> 2) != 1){
+                    continue;
+                }
+                uint64_t hash = t2hash[index];
+                uint8_t found = t2count[index] & 3;
+                reverse_h[stack_size] = found;
+                reverse_order[stack_size] = hash;
+                stack_size++;
+
+                h012[1] = Fuse_Hash(FF, 1, hash);
+                h012[2] = Fuse_Hash(FF, 2, hash);
+                h012[3] = Fuse_Hash(FF, 0, hash);
+                h012[4] = h012[1];
+
+                for(uint8_t d=1;d<=2;++d){
+                    uint32_t other = h012[found + d];
+                    alone[q_size] = other;
+                    q_size += ((t2count[other] >> 2) == 2) ? 1 : 0;
+                    t2count[other] -= 4;
+                    t2count[other] ^= Fuse_Mod3(found + d);
+                    t2hash[other] ^= hash;
+                }
+            }
+
+            if(stack_size + duplicates == size){
+                break;
+            }
+        }
+
+        std::fill(reverse_order.begin(), reverse_order.begin() + size, 0);
+        std::fill(t2count.begin(), t2count.end(), 0);
+        std::fill(t2hash.begin(), t2hash.end(), 0);
+        FF.seed = Fuse_SplitMix64(&rng_counter);
+    }
+
+    for(int64_t i=(int64_t)stack_size-1;i>=0;--i){
+        uint64_t hash = reverse_order[i];
+        uint8_t found = reverse_h[i];
+        h012[0] = Fuse_Hash(FF, 0, hash);
+        h012[1] = Fuse_Hash(FF, 1, hash);
+        h012[2] = Fuse_Hash(FF, 2, hash);
+        h012[3] = h012[0];
+        h012[4] = h012[1];
+        Fuse_Put(FF, h012[found], Fuse_Fingerprint(FF, hash) ^ Fuse_Get(FF, h012[found+1]) ^ Fuse_Get(FF, h012[found+2]));
+    }
+    return 0;
+}
+
+bool FuseFilter_Contain(const FuseFilter &FF, uint64_t key)
+{
+    uint64_t hash = Fuse_Murmur64(key + FF.seed);
+    uint32_t h0 = (uint32_t)Fuse_MulHi(hash, FF.segment_count_length);
+    uint32_t h1 = h0 + FF.segment_length;
+    uint32_t h2 = h1 + FF.segment_length;
+    h1 ^= (uint32_t)(hash >> 18) & FF.segment_length_mask;
+    h2 ^= (uint32_t)hash & FF.segment_length_mask;
+
+    uint32_t f = Fuse_Fingerprint(FF, hash);
+    f ^= Fuse_Get(FF, h0) ^ Fuse_Get(FF, h1) ^ Fuse_Get(FF, h2);
+    return f == 0;
+}
+
+void FuseFilter_Prefetch(const FuseFilter &FF, uint64_t key)
+{
+    uint64_t hash = Fuse_Murmur64(key + FF.seed);
+    size_t w = FF.fp_bits >> 3;
+    const unsigned char *base = (const unsigned char *)FF.fingerprints;
+    for(uint64_t j=0;j<FUSE_ARITY;++j){
+        __builtin_prefetch(base + w*Fuse_Hash(FF, j, hash), 0, 1);
+    }
+}
+
+size_t FuseFilter_Bytes(const FuseFilter &FF)
+{
+    return (size_t)FF.array_length * (FF.fp_bits >> 3);
+}
+
+int FuseFilter_Clean(FuseFilter &FF)
+{
+    if(FF.owned){
+        free(FF.fingerprints);
+    }
+    FF.fingerprints = nullptr;
+    FF.owned = false;
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef FUSEFILTER_H
+#define FUSEFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define FUSE_ARITY 3
+#define FUSE_MAX_ITERATIONS 100             //Seeds tried before construction gives up
+#define FUSE_MAX_SEGMENT_LENGTH 262144
+
+/*
+ * Static 3-wise binary fuse filter (Graf & Lemire) over 64-bit keys. An
+ * element is present iff the xor of the fingerprints at its three slots
+ * equals its own fingerprint, so a probe reads three entries of one
+ * fp_bits-wide array. Space is about 1.13 x fp_bits bits per element at
+ * FPR 2^-fp_bits; fp_bits is 8 or 16. The geometry is a function of the
+ * element count alone, so a filter file only has to carry n_items, the
+ * seed and fp_bits.
+ */
+typedef struct {
+    uint64_t seed;
+    uint32_t segment_length;
+    uint32_t segment_length_mask;
+    uint32_t segment_count;
+    uint32_t segment_count_length;
+    uint32_t array_length;
+    unsigned int fp_bits;
+    uint64_t n_items;                       //Element count the geometry was derived for
+    void *fingerprints;                     //array_length entries of fp_bits, 64B-aligned
+    bool owned;                             //false when fingerprints points into a mapped file
+} FuseFilter;
+
+int FuseFilter_Geometry(FuseFilter &FF, uint64_t n_items, unsigned int fp_bits);
+int FuseFilter_Init(FuseFilter &FF, uint64_t n_items, unsigned int fp_bits);
+int FuseFilter_Populate(FuseFilter &FF, const uint64_t *keys, size_t n_keys);
+bool FuseFilter_Contain(const FuseFilter &FF, uint64_t key);
+void FuseFilter_Prefetch(const FuseFilter &FF, uint64_t key);
+size_t FuseFilter_Bytes(const FuseFilter &FF);
+int FuseFilter_Clean(FuseFilter &FF);
+
+#endif // FUSEFILTER_H
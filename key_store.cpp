@@ -0,0 +1,177 @@
+#include "key_store.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static void KeyStore_Checksum(const KeyStoreData *kd, unsigned char *digest)
+{
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, kd, sizeof(KeyStoreData));
+    blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+}
+
+int KeyStore_Generate(KeyStoreData *kd, const unsigned char *seed, size_t seed_len)
+{
+    //Same derivation the tools always used: twelve keygen rounds on one SHAKE stream
+    inner_shake256_context sc_keygen;
+    std::vector<uint64_t> tt_keygen(FALCON_TMPSIZE_KEYGEN(KEYSTORE_LOGN)/8 + 1);
+    std::vector<uint64_t> tt_expand(FALCON_TMPSIZE_EXPANDPRIV(KEYSTORE_LOGN)/8 + 1);
+
+    ::memset(kd,0x00,sizeof(KeyStoreData));
+
+    inner_shake256_init(&sc_keygen);
+    inner_shake256_inject(&sc_keygen, seed, seed_len);
+    inner_shake256_flip(&sc_keygen);
+
+    for (int i = 0; i < 12; i ++) {
+        Zf(keygen)(&sc_keygen, kd->f, kd->g, kd->F, kd->G, kd->h, KEYSTORE_LOGN, (uint8_t *)tt_keygen.data());
+    }
+
+    Zf(expand_privkey)(kd->expanded_key, kd->f, kd->g, kd->F, kd->G, KEYSTORE_LOGN, (uint8_t *)tt_expand.data());
+
+    return 0;
+}
+
+int KeyStore_Write(std::string key_file, const KeyStoreData *kd)
+{
+    KeyStoreHeader hdr;
+    ::memset(&hdr,0x00,sizeof(hdr));
+    ::memcpy(hdr.magic,KEYSTORE_MAGIC,8);
+    hdr.version = KEYSTORE_VERSION;
+    hdr.logn = KEYSTORE_LOGN;
+    hdr.fpr_native = FALCON_FPNATIVE;
+    hdr.payload_bytes = sizeof(KeyStoreData);
+    KeyStore_Checksum(kd, hdr.checksum);
+
+    //Write aside and rename, so a concurrent reader never maps a partial file
+    std::string tmp_file = key_file + ".tmp";
+    //Owner-only from creation; a leftover tmp file is refused rather than reused
+    int fd = open(tmp_file.c_str(), O_WRONLY|O_CREAT|O_EXCL|O_TRUNC, S_IRUSR|S_IWUSR);
+    if(fd < 0){
+        if(errno == EEXIST){
+            std::cerr << "Key file " << tmp_file << " already exists; remove it if no other writer is running" << std::endl;
+        }else{
+            std::cerr << "Cannot open key file " << tmp_file << std::endl;
+        }
+        return -1;
+    }
+    FILE *fp = fdopen(fd,"wb");
+    if(fp == NULL){
+        std::cerr << "Cannot open key file " << tmp_file << std::endl;
+        close(fd);
+        unlink(tmp_file.c_str());
+        return -1;
+    }
+    bool ok = (fwrite(&hdr,sizeof(hdr),1,fp) == 1) && (fwrite(kd,sizeof(KeyStoreData),1,fp) == 1);
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || (rename(tmp_file.c_str(),key_file.c_str()) != 0)){
+        std::cerr << "Cannot write key file " << key_file << std::endl;
+        unlink(tmp_file.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int KeyStore_Map(KeyStore &ks, std::string key_file)
+{
+    //Returns 0 when mapped, 1 when the file does not exist, -1 when it is unusable
+    ks.data = nullptr;
+    ks.map = NULL;
+    ks.map_len = 0;
+    ks.owned = nullptr;
+
+    int fd = open(key_file.c_str(), O_RDONLY);
+    if(fd < 0){
+        return (errno == ENOENT) ? 1 : -1;
+    }
+
+    struct stat st;
+    size_t len = sizeof(KeyStoreHeader) + sizeof(KeyStoreData);
+    if((fstat(fd,&st) != 0) || ((size_t)st.st_size != len)){
+        std::cerr << "Key file " << key_file << " has the wrong size" << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        std::cerr << "Cannot map key file " << key_file << std::endl;
+        return -1;
+    }
+
+    const KeyStoreHeader *hdr = (const KeyStoreHeader *)map;
+    const KeyStoreData *kd = (const KeyStoreData *)((const unsigned char *)map + sizeof(KeyStoreHeader));
+    unsigned char checksum[BLAKE3_OUT_LEN];
+
+    bool valid = (::memcmp(hdr->magic,KEYSTORE_MAGIC,8) == 0) && (hdr->version == KEYSTORE_VERSION)
+              && (hdr->logn == KEYSTORE_LOGN) && (hdr->fpr_native == FALCON_FPNATIVE)
+              && (hdr->payload_bytes == sizeof(KeyStoreData));
+    if(valid){
+        KeyStore_Checksum(kd, checksum);
+        valid = (::memcmp(checksum,hdr->checksum,BLAKE3_OUT_LEN) == 0);
+    }
+    if(!valid){
+        std::cerr << "Key file " << key_file << " failed its header or checksum check" << std::endl;
+        munmap(map, len);
+        return -1;
+    }
+
+    ks.map = map;
+    ks.map_len = len;
+    ks.data = kd;
+    return 0;
+}
+
+int KeyStore_Open(KeyStore &ks, std::string key_file, const unsigned char *seed, size_t seed_len, KeyStoreSymKeys &sym)
+{
+    int rc = KeyStore_Map(ks, key_file);
+    if(rc < 0) return -1;
+
+    if(rc > 0){
+        //First run: generate from the seed and the built-in symmetric keys, then persist
+        KeyStoreData *kd = new KeyStoreData;
+        KeyStore_Generate(kd, seed, seed_len);
+        ::memcpy(kd->KS,sym.KS,32);
+        ::memcpy(kd->KI,sym.KI,32);
+        ::memcpy(kd->KZ,sym.KZ,32);
+        ::memcpy(kd->KX,sym.KX,32);
+        ::memcpy(kd->KR,sym.KR,32);
+        ::memcpy(kd->KT,sym.KT,32);
+        ks.owned = kd;
+        ks.data = kd;
+
+        if(KeyStore_Write(key_file, kd) == 0){
+            std::cout << "Client keys written to " << key_file << std::endl;
+        }else{
+            std::cerr << "Client keys were not persisted to " << key_file << "; this run uses them in memory only" << std::endl;
+        }
+        return 0;
+    }
+
+    ::memcpy(sym.KS,ks.data->KS,32);
+    ::memcpy(sym.KI,ks.data->KI,32);
+    ::memcpy(sym.KZ,ks.data->KZ,32);
+    ::memcpy(sym.KX,ks.data->KX,32);
+    ::memcpy(sym.KR,ks.data->KR,32);
+    ::memcpy(sym.KT,ks.data->KT,32);
+    return 0;
+}
+
+int KeyStore_Clean(KeyStore &ks)
+{
+    if(ks.map != NULL){
+        munmap(ks.map, ks.map_len);
+    }
+    delete ks.owned;
+    ks.data = nullptr;
+    ks.map = NULL;
+    ks.owned = nullptr;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef KEYSTORE_H
+#define KEYSTORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "utils.h"
+#include "./blake3/blake3.h"
+#include "../../NTRU-OQXT/falcon-round3/Extra/c/falcon.h"
+#include "../../NTRU-OQXT/falcon-round3/Extra/c/inner.h"
+
+#define KEYSTORE_MAGIC "OQXTKEY1"
+#define KEYSTORE_VERSION 1
+#define KEYSTORE_LOGN 9
+#define KEYSTORE_EXPKEY_BYTES ((8*KEYSTORE_LOGN + 40) << KEYSTORE_LOGN)
+
+/*
+ * Client key material: the Falcon key pair, the expanded private key (LDL
+ * tree) used by sign_tree and the initial symmetric keys. Written once and
+ * mmap'd read-only afterwards, so neither setup nor search reruns keygen.
+ */
+typedef struct {
+    int8_t f[N_l];
+    int8_t g[N_l];
+    int8_t F[N_l];
+    int8_t G[N_l];
+    uint16_t h[N_l];                        //Public key, coefficient form mod p_l
+    unsigned char KS[32];
+    unsigned char KI[32];
+    unsigned char KZ[32];
+    unsigned char KX[32];
+    unsigned char KR[32];
+    unsigned char KT[32];
+    fpr expanded_key[KEYSTORE_EXPKEY_BYTES/sizeof(fpr)];
+} KeyStoreData;
+
+/*
+ * File layout: this 64B header, then one KeyStoreData. The checksum is the
+ * BLAKE3 hash of the payload; fpr_native records the float representation
+ * the expanded key was built with.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t logn;
+    uint32_t fpr_native;
+    uint32_t payload_bytes;
+    unsigned char checksum[BLAKE3_OUT_LEN];
+    unsigned char reserved[8];
+} KeyStoreHeader;
+
+typedef struct {
+    const KeyStoreData *data;
+    void *map;                              //mmap of the key file, NULL when generated in memory
+    size_t map_len;
+    KeyStoreData *owned;
+} KeyStore;
+
+//The process-wide symmetric key arrays, filled from (or saved to) the store
+typedef struct {
+    unsigned char *KS, *KI, *KZ, *KX, *KR, *KT;
+} KeyStoreSymKeys;
+
+int KeyStore_Generate(KeyStoreData *kd, const unsigned char *seed, size_t seed_len);
+int KeyStore_Write(std::string key_file, const KeyStoreData *kd);
+int KeyStore_Map(KeyStore &ks, std::string key_file);
+int KeyStore_Open(KeyStore &ks, std::string key_file, const unsigned char *seed, size_t seed_len, KeyStoreSymKeys &sym);
+int KeyStore_Clean(KeyStore &ks);
+
+#endif // KEYSTORE_H
@@ -0,0 +1,28 @@
+#ifndef MQ_NTT_H
+#define MQ_NTT_H
+
+#include <cstdint>
+#include <cstddef>
+#include "utils.h"
+
+/*
+ * Arithmetic modulo p_l = 12289 for the Falcon ring: NTT, inverse NTT,
+ * Montgomery products (R = 2^16) and the s-term mask product. Each entry
+ * point dispatches at runtime to an AVX2 kernel (16 uint16 lanes) when the
+ * CPU supports it and falls back to the scalar code otherwise; both paths
+ * give bit-identical results. MQ_Init must be called once before use.
+ * Only MQ_PolyMulScalar is on the setup/search hot paths (the s-term
+ * mask product); xid and xtag no longer go through the mod-p_l NTT, so
+ * the NTT entry points are exercised only by test_kernels.
+ */
+
+int MQ_Init();
+int MQ_HasAVX2();
+int MQ_SetAVX2(int on);
+void MQ_NTT(uint16_t *a, unsigned logn);
+void MQ_iNTT(uint16_t *a, unsigned logn);
+void MQ_PolyToMonty(uint16_t *f, unsigned logn);
+void MQ_PolyMontymulNTT(uint16_t *f, const uint16_t *g, unsigned logn);
+void MQ_PolyMulScalar(int16_t *out, const int16_t *in, int32_t c, size_t n);
+
+#endif // MQ_NTT_H
@@ -1,4 +1,4 @@
-#include "ntru-oqxt-setup.h"
+#include "ntru-oqxt-search.h"
 
 #define TEMPALLOC
 #define CRYPTO_SECRETKEYBYTES   1281
@@ -17,279 +17,6 @@
 #define R_large      2523
 #define R2_large    22298801
 
-/*
- * Table for NTT, binary case:
- *   GMb[x] = R1*(g^rev(x)) mod q
- * where g = 7 (it is a 2048-th primitive root of 1 modulo q)
- * and rev() is the bit-reversal function over 10 bits.
- */
-static const uint16_t GMb[] = {
-	 4091,  7888, 11060, 11208,  6960,  4342,  6275,  9759,
-	 1591,  6399,  9477,  5266,   586,  5825,  7538,  9710,
-	 1134,  6407,  1711,   965,  7099,  7674,  3743,  6442,
-	10414,  8100,  1885,  1688,  1364, 10329, 10164,  9180,
-	12210,  6240,   997,   117,  4783,  4407,  1549,  7072,
-	 2829,  6458,  4431,  8877,  7144,  2564,  5664,  4042,
-	12189,   432, 10751,  1237,  7610,  1534,  3983,  7863,
-	 2181,  6308,  8720,  6570,  4843,  1690,    14,  3872,
-	 5569,  9368, 12163,  2019,  7543,  2315,  4673,  7340,
-	 1553,  1156,  8401, 11389,  1020,  2967, 10772,  7045,
-	 3316, 11236,  5285, 11578, 10637, 10086,  9493,  6180,
-	 9277,  6130,  3323,   883, 10469,   489,  1502,  2851,
-	11061,  9729,  2742, 12241,  4970, 10481, 10078,  1195,
-	  730,  1762,  3854,  2030,  5892, 10922,  9020,  5274,
-	 9179,  3604,  3782, 10206,  3180,  3467,  4668,  2446,
-	 7613,  9386,   834,  7703,  6836,  3403,  5351, 12276,
-	 3580,  1739, 10820,  9787, 10209,  4070, 12250,  8525,
-	10401,  2749,  7338, 10574,  6040,   943,  9330,  1477,
-	 6865,  9668,  3585,  6633, 12145,  4063,  3684,  7680,
-	 8188,  6902,  3533,  9807,  6090,   727, 10099,  7003,
-	 6945,  1949,  9731, 10559,  6057,   378,  7871,  8763,
-	 8901,  9229,  8846,  4551,  9589, 11664,  7630,  8821,
-	 5680,  4956,  6251,  8388, 10156,  8723,  2341,  3159,
-	 1467,  5460,  8553,  7783,  2649,  2320,  9036,  6188,
-	  737,  3698,  4699,  5753,  9046,  3687,    16,   914,
-	 5186, 10531,  4552,  1964,  3509,  8436,  7516,  5381,
-	10733,  3281,  7037,  1060,  2895,  7156,  8887,  5357,
-	 6409,  8197,  2962,  6375,  5064,  6634,  5625,   278,
-	  932, 10229,  8927,  7642,   351,  9298,   237,  5858,
-	 7692,  3146, 12126,  7586,  2053, 11285,  3802,  5204,
-	 4602,  1748, 11300,   340,  3711,  4614,   300, 10993,
-	 5070, 10049, 11616, 12247,  7421, 10707,  5746,  5654,
-	 3835,  5553,  1224,  8476,  9237,  3845,   250, 11209,
-	 4225,  6326,  9680, 12254,  4136,  2778,   692,  8808,
-	 6410,  6718, 10105, 10418,  3759,  7356, 11361,  8433,
-	 6437,  3652,  6342,  8978,  5391,  2272,  6476,  7416,
-	 8418, 10824, 11986,  5733,   876,  7030,  2167,  2436,
-	 3442,  9217,  8206,  4858,  5964,  2746,  7178,  1434,
-	 7389,  8879, 10661, 11457,  4220,  1432, 10832,  4328,
-	 8557,  1867,  9454,  2416,  3816,  9076,   686,  5393,
-	 2523,  4339,  6115,   619,   937,  2834,  7775,  3279,
-	 2363,  7488,  6112,  5056,   824, 10204, 11690,  1113,
-	 2727,  9848,   896,  2028,  5075,  2654, 10464,  7884,
-	12169,  5434,  3070,  6400,  9132, 11672, 12153,  4520,
-	 1273,  9739, 11468,  9937, 10039,  9720,  2262,  9399,
-	11192,   315,  4511,  1158,  6061,  6751, 11865,   357,
-	 7367,  4550,   983,  8534,  8352, 10126,  7530,  9253,
-	 4367,  5221,  3999,  8777,  3161,  6990,  4130, 11652,
-	 3374, 11477,  1753,   292,  8681,  2806, 10378, 12188,
-	 5800, 11811,  3181,  1988,  1024,  9340,  2477, 10928,
-	 4582,  6750,  3619,  5503,  5233,  2463,  8470,  7650,
-	 7964,  6395,  1071,  1272,  3474, 11045,  3291, 11344,
-	 8502,  9478,  9837,  1253,  1857,  6233,  4720, 11561,
-	 6034,  9817,  3339,  1797,  2879,  6242,  5200,  2114,
-	 7962,  9353, 11363,  5475,  6084,  9601,  4108,  7323,
-	10438,  9471,  1271,   408,  6911,  3079,   360,  8276,
-	11535,  9156,  9049, 11539,   850,  8617,   784,  7919,
-	 8334, 12170,  1846, 10213, 12184,  7827, 11903,  5600,
-	 9779,  1012,   721,  2784,  6676,  6552,  5348,  4424,
-	 6816,  8405,  9959,  5150,  2356,  5552,  5267,  1333,
-	 8801,  9661,  7308,  5788,  4910,   909, 11613,  4395,
-	 8238,  6686,  4302,  3044,  2285, 12249,  1963,  9216,
-	 4296, 11918,   695,  4371,  9793,  4884,  2411, 10230,
-	 2650,   841,  3890, 10231,  7248,  8505, 11196,  6688,
-	 4059,  6060,  3686,  4722, 11853,  5816,  7058,  6868,
-	11137,  7926,  4894, 12284,  4102,  3908,  3610,  6525,
-	 7938,  7982, 11977,  6755,   537,  4562,  1623,  8227,
-	11453,  7544,   906, 11816,  9548, 10858,  9703,  2815,
-	11736,  6813,  6979,   819,  8903,  6271, 10843,   348,
-	 7514,  8339,  6439,   694,   852,  5659,  2781,  3716,
-	11589,  3024,  1523,  8659,  4114, 10738,  3303,  5885,
-	 2978,  7289, 11884,  9123,  9323, 11830,    98,  2526,
-	 2116,  4131, 11407,  1844,  3645,  3916,  8133,  2224,
-	10871,  8092,  9651,  5989,  7140,  8480,  1670,   159,
-	10923,  4918,   128,  7312,   725,  9157,  5006,  6393,
-	 3494,  6043, 10972,  6181, 11838,  3423, 10514,  7668,
-	 3693,  6658,  6905, 11953, 10212, 11922,  9101,  8365,
-	 5110,    45,  2400,  1921,  4377,  2720,  1695,    51,
-	 2808,   650,  1896,  9997,  9971, 11980,  8098,  4833,
-	 4135,  4257,  5838,  4765, 10985, 11532,   590, 12198,
-	  482, 12173,  2006,  7064, 10018,  3912, 12016, 10519,
-	11362,  6954,  2210,   284,  5413,  6601,  3865, 10339,
-	11188,  6231,   517,  9564, 11281,  3863,  1210,  4604,
-	 8160, 11447,   153,  7204,  5763,  5089,  9248, 12154,
-	11748,  1354,  6672,   179,  5532,  2646,  5941, 12185,
-	  862,  3158,   477,  7279,  5678,  7914,  4254,   302,
-	 2893, 10114,  6890,  9560,  9647, 11905,  4098,  9824,
-	10269,  1353, 10715,  5325,  6254,  3951,  1807,  6449,
-	 5159,  1308,  8315,  3404,  1877,  1231,   112,  6398,
-	11724, 12272,  7286,  1459, 12274,  9896,  3456,   800,
-	 1397, 10678,   103,  7420,  7976,   936,   764,   632,
-	 7996,  8223,  8445,  7758, 10870,  9571,  2508,  1946,
-	 6524, 10158,  1044,  4338,  2457,  3641,  1659,  4139,
-	 4688,  9733, 11148,  3946,  2082,  5261,  2036, 11850,
-	 7636, 12236,  5366,  2380,  1399,  7720,  2100,  3217,
-	10912,  8898,  7578, 11995,  2791,  1215,  3355,  2711,
-	 2267,  2004,  8568, 10176,  3214,  2337,  1750,  4729,
-	 4997,  7415,  6315, 12044,  4374,  7157,  4844,   211,
-	 8003, 10159,  9290, 11481,  1735,  2336,  5793,  9875,
-	 8192,   986,  7527,  1401,   870,  3615,  8465,  2756,
-	 9770,  2034, 10168,  3264,  6132,    54,  2880,  4763,
-	11805,  3074,  8286,  9428,  4881,  6933,  1090, 10038,
-	 2567,   708,   893,  6465,  4962, 10024,  2090,  5718,
-	10743,   780,  4733,  4623,  2134,  2087,  4802,   884,
-	 5372,  5795,  5938,  4333,  6559,  7549,  5269, 10664,
-	 4252,  3260,  5917, 10814,  5768,  9983,  8096,  7791,
-	 6800,  7491,  6272,  1907, 10947,  6289, 11803,  6032,
-	11449,  1171,  9201,  7933,  2479,  7970, 11337,  7062,
-	 8911,  6728,  6542,  8114,  8828,  6595,  3545,  4348,
-	 4610,  2205,  6999,  8106,  5560, 10390,  9321,  2499,
-	 2413,  7272,  6881, 10582,  9308,  9437,  3554,  3326,
-	 5991, 11969,  3415, 12283,  9838, 12063,  4332,  7830,
-	11329,  6605, 12271,  2044, 11611,  7353, 11201, 11582,
-	 3733,  8943,  9978,  1627,  7168,  3935,  5050,  2762,
-	 7496, 10383,   755,  1654, 12053,  4952, 10134,  4394,
-	 6592,  7898,  7497,  8904, 12029,  3581, 10748,  5674,
-	10358,  4901,  7414,  8771,   710,  6764,  8462,  7193,
-	 5371,  7274, 11084,   290,  7864,  6827, 11822,  2509,
-	 6578,  4026,  5807,  1458,  5721,  5762,  4178,  2105,
-	11621,  4852,  8897,  2856, 11510,  9264,  2520,  8776,
-	 7011,  2647,  1898,  7039,  5950, 11163,  5488,  6277,
-	 9182, 11456,   633, 10046, 11554,  5633,  9587,  2333,
-	 7008,  7084,  5047,  7199,  9865,  8997,   569,  6390,
-	10845,  9679,  8268, 11472,  4203,  1997,     2,  9331,
-	  162,  6182,  2000,  3649,  9792,  6363,  7557,  6187,
-	 8510,  9935,  5536,  9019,  3706, 12009,  1452,  3067,
-	 5494,  9692,  4865,  6019,  7106,  9610,  4588, 10165,
-	 6261,  5887,  2652, 10172,  1580, 10379,  4638,  9949
-};
-
-
-/*
- * Table for inverse NTT, binary case:
- *   iGMb[x] = R1*((1/g)^rev(x)) mod q
- * Since g = 7, 1/g = 8778 mod 12289.
- */
-static const uint16_t iGMb[] = {
-	 4091,  4401,  1081,  1229,  2530,  6014,  7947,  5329,
-	 2579,  4751,  6464, 11703,  7023,  2812,  5890, 10698,
-	 3109,  2125,  1960, 10925, 10601, 10404,  4189,  1875,
-	 5847,  8546,  4615,  5190, 11324, 10578,  5882, 11155,
-	 8417, 12275, 10599,  7446,  5719,  3569,  5981, 10108,
-	 4426,  8306, 10755,  4679, 11052,  1538, 11857,   100,
-	 8247,  6625,  9725,  5145,  3412,  7858,  5831,  9460,
-	 5217, 10740,  7882,  7506, 12172, 11292,  6049,    79,
-	   13,  6938,  8886,  5453,  4586, 11455,  2903,  4676,
-	 9843,  7621,  8822,  9109,  2083,  8507,  8685,  3110,
-	 7015,  3269,  1367,  6397, 10259,  8435, 10527, 11559,
-	11094,  2211,  1808,  7319,    48,  9547,  2560,  1228,
-	 9438, 10787, 11800,  1820, 11406,  8966,  6159,  3012,
-	 6109,  2796,  2203,  1652,   711,  7004,  1053,  8973,
-	 5244,  1517,  9322, 11269,   900,  3888, 11133, 10736,
-	 4949,  7616,  9974,  4746, 10270,   126,  2921,  6720,
-	 6635,  6543,  1582,  4868,    42,   673,  2240,  7219,
-	 1296, 11989,  7675,  8578, 11949,   989, 10541,  7687,
-	 7085,  8487,  1004, 10236,  4703,   163,  9143,  4597,
-	 6431, 12052,  2991, 11938,  4647,  3362,  2060, 11357,
-	12011,  6664,  5655,  7225,  5914,  9327,  4092,  5880,
-	 6932,  3402,  5133,  9394, 11229,  5252,  9008,  1556,
-	 6908,  4773,  3853,  8780, 10325,  7737,  1758,  7103,
-	11375, 12273,  8602,  3243,  6536,  7590,  8591, 11552,
-	 6101,  3253,  9969,  9640,  4506,  3736,  6829, 10822,
-	 9130,  9948,  3566,  2133,  3901,  6038,  7333,  6609,
-	 3468,  4659,   625,  2700,  7738,  3443,  3060,  3388,
-	 3526,  4418, 11911,  6232,  1730,  2558, 10340,  5344,
-	 5286,  2190, 11562,  6199,  2482,  8756,  5387,  4101,
-	 4609,  8605,  8226,   144,  5656,  8704,  2621,  5424,
-	10812,  2959, 11346,  6249,  1715,  4951,  9540,  1888,
-	 3764,    39,  8219,  2080,  2502,  1469, 10550,  8709,
-	 5601,  1093,  3784,  5041,  2058,  8399, 11448,  9639,
-	 2059,  9878,  7405,  2496,  7918, 11594,   371,  7993,
-	 3073, 10326,    40, 10004,  9245,  7987,  5603,  4051,
-	 7894,   676, 11380,  7379,  6501,  4981,  2628,  3488,
-	10956,  7022,  6737,  9933,  7139,  2330,  3884,  5473,
-	 7865,  6941,  5737,  5613,  9505, 11568, 11277,  2510,
-	 6689,   386,  4462,   105,  2076, 10443,   119,  3955,
-	 4370, 11505,  3672, 11439,   750,  3240,  3133,   754,
-	 4013, 11929,  9210,  5378, 11881, 11018,  2818,  1851,
-	 4966,  8181,  2688,  6205,  6814,   926,  2936,  4327,
-	10175,  7089,  6047,  9410, 10492,  8950,  2472,  6255,
-	  728,  7569,  6056, 10432, 11036,  2452,  2811,  3787,
-	  945,  8998,  1244,  8815, 11017, 11218,  5894,  4325,
-	 4639,  3819,  9826,  7056,  6786,  8670,  5539,  7707,
-	 1361,  9812,  2949, 11265, 10301,  9108,   478,  6489,
-	  101,  1911,  9483,  3608, 11997, 10536,   812,  8915,
-	  637,  8159,  5299,  9128,  3512,  8290,  7068,  7922,
-	 3036,  4759,  2163,  3937,  3755, 11306,  7739,  4922,
-	11932,   424,  5538,  6228, 11131,  7778, 11974,  1097,
-	 2890, 10027,  2569,  2250,  2352,   821,  2550, 11016,
-	 7769,   136,   617,  3157,  5889,  9219,  6855,   120,
-	 4405,  1825,  9635,  7214, 10261, 11393,  2441,  9562,
-	11176,   599,  2085, 11465,  7233,  6177,  4801,  9926,
-	 9010,  4514,  9455, 11352, 11670,  6174,  7950,  9766,
-	 6896, 11603,  3213,  8473,  9873,  2835, 10422,  3732,
-	 7961,  1457, 10857,  8069,   832,  1628,  3410,  4900,
-	10855,  5111,  9543,  6325,  7431,  4083,  3072,  8847,
-	 9853, 10122,  5259, 11413,  6556,   303,  1465,  3871,
-	 4873,  5813, 10017,  6898,  3311,  5947,  8637,  5852,
-	 3856,   928,  4933,  8530,  1871,  2184,  5571,  5879,
-	 3481, 11597,  9511,  8153,    35,  2609,  5963,  8064,
-	 1080, 12039,  8444,  3052,  3813, 11065,  6736,  8454,
-	 2340,  7651,  1910, 10709,  2117,  9637,  6402,  6028,
-	 2124,  7701,  2679,  5183,  6270,  7424,  2597,  6795,
-	 9222, 10837,   280,  8583,  3270,  6753,  2354,  3779,
-	 6102,  4732,  5926,  2497,  8640, 10289,  6107, 12127,
-	 2958, 12287, 10292,  8086,   817,  4021,  2610,  1444,
-	 5899, 11720,  3292,  2424,  5090,  7242,  5205,  5281,
-	 9956,  2702,  6656,   735,  2243, 11656,   833,  3107,
-	 6012,  6801,  1126,  6339,  5250, 10391,  9642,  5278,
-	 3513,  9769,  3025,   779,  9433,  3392,  7437,   668,
-	10184,  8111,  6527,  6568, 10831,  6482,  8263,  5711,
-	 9780,   467,  5462,  4425, 11999,  1205,  5015,  6918,
-	 5096,  3827,  5525, 11579,  3518,  4875,  7388,  1931,
-	 6615,  1541,  8708,   260,  3385,  4792,  4391,  5697,
-	 7895,  2155,  7337,   236, 10635, 11534,  1906,  4793,
-	 9527,  7239,  8354,  5121, 10662,  2311,  3346,  8556,
-	  707,  1088,  4936,   678, 10245,    18,  5684,   960,
-	 4459,  7957,   226,  2451,     6,  8874,   320,  6298,
-	 8963,  8735,  2852,  2981,  1707,  5408,  5017,  9876,
-	 9790,  2968,  1899,  6729,  4183,  5290, 10084,  7679,
-	 7941,  8744,  5694,  3461,  4175,  5747,  5561,  3378,
-	 5227,   952,  4319,  9810,  4356,  3088, 11118,   840,
-	 6257,   486,  6000,  1342, 10382,  6017,  4798,  5489,
-	 4498,  4193,  2306,  6521,  1475,  6372,  9029,  8037,
-	 1625,  7020,  4740,  5730,  7956,  6351,  6494,  6917,
-	11405,  7487, 10202, 10155,  7666,  7556, 11509,  1546,
-	 6571, 10199,  2265,  7327,  5824, 11396, 11581,  9722,
-	 2251, 11199,  5356,  7408,  2861,  4003,  9215,   484,
-	 7526,  9409, 12235,  6157,  9025,  2121, 10255,  2519,
-	 9533,  3824,  8674, 11419, 10888,  4762, 11303,  4097,
-	 2414,  6496,  9953, 10554,   808,  2999,  2130,  4286,
-	12078,  7445,  5132,  7915,   245,  5974,  4874,  7292,
-	 7560, 10539,  9952,  9075,  2113,  3721, 10285, 10022,
-	 9578,  8934, 11074,  9498,   294,  4711,  3391,  1377,
-	 9072, 10189,  4569, 10890,  9909,  6923,    53,  4653,
-	  439, 10253,  7028, 10207,  8343,  1141,  2556,  7601,
-	 8150, 10630,  8648,  9832,  7951, 11245,  2131,  5765,
-	10343,  9781,  2718,  1419,  4531,  3844,  4066,  4293,
-	11657, 11525, 11353,  4313,  4869, 12186,  1611, 10892,
-	11489,  8833,  2393,    15, 10830,  5003,    17,   565,
-	 5891, 12177, 11058, 10412,  8885,  3974, 10981,  7130,
-	 5840, 10482,  8338,  6035,  6964,  1574, 10936,  2020,
-	 2465,  8191,   384,  2642,  2729,  5399,  2175,  9396,
-	11987,  8035,  4375,  6611,  5010, 11812,  9131, 11427,
-	  104,  6348,  9643,  6757, 12110,  5617, 10935,   541,
-	  135,  3041,  7200,  6526,  5085, 12136,   842,  4129,
-	 7685, 11079,  8426,  1008,  2725, 11772,  6058,  1101,
-	 1950,  8424,  5688,  6876, 12005, 10079,  5335,   927,
-	 1770,   273,  8377,  2271,  5225, 10283,   116, 11807,
-	   91, 11699,   757,  1304,  7524,  6451,  8032,  8154,
-	 7456,  4191,   309,  2318,  2292, 10393, 11639,  9481,
-	12238, 10594,  9569,  7912, 10368,  9889, 12244,  7179,
-	 3924,  3188,   367,  2077,   336,  5384,  5631,  8596,
-	 4621,  1775,  8866,   451,  6108,  1317,  6246,  8795,
-	 5896,  7283,  3132, 11564,  4977, 12161,  7371,  1366,
-	12130, 10619,  3809,  5149,  6300,  2638,  4197,  1418,
-	10065,  4156,  8373,  8644, 10445,   882,  8158, 10173,
-	 9763, 12191,   459,  2966,  3166,   405,  5000,  9311,
-	 6404,  8986,  1551,  8175,  3630, 10766,  9265,   700,
-	 8573,  9508,  6630, 11437, 11595,  5850,  3950,  4775,
-	11941,  1446,  6018,  3386, 11470,  5310,  5476,   553,
-	 9474,  2586,  1431,  2741,   473, 11383,  4745,   836,
-	 4062, 10666,  7727, 11752,  5534,   312,  4307,  4351,
-	 5764,  8679,  8381,  8187,     5,  7395,  4363,  1152,
-	 5421,  5231,  6473,   436,  7567,  8603,  6229,  8230
-};
 
 
 static const uint32_t GMb_large[] = {
@@ -436,7 +163,7 @@ string bloomfilter_file = "bloom_filter.dat";
 
 
 
-unsigned char **BF;
+XSet XS;
 
 unsigned char *UIDX;
 
@@ -448,6 +175,28 @@ int N_words = N_keywords;
 int N_max_id_words = 1809;
 int N_kw_id_max = 80901;
 int N_threads = 1;
+int N_search_threads = 0;                   //Candidate evaluation workers (0 = one per available core)
+int xtag_eval_mode = XTAG_EVAL_AUTO;        //XTAG_EVAL_AUTO / XTAG_EVAL_SCHOOLBOOK / XTAG_EVAL_RNS
+int xset_telemetry = 0;                     //Classify every candidate against the exact side-set written by setup
+string xset_exact_file = "xset_exact.dat";
+XSetExact XE;
+double xset_term_fpr = 0.0;                 //Per-term FPR of the loaded XSet
+string redis_host = "127.0.0.1";           //TSet store (ignored when redis_unix_socket is set)
+int redis_port = 6379;
+string redis_unix_socket = "";              //Connect over this Unix socket instead of TCP when non-empty
+size_t redis_pool_size = 8;                 //Pooled connections shared by all TSet requests
+unsigned int tset_format = TSET_FORMAT_BINARY;  //TSet entry encoding in Redis: TSET_FORMAT_BINARY or TSET_FORMAT_HEX (setup and search must agree)
+unsigned int tset_layout = TSET_LAYOUT_ENTRY;   //Must match setup; the chunked layout is always read in batched windows
+unsigned int tset_chunk_ids = 64;
+unsigned int tset_store = TSET_STORE_REDIS; //TSet backend: TSET_STORE_REDIS or TSET_STORE_FILE (mapped hash file written by setup)
+string tset_store_file = "tset.dat";
+vector<string> tset_shard_endpoints = {"127.0.0.1:6379"};   //TSET_STORE_SHARDED: "host:port" or "unix:/path" per shard; order fixes the ring
+vector<string> tset_read_replicas = {};     //TSET_STORE_REDIS: replicas of the primary that TSet reads are spread over
+TSetStore TSTORE;
+int tset_retrieve_mode = TSET_RETRIEVE_BATCHED;    //TSET_RETRIEVE_SERIAL: one GET per ID. TSET_RETRIEVE_BATCHED: speculative MGET windows. TSET_RETRIEVE_SERVER: windows walked by a server-side script
+unsigned int tset_window_init = 4;          //Batched retrieval: first window, doubled after every round trip
+unsigned int tset_window_max = 1024;
+unsigned int tset_server_window = 256;      //Server-side walk: first window; entries past the end are never sent, so it can start large
 
 
 int sym_block_size = N_threads*16;
@@ -491,6 +240,11 @@ const char* KX1 = reinterpret_cast<const char *> (KX);
 const char* KR1 = reinterpret_cast<const char *> (KR);
 const char* KT1 = reinterpret_cast<const char *> (KT);
 
+//Client key store: Falcon key pair, expanded key and the symmetric keys above
+string keystore_file = "client_keys.dat";
+unsigned char keygen_seed[16] = {0x56,0x37,0xca,0x94,0xd5,0xe0,0xad,0x62,0x73,0x7c,0xba,0x48,0x8d,0x2d,0x4d,0xde};
+KeyStore KEYS;
+
 
 
 
@@ -523,15 +277,37 @@ sw::redis::ConnectionPoolOptions pool_options;
 int Sys_Init()
 {
     
-    connection_options.host = "127.0.0.1";  
-    BloomFilter_Init(BF);
+    RedisPool_Options(connection_options, pool_options, redis_host, redis_port, redis_unix_socket, redis_pool_size);
+    if((RedisPool_Init(connection_options, pool_options) != 0)
+       || ((tset_store == TSET_STORE_SHARDED) && (RedisPool_InitShards(tset_shard_endpoints, connection_options, pool_options) != 0))
+       || ((tset_store == TSET_STORE_REDIS) && (RedisPool_InitReplicas(tset_read_replicas, connection_options, pool_options) != 0))
+       || (TSetStore_OpenRead(TSTORE, tset_store, tset_store_file) != 0)
+       || (TSetStore_Check(TSTORE, tset_format, tset_layout, tset_chunk_ids) != 0)){
+        exit(1);
+    }
+    MQ_Init();
+
+    //Load the client keys before anything derives from KS/KZ/KT
+    KeyStoreSymKeys sym_keys = {KS, KI, KZ, KX, KR, KT};
+    if(KeyStore_Open(KEYS, keystore_file, keygen_seed, sizeof(keygen_seed), sym_keys) != 0){
+        exit(1);
+    }
+
+    if(PolyRNS_Init() != 0){
+        std::cerr << "RNS transform tables failed to initialise" << std::endl;
+        exit(1);
+    }
 
     return 0;
 }
 
 int Sys_Clear()
 {
-    BloomFilter_Clean(BF);
+    XSet_Clean(XS);
+    XSetExact_Clean(XE);
+    KeyStore_Clean(KEYS);
+    TSetStore_Clean(TSTORE);
+    RedisPool_Clean();
 
     return 0;
 }
@@ -806,39 +582,6 @@ mq_div_12289(uint32_t x, uint32_t y)
 
 
 
-/*
- * Compute NTT on a ring element.
- */
-static void
-mq_NTT(uint16_t *a, unsigned logn)
-{
-	size_t n, t, m;
-
-	n = (size_t)1 << logn;
-	t = n;
-	for (m = 1; m < n; m <<= 1) {
-		size_t ht, i, j1;
-
-		ht = t >> 1;
-		for (i = 0, j1 = 0; i < m; i ++, j1 += t) {
-			size_t j, j2;
-			uint32_t s;
-
-			s = GMb[m + i];
-			j2 = j1 + ht;
-			for (j = j1; j < j2; j ++) {
-				uint32_t u, v;
-
-				u = a[j];
-				v = mq_montymul(a[j + ht], s);
-				a[j] = (uint16_t)mq_add(u, v);
-				a[j + ht] = (uint16_t)mq_sub(u, v);
-			}
-		}
-		t = ht;
-	}
-}
-
 
 static void
 mq_NTT_large(uint32_t *a, unsigned logn)
@@ -871,62 +614,6 @@ mq_NTT_large(uint32_t *a, unsigned logn)
 }
 
 
-/*
- * Compute the inverse NTT on a ring element, binary case.
- */
-static void
-mq_iNTT(uint16_t *a, unsigned logn)
-{
-	size_t n, t, m;
-	uint32_t ni;
-
-	n = (size_t)1 << logn;
-	t = 1;
-	m = n;
-	while (m > 1) {
-		size_t hm, dt, i, j1;
-
-		hm = m >> 1;
-		dt = t << 1;
-		for (i = 0, j1 = 0; i < hm; i ++, j1 += dt) {
-			size_t j, j2;
-			uint32_t s;
-
-			j2 = j1 + t;
-			s = iGMb[hm + i];
-			for (j = j1; j < j2; j ++) {
-				uint32_t u, v, w;
-
-				u = a[j];
-				v = a[j + t];
-				a[j] = (uint16_t)mq_add(u, v);
-				w = mq_sub(u, v);
-				a[j + t] = (uint16_t)
-					mq_montymul(w, s);
-			}
-		}
-		t = dt;
-		m = hm;
-	}
-
-	/*
-	 * To complete the inverse NTT, we must now divide all values by
-	 * n (the vector size). We thus need the inverse of n, i.e. we
-	 * need to divide 1 by 2 logn times. But we also want it in
-	 * Montgomery representation, i.e. we also want to multiply it
-	 * by R = 2^16. In the common case, this should be a simple right
-	 * shift. The loop below is generic and works also in corner cases;
-	 * its computation time is negligible.
-	 */
-	ni = R1;
-	for (m = n; m > 1; m >>= 1) {
-		ni = mq_rshift1(ni);
-	}
-	for (m = 0; m < n; m ++) {
-		a[m] = (uint16_t)mq_montymul(a[m], ni);
-	}
-}
-
 
 static void
 mq_iNTT_large(uint32_t *a, unsigned logn)
@@ -981,20 +668,6 @@ mq_iNTT_large(uint32_t *a, unsigned logn)
 }
 
 
-/*
- * Convert a polynomial (mod q) to Montgomery representation.
- */
-static void
-mq_poly_tomonty(uint16_t *f, unsigned logn)
-{
-	size_t u, n;
-
-	n = (size_t)1 << logn;
-	for (u = 0; u < n; u ++) {
-		f[u] = (uint16_t)mq_montymul(f[u], R2);
-	}
-}
-
 static void
 mq_poly_tomonty_large(uint32_t *f, unsigned logn)
 {
@@ -1007,21 +680,6 @@ mq_poly_tomonty_large(uint32_t *f, unsigned logn)
 }
 
 
-/*
- * Multiply two polynomials together (NTT representation, and using
- * a Montgomery multiplication). Result f*g is written over f.
- */
-static void
-mq_poly_montymul_ntt(uint16_t *f, const uint16_t *g, unsigned logn)
-{
-	size_t u, n;
-
-	n = (size_t)1 << logn;
-	for (u = 0; u < n; u ++) {
-		f[u] = (uint16_t)mq_montymul(f[u], g[u]);
-	}
-}
-
 static void
 mq_poly_montymul_ntt_large(uint32_t *f, const uint32_t *g, unsigned logn)
 {
@@ -1077,23 +735,6 @@ uint32_t round(uint32_t x, uint32_t q_bits, uint32_t p_bits) {
 }
 
 
-void reduce_mod_phi(ZZX& poly, const ZZ& modulus, int reduction_degree) {
-    long degree_poly = deg(poly);  // Degree of the polynomial
-    if (degree_poly < reduction_degree) return;  // No reduction needed
-
-    for (long i = reduction_degree; i <= degree_poly; ++i) {
-        ZZ coeff_i = coeff(poly, i);
-        if (coeff_i != 0) {  // Only process non-zero terms
-            ZZ lower_coeff = coeff(poly, i - reduction_degree);
-            ZZ new_lower_coeff = (lower_coeff + coeff_i) % modulus;
-            SetCoeff(poly, i - reduction_degree, new_lower_coeff);  // Update lower degree
-            SetCoeff(poly, i, ZZ(0));  // Zero out higher degree
-        }
-    }
-
-    poly.normalize();  // Ensure no trailing zeros
-}
-
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -1156,22 +797,58 @@ int MGDB_QUERY(unsigned char *RES, unsigned char *BIDX, unsigned char *JIDX, uns
     ::memcpy(GL_MGDB_LBL,LBL,(N_threads * 12));
     ::memset(GL_MGDB_RES,0x00,(N_threads * ((2*N_l+16)+1)));
 
-    auto redis = Redis("tcp://127.0.0.1:6379");
-
-        
-    string s = HexToStr(GL_MGDB_BIDX,2) + HexToStr(GL_MGDB_JIDX,2) + HexToStr(GL_MGDB_LBL,12);
-    
-    auto val = redis.get(s);
-    unsigned char *t_res = reinterpret_cast<unsigned char *>(val->data());
+    std::vector<string> keys(1);
+    std::vector<OptionalString> vals;
+    TSetFormat_Key(tset_format, GL_MGDB_BIDX, GL_MGDB_JIDX, GL_MGDB_LBL, keys[0]);
     
-
-    DB_StrToHexN(GL_MGDB_RES,t_res,((2*N_l+16)+1));
+    //-1: the store could not be read. 1: missing or malformed entry, which ends the list
+    if(TSetStore_MGet(TSTORE, keys, vals) != 0){
+        return -1;
+    }
+    if(vals.empty() || !vals[0] || (TSetFormat_DecodeValue(tset_format, *vals[0], GL_MGDB_RES, ((2*N_l+16)+1)) != 0)){
+        return 1;
+    }
 
     ::memcpy(RES,GL_MGDB_RES,((2*N_l+16)+1));
 
     return 0;
 }
 
+int MGDB_QUERY_N(unsigned char *RES, unsigned char *BIDX, unsigned char *JIDX, unsigned char *LBL, int n_entries, int value_bytes, int *n_found, int *res_bytes)
+{
+    // One store read (MGET or server-side walk on Redis) for n_entries labels into value_bytes-strided slots of RES; res_bytes gets each
+    // value's length. Stops decoding at the first missing, oversized or malformed entry
+    std::vector<std::string> keys;
+    std::vector<OptionalString> vals;
+    keys.reserve(n_entries);
+    for(int k=0;k<n_entries;++k){
+        keys.emplace_back();
+        TSetFormat_Key(tset_format, BIDX+2*k, JIDX+2*k, LBL+12*k, keys.back());
+    }
+
+    //The server-side walk returns nothing past the end-of-list entry
+    *n_found = 0;
+    int status = (tset_retrieve_mode == TSET_RETRIEVE_SERVER) ? TSetStore_Walk(TSTORE, tset_format, keys, vals)
+                                                              : TSetStore_MGet(TSTORE, keys, vals);
+    if(status != 0){
+        return -1;
+    }
+
+    for(int k=0;(k<n_entries) && (k<(int)vals.size());++k){
+        if(!vals[k]){
+            break;
+        }
+        size_t n_bytes = TSetFormat_ValueBytes(tset_format, *vals[k]);
+        if((n_bytes > (size_t)value_bytes) || (TSetFormat_DecodeValue(tset_format, *vals[k], RES+(size_t)value_bytes*k, n_bytes) != 0)){
+            break;
+        }
+        res_bytes[k] = (int)n_bytes;
+        (*n_found)++;
+    }
+
+    return 0;
+}
+
 
 
 
@@ -1183,8 +860,138 @@ int TSet_GetTag(unsigned char *word, unsigned char *stag)
     return 0;
 }
 
+int TSet_RetrieveBatched(unsigned char *stag,unsigned char *tset_row, int *n_ids_tset)
+{
+    // Derives labels a window ahead of the end-of-list flag and fetches each window with
+    // one MGET; windows double, so an s-term of n IDs costs O(log n) round trips. In the
+    // chunked layout each label holds up to chunk_ids records
+    int datasize = (2*N_l)+16;
+
+    int N_words = (N_max_ids/N_threads) + ((N_max_ids%N_threads==0)?0:1);
+    int N_max_id_words = N_words * N_threads;
+
+    bool chunked = (tset_layout == TSET_LAYOUT_CHUNKED);
+    int chunk_ids = chunked ? (int)std::min(std::max(tset_chunk_ids, 1u), (unsigned int)TSET_CHUNK_MAX_IDS) : 1;
+    int value_bytes = chunked ? (TSET_CHUNK_HEADER_BYTES + chunk_ids*datasize) : (datasize+1);
+    int window_max = std::max((int)tset_window_max/chunk_ids, 1);
+
+    unsigned char *stagi = new unsigned char[16*window_max];
+    unsigned char *hashin = new unsigned char[16*window_max];
+    unsigned char *hashout = new unsigned char[64*window_max];
+    unsigned char *T_RES = new unsigned char[(size_t)value_bytes*window_max];
+    unsigned char *T_BIDX = new unsigned char[2*window_max];
+    unsigned char *T_JIDX = new unsigned char[2*window_max];
+    unsigned char *T_LBL = new unsigned char[12*window_max];
+    int *T_LEN = new int[window_max];
+
+    int len_freeb = 65536;
+    unsigned int *FreeB = new unsigned int[len_freeb];
+    for(int bc=0;bc<len_freeb;++bc){
+        FreeB[bc] = 0;
+    }
+
+    const char* stag1 = reinterpret_cast<const char *> (stag);
+    if(!PKCS5_PBKDF2_HMAC_SHA1(stag, strlen(stag),NULL,0,1000,32,stag1))
+    {
+        printf("Error in key generation\n");
+        exit(1);
+    }
+
+    int rcnt = 0;
+    int status = 0;
+    int lidx = 0;                           //Next label index: id in the entry layout, chunk otherwise
+    unsigned int window_init = (tset_retrieve_mode == TSET_RETRIEVE_SERVER) ? std::max(tset_server_window/chunk_ids, 1u) : tset_window_init;
+    int window = (window_init == 0) ? 1 : std::min((int)window_init, window_max);
+    bool BETA = 0;
+
+    while(!BETA && (rcnt < N_max_id_words)){
+        int n_win = std::min(window, (N_max_id_words - rcnt + chunk_ids - 1)/chunk_ids);
+
+        ::memset(stagi,0x00,16*n_win);
+        ::memset(hashin,0x00,16*n_win);
+        ::memset(hashout,0x00,64*n_win);
+
+        for(int k=0;k<n_win;++k){
+            stagi[16*k] = (lidx+k) & 0xFF;
+            unsigned char *stagi_local = stagi+16*k;
+            k_stag_TSetRetrieve = encrypt(stagi_local, sizeof(stagi_local)/sizeof(stagi_local[0]), aad, sizeof(aad), stag1, iv_stag, hashin+16*k, tag_stag);
+            FPGA_HASH(hashin+16*k,hashout+64*k);
+
+            unsigned char *bidx_k = T_BIDX+2*k;
+            unsigned char *jidx_k = T_JIDX+2*k;
+            ::memcpy(bidx_k,hashout+64*k,2);
+            int bidx = (FreeB[(bidx_k[1] << 8) + bidx_k[0]]++);
+            jidx_k[0] = bidx & 0xFF;
+            jidx_k[1] = (bidx >> 8) & 0xFF;
+            ::memcpy(T_LBL+12*k,hashout+64*k+2,12);
+        }
+        lidx += n_win;
+
+        int n_found = 0;
+        if(MGDB_QUERY_N(T_RES,T_BIDX,T_JIDX,T_LBL,n_win,value_bytes,&n_found,T_LEN) != 0){
+            status = -1;
+            break;
+        }
+
+        //A missing key ends the list as if its predecessor carried the flag
+        if(n_found < n_win){
+            BETA = 1;
+        }
+        for(int k=0;(k<n_found) && (rcnt<N_max_id_words);++k){
+            unsigned char *tval = T_RES+(size_t)value_bytes*k;
+            if(!chunked){
+                if(T_LEN[k] != datasize+1){
+                    BETA = 1;
+                    break;
+                }
+                ::memcpy(tset_row+datasize*rcnt,tval+1,datasize);
+                rcnt++;
+                if(tval[0] == 0x01){
+                    BETA = 1;
+                    break;
+                }
+                continue;
+            }
+
+            bool last = false;
+            unsigned int n_records = 0;
+            if(TSetChunk_Unpack(tval, T_LEN[k], datasize, &last, &n_records) != 0){
+                BETA = 1;
+                break;
+            }
+            n_records = std::min((int)n_records, N_max_id_words - rcnt);
+            ::memcpy(tset_row+(size_t)datasize*rcnt,tval+TSET_CHUNK_HEADER_BYTES,(size_t)datasize*n_records);
+            rcnt += n_records;
+            if(last){
+                BETA = 1;
+                break;
+            }
+        }
+
+        window = std::min(2*window, window_max);
+    }
+
+    *n_ids_tset = rcnt;
+
+    delete [] stagi;
+    delete [] hashin;
+    delete [] hashout;
+    delete [] T_RES;
+    delete [] T_BIDX;
+    delete [] T_JIDX;
+    delete [] T_LBL;
+    delete [] T_LEN;
+    delete [] FreeB;
+
+    return status;
+}
+
 int TSet_Retrieve(unsigned char *stag,unsigned char *tset_row, int *n_ids_tset)
 {
+    if((tset_retrieve_mode != TSET_RETRIEVE_SERIAL) || (tset_layout == TSET_LAYOUT_CHUNKED)){
+        return TSet_RetrieveBatched(stag,tset_row,n_ids_tset);
+    }
+
     unsigned char *stagi;
     unsigned char *stago;
     unsigned char *hashin;
@@ -1250,6 +1057,7 @@ int TSet_Retrieve(unsigned char *stag,unsigned char *tset_row, int *n_ids_tset)
     T_LBL = new unsigned char[12*N_max_id_words];
 
     int rcnt = 0;
+    int status = 0;
 
     ::memset(stagi,0x00,16*N_max_id_words);
     ::memset(stago,0x00,16*N_max_id_words);
@@ -1351,7 +1159,12 @@ int TSet_Retrieve(unsigned char *stag,unsigned char *tset_row, int *n_ids_tset)
             hashout_local +=64;
         }
 
-        MGDB_QUERY(local_t_res,local_t_bidx_word,local_t_jidx_word,local_t_lbl_word);
+        //A missing or malformed entry ends the list; a store failure also fails the retrieval
+        int query_status = MGDB_QUERY(local_t_res,local_t_bidx_word,local_t_jidx_word,local_t_lbl_word);
+        if(query_status != 0){
+            status = (query_status < 0) ? -1 : 0;
+            break;
+        }
 
     
         for(unsigned int ni=0;ni<N_threads;++ni){
@@ -1394,7 +1207,7 @@ int TSet_Retrieve(unsigned char *stag,unsigned char *tset_row, int *n_ids_tset)
     delete [] T_LBL;
     
    
-    return 0;
+    return status;
 }
 
 
@@ -1466,6 +1279,258 @@ int32_t mod_inverse(uint32_t value, uint32_t mod) {
 
 
 
+int SearchWorker_Init(SearchWorker &wk, int NWords)
+{
+    wk.XTAG = new uint64_t[(NWords+1)*N_l];
+    wk.bf_n_indices = new unsigned int *[XSet_ElementWords(XS)];
+    for(unsigned int i=0;i<XSet_ElementWords(XS);++i){
+        wk.bf_n_indices[i] = new unsigned int [SEARCH_BATCH_CANDS*(NWords+1)];
+    }
+    blake3_hasher_init(&wk.hasher);
+    wk.yid_rns = new RNSPoly;
+    wk.xtag_rns = new RNSPoly;
+    wk.exact = xset_telemetry ? new XTagDigest[SEARCH_BATCH_CANDS*(NWords+1)] : nullptr;
+    ::memset(&wk.tl,0x00,sizeof(wk.tl));
+
+    return 0;
+}
+
+int SearchWorker_Clean(SearchWorker &wk)
+{
+    delete wk.yid_rns;
+    delete wk.xtag_rns;
+    delete [] wk.exact;
+    for(unsigned int i=0;i<XSet_ElementWords(XS);++i){
+        delete [] wk.bf_n_indices[i];
+    }
+    delete [] wk.bf_n_indices;
+    delete [] wk.XTAG;
+    return 0;
+}
+
+
+int QueryContext_Init(QueryContext &QC, unsigned char *Q1, unsigned char *W, int NWords, const uint16_t *h_temp)
+{
+    unsigned char r[16];
+    unsigned char tag_q[100];
+    int c = 0;
+    int32_t rnd;
+    uint16_t mask, inv_mask;
+
+    struct random_data rng;
+    char rng_state[128];
+
+    ::memcpy(QC.Q1,Q1,16);
+    QC.NWords = NWords;
+    QC.XToken = new uint64_t[(NWords+1)*N_l];
+    QC.XTokenRNS = nullptr;
+
+
+    //Mask for the s-term, the same one setup derived for this keyword
+    int kr = encrypt(Q1, 16, aad, sizeof(aad), KZ1, iv_kz, r, tag_q);
+
+    uint32_t temp;
+    memcpy(&temp, r, sizeof(uint32_t));
+
+    //Reentrant replacement for srand/rand; glibc's rand() is random() on this state
+    ::memset(&rng,0x00,sizeof(rng));
+    initstate_r(1, rng_state, sizeof(rng_state), &rng);
+    srandom_r(temp, &rng);
+    random_r(&rng, &rnd);
+    mask = (rnd%p_l);
+    
+    int32_t x, y;
+    int32_t gcd = extended_gcd(mask, p_l, x, y);
+    if (gcd != 1) {
+        mask += 1;
+    }
+
+    inv_mask = mod_inverse(mask,p_l);
+
+    if((mask * inv_mask)%p_l == 1){
+        c++;
+    }	
+    else{	
+        random_r(&rng, &rnd);
+        mask = (rnd%p_l);
+
+        int32_t x, y;
+        int32_t gcd = extended_gcd(mask, p_l, x, y);
+        
+        if (gcd != 1) {
+            mask += 1;
+        }
+
+        inv_mask = mod_inverse(mask,p_l);
+        if((mask * inv_mask)%p_l == 1){
+            c++;
+        }
+    }
+
+    QC.mask = mask;
+    QC.inv_mask = inv_mask;
+
+
+    //xtoken = h.xw for every remaining query term, rounded to p_l_dash_bits
+    uint64_t h_poly[512], xtoken_poly[512];
+    uint64_t *xtoken_local = QC.XToken;
+    unsigned char *w_local = W;
+
+    PolyRing_FromUint16(h_poly, h_temp, q_l_bits);
+
+    for(int n1=0; n1<NWords; ++n1) 
+    {
+        //Generate random polynomial wrt XW from Falcon specifications
+        TEMPALLOC union {
+            uint16_t hm_xw[512];
+        } r_xw;
+        TEMPALLOC inner_shake256_context sc_xw;
+
+        inner_shake256_init(&sc_xw); 		                            
+        inner_shake256_inject(&sc_xw,w_local, 16);	
+        inner_shake256_flip(&sc_xw);
+        Zf(hash_to_point_vartime)(&sc_xw, r_xw.hm_xw, 9);
+
+        uint64_t xw[512];
+
+        for(int i=0; i<512; i++){
+            xw[i] = (r_xw.hm_xw[i] << 14) % q_l;
+        }
+
+        PolyRing_Mul(xtoken_poly, h_poly, xw, q_l_bits);
+        PolyRing_Round(xtoken_local, xtoken_poly, q_l_bits, p_l_dash_bits);
+	
+        xtoken_local += N_l;
+        w_local += 16;
+    }
+
+
+    //Transform the xtokens once so each candidate term is a pointwise product
+    bool use_rns = (xtag_eval_mode == XTAG_EVAL_RNS) ||
+                   ((xtag_eval_mode == XTAG_EVAL_AUTO) && (XTAG_FP.n_coeffs >= XTAG_RNS_MIN_COEFFS));
+
+    if(use_rns && (NWords > 0)){
+        QC.XTokenRNS = new RNSPoly[NWords];
+        for(int n1=0; n1<NWords; ++n1){
+            PolyRNS_FromRing(QC.XTokenRNS+n1, QC.XToken+((size_t)n1*N_l), p_l_dash_bits);
+        }
+    }
+
+    return 0;
+}
+
+int QueryContext_Clean(QueryContext &QC)
+{
+    delete [] QC.XTokenRNS;
+    delete [] QC.XToken;
+    return 0;
+}
+
+
+int Search_Candidate(SearchWorker &wk, const QueryContext &QC, const uint16_t *yid, unsigned int slot)
+{
+    //XSet indices of every term of one candidate, into batch slot `slot` of wk.bf_n_indices
+    int NWords = QC.NWords;
+    size_t base = (size_t)slot*NWords;
+
+    uint64_t *xtoken_local;
+    uint64_t *xtag_local;
+
+
+    //  XTAG Computation  //
+    int16_t tt_yid[512];
+    int16_t yid_temp[512];
+
+    for (int u = 0; u < N_l; u ++) {
+        uint32_t w;
+        w = (uint32_t)yid[u];
+        w += q_l & - (w >> 31);
+        yid_temp[u] = (uint16_t)w;
+    }
+
+    MQ_PolyMulScalar(tt_yid, yid_temp, QC.mask, N_l);
+
+
+    //Only the coefficients hashed into the XSet fingerprint are needed
+    unsigned int n_fp = XTAG_FP.n_coeffs;
+    uint64_t yid_poly[512];
+
+    if(QC.XTokenRNS != nullptr){
+        PolyRNS_FromInt16(wk.yid_rns, tt_yid);
+    }
+    else{
+        PolyRing_FromInt16(yid_poly, tt_yid, p_l_dash_bits);
+    }
+
+    xtoken_local = QC.XToken;
+    xtag_local = wk.XTAG;
+    for(int i=0; i<NWords; ++i) 
+    { 
+        if(QC.XTokenRNS != nullptr){
+            PolyRNS_MulPoint(wk.xtag_rns, wk.yid_rns, QC.XTokenRNS+i);
+            PolyRNS_ToRing(xtag_local, wk.xtag_rns, p_l_dash_bits, n_fp);
+        }
+        else{
+		    PolyRing_MulPartial(xtag_local, yid_poly, xtoken_local, p_l_dash_bits, n_fp);
+        }
+		PolyRing_Round(xtag_local, xtag_local, p_l_dash_bits, p_bits, n_fp);
+
+        XSet_XTagIndices(XS, &wk.hasher, xtag_local, wk.bf_idx);
+        if(wk.exact != nullptr){
+            XTagFP_Digest(&wk.hasher, xtag_local, &wk.exact[base+i]);
+        }
+
+        for(unsigned int j=0;j<XSet_ElementWords(XS);++j){
+            wk.bf_n_indices[j][base+i] = wk.bf_idx[j];
+        }
+		
+        xtoken_local += N_l;
+        xtag_local += N_l;
+    }
+
+    return 0;
+}
+
+int Search_Block(SearchWorker &wk, const QueryContext &QC, const uint16_t *yid, unsigned int n_cand, char *is_match)
+{
+    //Computes the xtags of up to SEARCH_BATCH_CANDS candidates, then resolves all their XSet probes in one prefetched batch
+    if(QC.NWords == 0){
+        ::memset(is_match,1,n_cand);
+        return 0;
+    }
+
+    for(unsigned int c=0;c<n_cand;++c){
+        Search_Candidate(wk, QC, yid+((size_t)c*N_l), c);
+    }
+
+    XSet_ProbeBatch(XS, wk.bf_n_indices, QC.NWords, n_cand, wk.survivors);
+
+    for(unsigned int c=0;c<n_cand;++c){
+        is_match[c] = (wk.survivors[c >> 6] >> (c & 63)) & 1;
+    }
+
+    if(wk.exact != nullptr){
+        for(unsigned int c=0;c<n_cand;++c){
+            unsigned int n_absent = 0;
+            for(int l=0;l<QC.NWords;++l){
+                n_absent += XSetExact_Contains(XE, wk.exact[(size_t)c*QC.NWords + l]) ? 0 : 1;
+            }
+            wk.tl.n_cand++;
+            if(n_absent == 0){
+                wk.tl.n_true++;
+            }
+            else{
+                wk.tl.n_fp += is_match[c] ? 1 : 0;
+                wk.tl.expected_fp += std::pow(xset_term_fpr, (double)n_absent);
+            }
+        }
+    }
+    return 0;
+}
+
+
+
+
 int EDB_Search(unsigned char *query_str, int NWords)   
 {
 
@@ -1479,14 +1544,10 @@ int EDB_Search(unsigned char *query_str, int NWords)
     unsigned char *ID;
     unsigned char *WC;
     unsigned char *EC;
-    unsigned char ECE[16];
 
     unsigned char *YID_char;
-    unsigned char *bhash;
 
     uint16_t* YID;
-    uint64_t *XToken;    
-    uint64_t *XTAG;    
     
     int datasize = (2*N_l)+16;
 
@@ -1501,10 +1562,6 @@ int EDB_Search(unsigned char *query_str, int NWords)
     UIDX = new unsigned char[16*N_max_ids];
 
     
-    XToken = new uint64_t[N_max_id_words*N_l];
-    XTAG = new uint64_t[N_max_id_words*N_l];
-    bhash = new unsigned char[bhash_block_size];
-    
     YID = new uint16_t [N_l*N_max_id_words];
     YID_char = new unsigned char[N_max_id_words*N_l*2];                        
     
@@ -1518,23 +1575,10 @@ int EDB_Search(unsigned char *query_str, int NWords)
     string rawdb_row_current;
     string s;
 
-    int N_words = 0;
-    int n_rows = 0;
-    int n_row_ids = 0;
     int n_ids_tset = 0;
 
 
-    //BLoom Filter Parameters
-    bool idx_in_set = false;
     int nmatch = 0;
-    unsigned int bfidx = 0;
-
-    unsigned int** bf_n_indices;
-
-    bf_n_indices = new unsigned int *[N_HASH];
-    for(unsigned int i=0;i<N_HASH;++i){
-        bf_n_indices[i] = new unsigned int [NWords];
-    }
 
 
      
@@ -1544,42 +1588,32 @@ int EDB_Search(unsigned char *query_str, int NWords)
     
     ::memset(W,0x00,16);
     ::memset(ID,0x00,N_max_id_words*16);
-    ::memset(XTAG,0x00,N_max_id_words*N_l);
    
     ::memset(WC,0x00,N_max_id_words*16);
     ::memset(EC,0x00,N_max_id_words*16);
-    ::memset(bhash,0x00,bhash_block_size);
 
     ::memset(YID_char,0x00,N_max_id_words*2*N_l);
     ::memset(YID,0x00,N_max_id_words*N_l);
    
-    ::memset(XToken,0x00, N_max_id_words*N_l);
     ::memset(UIDX,0x00,16*N_max_ids);
 
 
     
-    unsigned char *id_local = ID;
-    unsigned char *wc_local = WC;
     unsigned char *w_local = W;
     unsigned char *ec_local = EC;
-    
-    uint64_t *xtoken_local = XToken;
-    unsigned char *yid_char_local = YID_char;
     uint16_t *yid_local = YID;
     unsigned char *tset_row_local = tset_row;
     unsigned char *tset_yid_local = tset_yid;
-    uint64_t *xtag_local = XTAG;
-    unsigned char *uidx_local = UIDX;
-
-    unsigned char *local_s;
-
 
 
     ::memcpy(Q1,query_str,16);
 
     
     TSet_GetTag(Q1,stag);
-    TSet_Retrieve(stag,tset_row,&n_ids_tset);
+    if(TSet_Retrieve(stag,tset_row,&n_ids_tset) != 0){
+        std::cerr << "TSet retrieval failed; the query returns no results" << std::endl;
+        n_ids_tset = 0;
+    }
     
 
     cout << "N IDs TSet: " << n_ids_tset << endl;
@@ -1623,283 +1657,65 @@ int EDB_Search(unsigned char *query_str, int NWords)
 
 
     
-    /* Key Generation */
-
-    unsigned char seed[16] = {0x56,0x37,0xca,0x94,0xd5,0xe0,0xad,0x62,0x73,0x7c,0xba,0x48,0x8d,0x2d,0x4d,0xde};
-    size_t n_keygen;
-    size_t tlen_keygen = 90112;
-    size_t tlen_sign = 178176;
-    unsigned logn_keygen = 9;
-    int8_t *f, *g, *F, *G;
-    uint16_t *h, *hm, *h2, *hm2, *h_mont;
-    int16_t *sig_keygen, *s1_keygen;
-    uint8_t *tt_keygen, *tt_sign, *temp_sign;
-    inner_shake256_context sc_keygen;
-    fpr *expanded_key;             
-
-    
-    inner_shake256_init(&sc_keygen);
-    inner_shake256_inject(&sc_keygen, seed, sizeof(seed));
-    inner_shake256_flip(&sc_keygen);
-    
-
-    temp_sign = xmalloc(tlen_sign);
-    h_mont = (uint16_t *)temp_sign;
-    n_keygen = (size_t)1 << logn_keygen;
-
-    f = xmalloc(tlen_keygen);
-    g = f + n_keygen;
-    F = g + n_keygen;
-    G = F + n_keygen;
-    h = (uint16_t *)(G + n_keygen);
-    h2 = h + n_keygen;
-    hm = h2 + n_keygen;
-    sig_keygen = (int16_t *)(hm + n_keygen);
-    s1_keygen = sig_keygen + n_keygen;
-    tt_keygen = (uint8_t *)(s1_keygen + n_keygen);
-    tt_sign = (uint8_t *)(s1_keygen + n_keygen);
-    if (logn_keygen == 1) {
-        tt_keygen += 4;
-        tt_sign += 4;
-    }
-    for (int i = 0; i < 12; i ++) {
-        Zf(keygen)(&sc_keygen, f, g, F, G, h, logn_keygen, tt_keygen);
-    }
-
-    // Public key h in NTT-Montgomery Form
-    ::memcpy(h_mont, h, n_keygen * sizeof *h_mont);
-   
+    /* Client Keys */
+    //Public key h from the key store mapped in Sys_Init; no per-query keygen
 
 	uint16_t h_temp[512];
 	for(int i=0; i<512;i++){
-		h_temp[i] = h_mont[i];
+		h_temp[i] = KEYS.data->h[i];
 	}
 
-    uint16_t mask;
-
-    yid_local = YID;
-    id_local = ID;          
-    for(int i=0;i<n_ids_tset;++i)
-    {
-        //Generate xtoken
-        xtoken_local = XToken;
-        w_local = W;
-        for(unsigned int n1=0; n1<NWords; ++n1) 
-        {
-			unsigned char r[16];
-			int c = 0;
-			int kr = encrypt(Q1, sizeof(Q1)/sizeof(Q1[0]), aad, sizeof(aad), KZ1, iv_kz, r, tag_kz);
-		
-
-			uint32_t temp = r;
-			memcpy(&temp, r, sizeof(uint32_t));
-
-			srand(temp);
-			mask = (rand()%p_l);
-			
-			int32_t x, y;
-			int32_t gcd = extended_gcd(mask, p_l, x, y);
-			if (gcd != 1) {
-				mask += 1;
-			}
-
-			
-			uint16_t inv_mask = mod_inverse(mask,p_l);
-
-			if((mask * inv_mask)%p_l == 1){
-				c++;
-			}	
-			else{	
-				mask = (rand()%p_l);
-
-				int32_t x, y;
-				int32_t gcd = extended_gcd(mask, p_l, x, y);
-				
-				if (gcd != 1) {
-					mask += 1;
-				}
-
-				inv_mask = mod_inverse(mask,p_l);
-				if((mask * inv_mask)%p_l == 1){
-					c++;
-				}
-			}
-
-
-            //Generate random polynomial wrt XW from Falcon specifications
-            TEMPALLOC union {
-                uint16_t hm_xw[512];
-            } r_xw;
-            TEMPALLOC inner_shake256_context sc_xw;
-
-            inner_shake256_init(&sc_xw); 		                            
-            inner_shake256_inject(&sc_xw,w_local, 16);	
-            inner_shake256_flip(&sc_xw);
-            Zf(hash_to_point_vartime)(&sc_xw, r_xw.hm_xw, 9);
-
-           
-			uint64_t xw[512];
-			size_t n_xw = (size_t)1 << 9;
-
-			for(int i=0; i<512; i++){
-				xw[i] = (r_xw.hm_xw[i] << 14) % q_l;
-			}
-
-			ZZ q = power2_ZZ(45);
-			ZZ p1 = power2_ZZ(40);
-
-			ZZX h_temp_NTL, xw_NTL, xtoken;
-
-			for(int i=0; i<512; i++){ 
-				SetCoeff(h_temp_NTL, i, ZZ(h_temp[i]));
-				SetCoeff(xw_NTL, i, ZZ(xw[i]));
-			}
-
-			
-			reduce_mod_phi(xw_NTL, q, N_l);	
+    //Candidates are independent; workers take them in blocks of SEARCH_BATCH_CANDS and matches are merged in TSet order
+    QueryContext QC;
+    QueryContext_Init(QC, Q1, W, NWords, h_temp);
 
-			xtoken = h_temp_NTL * xw_NTL;
-			for(long i=0; i<=deg(xtoken); i++){ 
-				NTL::ZZ coeff = NTL::coeff(xtoken, i);
-				coeff = (coeff % q + q) % q; 
-				NTL::SetCoeff(xtoken, i, coeff);
-			}
-			reduce_mod_phi(xtoken, q, N_l);
-
-
-			for (size_t i = 0; i < 512; i++) {
-				xtoken_local[i] = conv<int64_t>((coeff(xtoken, i)) >> (45 - 40));
-				xtoken_local[i] = xtoken_local[i] % p_l_dash;
-				SetCoeff(xtoken, i, xtoken_local[i]);
-			}
-		
-            xtoken_local += N_l;
-            w_local += 16;
-        }
-        xtoken_local = XToken;
+    int n_workers = (N_search_threads > 0) ? N_search_threads : omp_get_max_threads();
 
+    vector<SearchWorker> workers(n_workers);
+    for(auto &wk:workers){
+        SearchWorker_Init(wk, NWords);
+    }
 
-        //  XTAG Computation  //
-        ::memset(XTAG,0x00, N_max_id_words*N_l);
-
-        int16_t tt_yid[512];
-        int16_t yid_temp[512];
-		uint32_t tt_yid_large[512];
-
-        for (int u = 0; u < N_l; u ++) {
-            uint32_t w;
-            w = (uint32_t)yid_local[u];
-            w += q_l & - (w >> 31);
-            yid_temp[u] = (uint16_t)w;
-        }
-
-        for(int i=0; i<512; i++){
-            tt_yid[i] = (yid_temp[i] * mask) % p_l; 
-			// tt_yid_large[i] = tt_yid[i];	
-		}
-
-
-        if(NWords == 0){
-            ::memcpy(ec_local,ECE,16);
-            ec_local +=16;
-            ++nmatch;
-        }
-
-        else {
-
-            xtag_local = XTAG;
-            xtoken_local = XToken;
-            for(unsigned int n1=0; n1<NWords; ++n1) 
-            { 
-				ZZ p1 = power2_ZZ(40);
-
-				ZZX yid_NTL, xtoken_NTL, xtag_NTL_temp, xtag_NTL;
-
-				for(int i=0; i<512; i++){
-					SetCoeff(yid_NTL,i,ZZ(tt_yid[i]));
-					SetCoeff(xtoken_NTL,i,ZZ(xtoken_local[i]));
-					
-				}
-				
-
-				xtag_NTL_temp = yid_NTL * xtoken_NTL;
-				for(int i=0; i<=deg(xtag_NTL_temp); i++){ 
-					int64_t x = conv<int64_t>((coeff(xtag_NTL_temp, i)));
-					x = x % p_l_dash;
-					SetCoeff(xtag_NTL_temp, i, x);
-				}
-				reduce_mod_phi(xtag_NTL_temp, p1, N_l);
-				
-
-				for(int i = 0; i <= deg(xtag_NTL_temp); i++){
-					xtag_local[i] = conv<int64_t>((coeff(xtag_NTL_temp, i)));
-					xtag_local[i] = xtag_local[i] >> (40 - 5);
-					xtag_local[i] = xtag_local[i] % p;
-					SetCoeff(xtag_NTL_temp, i, xtag_local[i]);
-				}
-				
-				
-                xtoken_local += N_l;
-                xtag_local += N_l;
-        
-            }
-            xtoken_local = XToken;
-            xtag_local = XTAG;
-
-
-            for(int i=0; i<NWords; ++i){
-
-                ::memset(bhash,0x00,bhash_block_size);
-
-                unsigned char xtag_char[2*N_l];
-                ::memset(xtag_char,0x00,2*N_l);
-
-
-                unsigned char *xtag_char_local = xtag_char;
-                for(int k=0; k<N_l; k++){
-                    xtag_char[2*k] = static_cast<unsigned char>(xtag_local[k] & 0xFF);          
-                    xtag_char[2*k + 1] = static_cast<unsigned char>((xtag_local[k] >> 8) & 0xFF); 
-
-                }
-                
-                xtag_char_local = xtag_char;
-
-                BLOOM_HASH(xtag_char,bhash);
-
-
-                for(int j=0;j<N_HASH;++j){
-                    bf_n_indices[j][i] = BFIdxConv(bhash+(64*j),N_BF_BITS);
-                }
-
-                xtag_local += N_l;
-            }
-
-            xtag_local = XTAG;
-
-            BloomFilter_Match_N(BF, bf_n_indices, NWords, &idx_in_set);
-
+    vector<char> cand_match(n_ids_tset, 0);
 
-            if(idx_in_set){
-                ::memcpy(ec_local,ECE,16);
-                ec_local +=16;
-                nmatch++;
-            }
+    int n_blocks = (n_ids_tset + SEARCH_BATCH_CANDS - 1)/SEARCH_BATCH_CANDS;
 
+    #pragma omp parallel for schedule(dynamic,1) num_threads(n_workers)
+    for(int b=0;b<n_blocks;++b)
+    {
+        int first = b*SEARCH_BATCH_CANDS;
+        unsigned int n_cand = std::min(SEARCH_BATCH_CANDS, n_ids_tset - first);
+        Search_Block(workers[omp_get_thread_num()], QC, YID+((size_t)first*N_l), n_cand, cand_match.data()+first);
+    }
 
+    for(int i=0;i<n_ids_tset;++i){
+        if(cand_match[i]){
+            ::memcpy(UIDX+(16*nmatch),EC+(16*i),16);
+            nmatch++;
         }
+    }
 
-        ec_local += 16;
-        w_local += 16;
-        yid_local += N_l;
-
+    XSetTelemetry tl;
+    ::memset(&tl,0x00,sizeof(tl));
+    for(auto &wk:workers){
+        tl.n_cand += wk.tl.n_cand;
+        tl.n_true += wk.tl.n_true;
+        tl.n_fp += wk.tl.n_fp;
+        tl.expected_fp += wk.tl.expected_fp;
+        SearchWorker_Clean(wk);
     }
-    yid_local = YID;
-    ec_local = EC;
-    w_local = W;
+    QueryContext_Clean(QC);
 
     
     
     cout << "Nmatch: " << nmatch << endl;
+    if(xset_telemetry && (NWords > 0)){
+        uint64_t n_neg = tl.n_cand - tl.n_true;
+        cout << "XSet telemetry: " << tl.n_cand << " candidates, " << tl.n_true << " true matches, "
+             << tl.n_fp << " false positives, observed FPR " << ((n_neg > 0) ? (double)tl.n_fp/n_neg : 0.0)
+             << ", expected FPR " << ((n_neg > 0) ? tl.expected_fp/n_neg : 0.0)
+             << " (" << tl.expected_fp << " expected false positives, term FPR " << xset_term_fpr << ")" << endl;
+    }
 
     
     
@@ -1963,16 +1779,9 @@ int EDB_Search(unsigned char *query_str, int NWords)
     
     
 
-    for(unsigned int i=0;i<N_HASH;++i){
-        delete [] bf_n_indices[i];
-    }
-    delete [] bf_n_indices;
-
     delete [] stag;
     delete [] tset_row;
     delete [] WC;
-    delete [] XTAG;
-    delete [] bhash;
     delete [] EC;
 
     delete [] YID;
@@ -2002,8 +1811,18 @@ int main()
    
     Sys_Init();
     
-    std::cout << "Reading Bloom Filter from disk..." << std::endl;
-    BloomFilter_ReadBFfromFile(bloomfilter_file, BF); //Load bloom filter from file
+    std::cout << "Reading XSet filter from disk..." << std::endl;
+    if(XSet_Read(bloomfilter_file, XS) != 0){ //Load XSet filter from file
+        exit(1);
+    }
+    if(xset_telemetry){
+        if(XSetExact_Read(xset_exact_file, XE) != 0){
+            exit(1);
+        }
+        xset_term_fpr = XSet_TermFPR(XS);
+        std::cout << "XSet telemetry on: " << XE.n_digests << " exact xtags, " << XSet_Name(XS.type)
+                  << " term FPR " << xset_term_fpr << std::endl;
+    }
   
     
     auto search_start_time = std::chrono::high_resolution_clock::now();
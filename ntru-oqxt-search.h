@@ -25,8 +25,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <bits/stdc++.h>
-#include <NTL/ZZ_pX.h>
-#include <NTL/ZZ_p.h>
+#include <omp.h>
 
 
 #include "crypto++/cryptlib.h"
@@ -47,7 +46,15 @@
 
 #include "size_parameters.h"
 #include "rawdatautil.h"
-#include "bloom_filter.h"
+#include "xset.h"
+#include "xset_exact.h"
+#include "redis_pool.h"
+#include "tset_format.h"
+#include "tset_store.h"
+#include "poly_ring.h"
+#include "mq_ntt.h"
+#include "key_store.h"
+#include "poly_rns.h"
 #include "utils.h"
 #include "AES_256GCM.h"
 #include "../../NTRU-OQXT/falcon-round3/Extra/c/falcon.h"
@@ -57,7 +64,6 @@ using namespace std;
 using namespace std::chrono;
 using namespace sw::redis;
 using namespace CryptoPP;
-using namespace NTL;
 
 extern sw::redis::ConnectionOptions connection_options;
 extern sw::redis::ConnectionPoolOptions pool_options;
@@ -79,6 +85,7 @@ int BLOOM_HASH(unsigned char *msg, unsigned char *digest);
 
 
 int MGDB_QUERY(unsigned char *RES, unsigned char *BIDX, unsigned char *JIDX, unsigned char *LBL);
+int MGDB_QUERY_N(unsigned char *RES, unsigned char *BIDX, unsigned char *JIDX, unsigned char *LBL, int n_entries, int value_bytes, int *n_found, int *res_bytes);
 
 
 int SHA3_HASH(blake3_hasher *hasher,unsigned char *msg, unsigned char *digest);
@@ -90,8 +97,70 @@ std::string HexToStr(unsigned char *hexarr,int len=16);
 unsigned int BFIdxConv(unsigned char *hex_arr, unsigned int n_bits);
 
 static void mk_rand_poly_oqxt(prng *p, fpr *f, unsigned logn);
-std::string HexToStr(int *hexarr, int len);
-std::string HexToStr(unsigned char *hexarr,int len=16);
+
+
+//Candidate xtag evaluation: schoolbook over the fingerprint coefficients, or
+//pointwise products against xtokens held in the RNS/NTT domain (poly_rns.h)
+#define XTAG_EVAL_AUTO 0
+#define XTAG_EVAL_SCHOOLBOOK 1
+#define XTAG_EVAL_RNS 2
+#define XTAG_RNS_MIN_COEFFS 64                  //AUTO picks RNS from this fingerprint width up
+
+#define SEARCH_BATCH_CANDS 64                   //Candidates whose XSet probes are resolved in one batch
+
+#define TSET_RETRIEVE_SERIAL 0
+#define TSET_RETRIEVE_BATCHED 1
+#define TSET_RETRIEVE_SERVER 2                  //Batched windows walked server-side up to the end-of-list flag
+
+/*
+ * Everything in EDB_Search that depends only on the query: the s-term mask
+ * and its inverse, and the rounded xtoken of every remaining term. Derived
+ * once per query and shared read-only by all candidate workers.
+ */
+typedef struct {
+    unsigned char Q1[16];
+    int NWords;
+    uint16_t mask;
+    uint16_t inv_mask;
+    uint64_t *XToken;                       //NWords x N_l, h.xw mod 2^q_l_bits rounded to p_l_dash_bits
+    RNSPoly *XTokenRNS;                     //NWords transformed xtokens, or nullptr for schoolbook evaluation
+} QueryContext;
+
+/*
+ * Per-query false-positive telemetry against the exact XSet side-set.
+ * Non-matching candidates are those with at least one term absent from the
+ * exact set; each survives the filter with probability term_fpr^absent.
+ */
+typedef struct {
+    uint64_t n_cand;
+    uint64_t n_true;                        //All terms in the exact set
+    uint64_t n_fp;                          //Passed the filter without being a true match
+    double expected_fp;                     //Sum of term_fpr^absent over non-matching candidates
+} XSetTelemetry;
+
+/*
+ * Per-thread scratch for candidate evaluation in EDB_Search: xtag buffers,
+ * Bloom indices for a batch of candidates (entry c*NWords + l of each row
+ * is term l of candidate c) and fingerprint hashing state.
+ */
+typedef struct {
+    uint64_t *XTAG;
+    unsigned int **bf_n_indices;
+    uint64_t survivors[(SEARCH_BATCH_CANDS + 63)/64];
+    blake3_hasher hasher;
+    unsigned int bf_idx[BF_MAX_HASH+1];
+    RNSPoly *yid_rns;
+    RNSPoly *xtag_rns;
+    XTagDigest *exact;                      //Batch xtag digests, xset_telemetry only
+    XSetTelemetry tl;
+} SearchWorker;
+
+int QueryContext_Init(QueryContext &QC, unsigned char *Q1, unsigned char *W, int NWords, const uint16_t *h_temp);
+int QueryContext_Clean(QueryContext &QC);
+int SearchWorker_Init(SearchWorker &wk, int NWords);
+int SearchWorker_Clean(SearchWorker &wk);
+int Search_Candidate(SearchWorker &wk, const QueryContext &QC, const uint16_t *yid, unsigned int slot);
+int Search_Block(SearchWorker &wk, const QueryContext &QC, const uint16_t *yid, unsigned int n_cand, char *is_match);
 
 
 #endif
@@ -5,6 +5,7 @@
 #define CRYPTO_PUBLICKEYBYTES   897
 #define CRYPTO_BYTES            690
 #define FALCON_KEYGEN_TEMP_9    14336
+#define FALCON_SIGN_TREE_TEMP_9 24576
 
 
 #define Q0I   12287
@@ -17,279 +18,6 @@
 #define R_large      2523
 #define R2_large    22298801
 
-/*
- * Table for NTT, binary case:
- *   GMb[x] = R1*(g^rev(x)) mod q
- * where g = 7 (it is a 2048-th primitive root of 1 modulo q)
- * and rev() is the bit-reversal function over 10 bits.
- */
-static const uint16_t GMb[] = {
-	 4091,  7888, 11060, 11208,  6960,  4342,  6275,  9759,
-	 1591,  6399,  9477,  5266,   586,  5825,  7538,  9710,
-	 1134,  6407,  1711,   965,  7099,  7674,  3743,  6442,
-	10414,  8100,  1885,  1688,  1364, 10329, 10164,  9180,
-	12210,  6240,   997,   117,  4783,  4407,  1549,  7072,
-	 2829,  6458,  4431,  8877,  7144,  2564,  5664,  4042,
-	12189,   432, 10751,  1237,  7610,  1534,  3983,  7863,
-	 2181,  6308,  8720,  6570,  4843,  1690,    14,  3872,
-	 5569,  9368, 12163,  2019,  7543,  2315,  4673,  7340,
-	 1553,  1156,  8401, 11389,  1020,  2967, 10772,  7045,
-	 3316, 11236,  5285, 11578, 10637, 10086,  9493,  6180,
-	 9277,  6130,  3323,   883, 10469,   489,  1502,  2851,
-	11061,  9729,  2742, 12241,  4970, 10481, 10078,  1195,
-	  730,  1762,  3854,  2030,  5892, 10922,  9020,  5274,
-	 9179,  3604,  3782, 10206,  3180,  3467,  4668,  2446,
-	 7613,  9386,   834,  7703,  6836,  3403,  5351, 12276,
-	 3580,  1739, 10820,  9787, 10209,  4070, 12250,  8525,
-	10401,  2749,  7338, 10574,  6040,   943,  9330,  1477,
-	 6865,  9668,  3585,  6633, 12145,  4063,  3684,  7680,
-	 8188,  6902,  3533,  9807,  6090,   727, 10099,  7003,
-	 6945,  1949,  9731, 10559,  6057,   378,  7871,  8763,
-	 8901,  9229,  8846,  4551,  9589, 11664,  7630,  8821,
-	 5680,  4956,  6251,  8388, 10156,  8723,  2341,  3159,
-	 1467,  5460,  8553,  7783,  2649,  2320,  9036,  6188,
-	  737,  3698,  4699,  5753,  9046,  3687,    16,   914,
-	 5186, 10531,  4552,  1964,  3509,  8436,  7516,  5381,
-	10733,  3281,  7037,  1060,  2895,  7156,  8887,  5357,
-	 6409,  8197,  2962,  6375,  5064,  6634,  5625,   278,
-	  932, 10229,  8927,  7642,   351,  9298,   237,  5858,
-	 7692,  3146, 12126,  7586,  2053, 11285,  3802,  5204,
-	 4602,  1748, 11300,   340,  3711,  4614,   300, 10993,
-	 5070, 10049, 11616, 12247,  7421, 10707,  5746,  5654,
-	 3835,  5553,  1224,  8476,  9237,  3845,   250, 11209,
-	 4225,  6326,  9680, 12254,  4136,  2778,   692,  8808,
-	 6410,  6718, 10105, 10418,  3759,  7356, 11361,  8433,
-	 6437,  3652,  6342,  8978,  5391,  2272,  6476,  7416,
-	 8418, 10824, 11986,  5733,   876,  7030,  2167,  2436,
-	 3442,  9217,  8206,  4858,  5964,  2746,  7178,  1434,
-	 7389,  8879, 10661, 11457,  4220,  1432, 10832,  4328,
-	 8557,  1867,  9454,  2416,  3816,  9076,   686,  5393,
-	 2523,  4339,  6115,   619,   937,  2834,  7775,  3279,
-	 2363,  7488,  6112,  5056,   824, 10204, 11690,  1113,
-	 2727,  9848,   896,  2028,  5075,  2654, 10464,  7884,
-	12169,  5434,  3070,  6400,  9132, 11672, 12153,  4520,
-	 1273,  9739, 11468,  9937, 10039,  9720,  2262,  9399,
-	11192,   315,  4511,  1158,  6061,  6751, 11865,   357,
-	 7367,  4550,   983,  8534,  8352, 10126,  7530,  9253,
-	 4367,  5221,  3999,  8777,  3161,  6990,  4130, 11652,
-	 3374, 11477,  1753,   292,  8681,  2806, 10378, 12188,
-	 5800, 11811,  3181,  1988,  1024,  9340,  2477, 10928,
-	 4582,  6750,  3619,  5503,  5233,  2463,  8470,  7650,
-	 7964,  6395,  1071,  1272,  3474, 11045,  3291, 11344,
-	 8502,  9478,  9837,  1253,  1857,  6233,  4720, 11561,
-	 6034,  9817,  3339,  1797,  2879,  6242,  5200,  2114,
-	 7962,  9353, 11363,  5475,  6084,  9601,  4108,  7323,
-	10438,  9471,  1271,   408,  6911,  3079,   360,  8276,
-	11535,  9156,  9049, 11539,   850,  8617,   784,  7919,
-	 8334, 12170,  1846, 10213, 12184,  7827, 11903,  5600,
-	 9779,  1012,   721,  2784,  6676,  6552,  5348,  4424,
-	 6816,  8405,  9959,  5150,  2356,  5552,  5267,  1333,
-	 8801,  9661,  7308,  5788,  4910,   909, 11613,  4395,
-	 8238,  6686,  4302,  3044,  2285, 12249,  1963,  9216,
-	 4296, 11918,   695,  4371,  9793,  4884,  2411, 10230,
-	 2650,   841,  3890, 10231,  7248,  8505, 11196,  6688,
-	 4059,  6060,  3686,  4722, 11853,  5816,  7058,  6868,
-	11137,  7926,  4894, 12284,  4102,  3908,  3610,  6525,
-	 7938,  7982, 11977,  6755,   537,  4562,  1623,  8227,
-	11453,  7544,   906, 11816,  9548, 10858,  9703,  2815,
-	11736,  6813,  6979,   819,  8903,  6271, 10843,   348,
-	 7514,  8339,  6439,   694,   852,  5659,  2781,  3716,
-	11589,  3024,  1523,  8659,  4114, 10738,  3303,  5885,
-	 2978,  7289, 11884,  9123,  9323, 11830,    98,  2526,
-	 2116,  4131, 11407,  1844,  3645,  3916,  8133,  2224,
-	10871,  8092,  9651,  5989,  7140,  8480,  1670,   159,
-	10923,  4918,   128,  7312,   725,  9157,  5006,  6393,
-	 3494,  6043, 10972,  6181, 11838,  3423, 10514,  7668,
-	 3693,  6658,  6905, 11953, 10212, 11922,  9101,  8365,
-	 5110,    45,  2400,  1921,  4377,  2720,  1695,    51,
-	 2808,   650,  1896,  9997,  9971, 11980,  8098,  4833,
-	 4135,  4257,  5838,  4765, 10985, 11532,   590, 12198,
-	  482, 12173,  2006,  7064, 10018,  3912, 12016, 10519,
-	11362,  6954,  2210,   284,  5413,  6601,  3865, 10339,
-	11188,  6231,   517,  9564, 11281,  3863,  1210,  4604,
-	 8160, 11447,   153,  7204,  5763,  5089,  9248, 12154,
-	11748,  1354,  6672,   179,  5532,  2646,  5941, 12185,
-	  862,  3158,   477,  7279,  5678,  7914,  4254,   302,
-	 2893, 10114,  6890,  9560,  9647, 11905,  4098,  9824,
-	10269,  1353, 10715,  5325,  6254,  3951,  1807,  6449,
-	 5159,  1308,  8315,  3404,  1877,  1231,   112,  6398,
-	11724, 12272,  7286,  1459, 12274,  9896,  3456,   800,
-	 1397, 10678,   103,  7420,  7976,   936,   764,   632,
-	 7996,  8223,  8445,  7758, 10870,  9571,  2508,  1946,
-	 6524, 10158,  1044,  4338,  2457,  3641,  1659,  4139,
-	 4688,  9733, 11148,  3946,  2082,  5261,  2036, 11850,
-	 7636, 12236,  5366,  2380,  1399,  7720,  2100,  3217,
-	10912,  8898,  7578, 11995,  2791,  1215,  3355,  2711,
-	 2267,  2004,  8568, 10176,  3214,  2337,  1750,  4729,
-	 4997,  7415,  6315, 12044,  4374,  7157,  4844,   211,
-	 8003, 10159,  9290, 11481,  1735,  2336,  5793,  9875,
-	 8192,   986,  7527,  1401,   870,  3615,  8465,  2756,
-	 9770,  2034, 10168,  3264,  6132,    54,  2880,  4763,
-	11805,  3074,  8286,  9428,  4881,  6933,  1090, 10038,
-	 2567,   708,   893,  6465,  4962, 10024,  2090,  5718,
-	10743,   780,  4733,  4623,  2134,  2087,  4802,   884,
-	 5372,  5795,  5938,  4333,  6559,  7549,  5269, 10664,
-	 4252,  3260,  5917, 10814,  5768,  9983,  8096,  7791,
-	 6800,  7491,  6272,  1907, 10947,  6289, 11803,  6032,
-	11449,  1171,  9201,  7933,  2479,  7970, 11337,  7062,
-	 8911,  6728,  6542,  8114,  8828,  6595,  3545,  4348,
-	 4610,  2205,  6999,  8106,  5560, 10390,  9321,  2499,
-	 2413,  7272,  6881, 10582,  9308,  9437,  3554,  3326,
-	 5991, 11969,  3415, 12283,  9838, 12063,  4332,  7830,
-	11329,  6605, 12271,  2044, 11611,  7353, 11201, 11582,
-	 3733,  8943,  9978,  1627,  7168,  3935,  5050,  2762,
-	 7496, 10383,   755,  1654, 12053,  4952, 10134,  4394,
-	 6592,  7898,  7497,  8904, 12029,  3581, 10748,  5674,
-	10358,  4901,  7414,  8771,   710,  6764,  8462,  7193,
-	 5371,  7274, 11084,   290,  7864,  6827, 11822,  2509,
-	 6578,  4026,  5807,  1458,  5721,  5762,  4178,  2105,
-	11621,  4852,  8897,  2856, 11510,  9264,  2520,  8776,
-	 7011,  2647,  1898,  7039,  5950, 11163,  5488,  6277,
-	 9182, 11456,   633, 10046, 11554,  5633,  9587,  2333,
-	 7008,  7084,  5047,  7199,  9865,  8997,   569,  6390,
-	10845,  9679,  8268, 11472,  4203,  1997,     2,  9331,
-	  162,  6182,  2000,  3649,  9792,  6363,  7557,  6187,
-	 8510,  9935,  5536,  9019,  3706, 12009,  1452,  3067,
-	 5494,  9692,  4865,  6019,  7106,  9610,  4588, 10165,
-	 6261,  5887,  2652, 10172,  1580, 10379,  4638,  9949
-};
-
-
-/*
- * Table for inverse NTT, binary case:
- *   iGMb[x] = R1*((1/g)^rev(x)) mod q
- * Since g = 7, 1/g = 8778 mod 12289.
- */
-static const uint16_t iGMb[] = {
-	 4091,  4401,  1081,  1229,  2530,  6014,  7947,  5329,
-	 2579,  4751,  6464, 11703,  7023,  2812,  5890, 10698,
-	 3109,  2125,  1960, 10925, 10601, 10404,  4189,  1875,
-	 5847,  8546,  4615,  5190, 11324, 10578,  5882, 11155,
-	 8417, 12275, 10599,  7446,  5719,  3569,  5981, 10108,
-	 4426,  8306, 10755,  4679, 11052,  1538, 11857,   100,
-	 8247,  6625,  9725,  5145,  3412,  7858,  5831,  9460,
-	 5217, 10740,  7882,  7506, 12172, 11292,  6049,    79,
-	   13,  6938,  8886,  5453,  4586, 11455,  2903,  4676,
-	 9843,  7621,  8822,  9109,  2083,  8507,  8685,  3110,
-	 7015,  3269,  1367,  6397, 10259,  8435, 10527, 11559,
-	11094,  2211,  1808,  7319,    48,  9547,  2560,  1228,
-	 9438, 10787, 11800,  1820, 11406,  8966,  6159,  3012,
-	 6109,  2796,  2203,  1652,   711,  7004,  1053,  8973,
-	 5244,  1517,  9322, 11269,   900,  3888, 11133, 10736,
-	 4949,  7616,  9974,  4746, 10270,   126,  2921,  6720,
-	 6635,  6543,  1582,  4868,    42,   673,  2240,  7219,
-	 1296, 11989,  7675,  8578, 11949,   989, 10541,  7687,
-	 7085,  8487,  1004, 10236,  4703,   163,  9143,  4597,
-	 6431, 12052,  2991, 11938,  4647,  3362,  2060, 11357,
-	12011,  6664,  5655,  7225,  5914,  9327,  4092,  5880,
-	 6932,  3402,  5133,  9394, 11229,  5252,  9008,  1556,
-	 6908,  4773,  3853,  8780, 10325,  7737,  1758,  7103,
-	11375, 12273,  8602,  3243,  6536,  7590,  8591, 11552,
-	 6101,  3253,  9969,  9640,  4506,  3736,  6829, 10822,
-	 9130,  9948,  3566,  2133,  3901,  6038,  7333,  6609,
-	 3468,  4659,   625,  2700,  7738,  3443,  3060,  3388,
-	 3526,  4418, 11911,  6232,  1730,  2558, 10340,  5344,
-	 5286,  2190, 11562,  6199,  2482,  8756,  5387,  4101,
-	 4609,  8605,  8226,   144,  5656,  8704,  2621,  5424,
-	10812,  2959, 11346,  6249,  1715,  4951,  9540,  1888,
-	 3764,    39,  8219,  2080,  2502,  1469, 10550,  8709,
-	 5601,  1093,  3784,  5041,  2058,  8399, 11448,  9639,
-	 2059,  9878,  7405,  2496,  7918, 11594,   371,  7993,
-	 3073, 10326,    40, 10004,  9245,  7987,  5603,  4051,
-	 7894,   676, 11380,  7379,  6501,  4981,  2628,  3488,
-	10956,  7022,  6737,  9933,  7139,  2330,  3884,  5473,
-	 7865,  6941,  5737,  5613,  9505, 11568, 11277,  2510,
-	 6689,   386,  4462,   105,  2076, 10443,   119,  3955,
-	 4370, 11505,  3672, 11439,   750,  3240,  3133,   754,
-	 4013, 11929,  9210,  5378, 11881, 11018,  2818,  1851,
-	 4966,  8181,  2688,  6205,  6814,   926,  2936,  4327,
-	10175,  7089,  6047,  9410, 10492,  8950,  2472,  6255,
-	  728,  7569,  6056, 10432, 11036,  2452,  2811,  3787,
-	  945,  8998,  1244,  8815, 11017, 11218,  5894,  4325,
-	 4639,  3819,  9826,  7056,  6786,  8670,  5539,  7707,
-	 1361,  9812,  2949, 11265, 10301,  9108,   478,  6489,
-	  101,  1911,  9483,  3608, 11997, 10536,   812,  8915,
-	  637,  8159,  5299,  9128,  3512,  8290,  7068,  7922,
-	 3036,  4759,  2163,  3937,  3755, 11306,  7739,  4922,
-	11932,   424,  5538,  6228, 11131,  7778, 11974,  1097,
-	 2890, 10027,  2569,  2250,  2352,   821,  2550, 11016,
-	 7769,   136,   617,  3157,  5889,  9219,  6855,   120,
-	 4405,  1825,  9635,  7214, 10261, 11393,  2441,  9562,
-	11176,   599,  2085, 11465,  7233,  6177,  4801,  9926,
-	 9010,  4514,  9455, 11352, 11670,  6174,  7950,  9766,
-	 6896, 11603,  3213,  8473,  9873,  2835, 10422,  3732,
-	 7961,  1457, 10857,  8069,   832,  1628,  3410,  4900,
-	10855,  5111,  9543,  6325,  7431,  4083,  3072,  8847,
-	 9853, 10122,  5259, 11413,  6556,   303,  1465,  3871,
-	 4873,  5813, 10017,  6898,  3311,  5947,  8637,  5852,
-	 3856,   928,  4933,  8530,  1871,  2184,  5571,  5879,
-	 3481, 11597,  9511,  8153,    35,  2609,  5963,  8064,
-	 1080, 12039,  8444,  3052,  3813, 11065,  6736,  8454,
-	 2340,  7651,  1910, 10709,  2117,  9637,  6402,  6028,
-	 2124,  7701,  2679,  5183,  6270,  7424,  2597,  6795,
-	 9222, 10837,   280,  8583,  3270,  6753,  2354,  3779,
-	 6102,  4732,  5926,  2497,  8640, 10289,  6107, 12127,
-	 2958, 12287, 10292,  8086,   817,  4021,  2610,  1444,
-	 5899, 11720,  3292,  2424,  5090,  7242,  5205,  5281,
-	 9956,  2702,  6656,   735,  2243, 11656,   833,  3107,
-	 6012,  6801,  1126,  6339,  5250, 10391,  9642,  5278,
-	 3513,  9769,  3025,   779,  9433,  3392,  7437,   668,
-	10184,  8111,  6527,  6568, 10831,  6482,  8263,  5711,
-	 9780,   467,  5462,  4425, 11999,  1205,  5015,  6918,
-	 5096,  3827,  5525, 11579,  3518,  4875,  7388,  1931,
-	 6615,  1541,  8708,   260,  3385,  4792,  4391,  5697,
-	 7895,  2155,  7337,   236, 10635, 11534,  1906,  4793,
-	 9527,  7239,  8354,  5121, 10662,  2311,  3346,  8556,
-	  707,  1088,  4936,   678, 10245,    18,  5684,   960,
-	 4459,  7957,   226,  2451,     6,  8874,   320,  6298,
-	 8963,  8735,  2852,  2981,  1707,  5408,  5017,  9876,
-	 9790,  2968,  1899,  6729,  4183,  5290, 10084,  7679,
-	 7941,  8744,  5694,  3461,  4175,  5747,  5561,  3378,
-	 5227,   952,  4319,  9810,  4356,  3088, 11118,   840,
-	 6257,   486,  6000,  1342, 10382,  6017,  4798,  5489,
-	 4498,  4193,  2306,  6521,  1475,  6372,  9029,  8037,
-	 1625,  7020,  4740,  5730,  7956,  6351,  6494,  6917,
-	11405,  7487, 10202, 10155,  7666,  7556, 11509,  1546,
-	 6571, 10199,  2265,  7327,  5824, 11396, 11581,  9722,
-	 2251, 11199,  5356,  7408,  2861,  4003,  9215,   484,
-	 7526,  9409, 12235,  6157,  9025,  2121, 10255,  2519,
-	 9533,  3824,  8674, 11419, 10888,  4762, 11303,  4097,
-	 2414,  6496,  9953, 10554,   808,  2999,  2130,  4286,
-	12078,  7445,  5132,  7915,   245,  5974,  4874,  7292,
-	 7560, 10539,  9952,  9075,  2113,  3721, 10285, 10022,
-	 9578,  8934, 11074,  9498,   294,  4711,  3391,  1377,
-	 9072, 10189,  4569, 10890,  9909,  6923,    53,  4653,
-	  439, 10253,  7028, 10207,  8343,  1141,  2556,  7601,
-	 8150, 10630,  8648,  9832,  7951, 11245,  2131,  5765,
-	10343,  9781,  2718,  1419,  4531,  3844,  4066,  4293,
-	11657, 11525, 11353,  4313,  4869, 12186,  1611, 10892,
-	11489,  8833,  2393,    15, 10830,  5003,    17,   565,
-	 5891, 12177, 11058, 10412,  8885,  3974, 10981,  7130,
-	 5840, 10482,  8338,  6035,  6964,  1574, 10936,  2020,
-	 2465,  8191,   384,  2642,  2729,  5399,  2175,  9396,
-	11987,  8035,  4375,  6611,  5010, 11812,  9131, 11427,
-	  104,  6348,  9643,  6757, 12110,  5617, 10935,   541,
-	  135,  3041,  7200,  6526,  5085, 12136,   842,  4129,
-	 7685, 11079,  8426,  1008,  2725, 11772,  6058,  1101,
-	 1950,  8424,  5688,  6876, 12005, 10079,  5335,   927,
-	 1770,   273,  8377,  2271,  5225, 10283,   116, 11807,
-	   91, 11699,   757,  1304,  7524,  6451,  8032,  8154,
-	 7456,  4191,   309,  2318,  2292, 10393, 11639,  9481,
-	12238, 10594,  9569,  7912, 10368,  9889, 12244,  7179,
-	 3924,  3188,   367,  2077,   336,  5384,  5631,  8596,
-	 4621,  1775,  8866,   451,  6108,  1317,  6246,  8795,
-	 5896,  7283,  3132, 11564,  4977, 12161,  7371,  1366,
-	12130, 10619,  3809,  5149,  6300,  2638,  4197,  1418,
-	10065,  4156,  8373,  8644, 10445,   882,  8158, 10173,
-	 9763, 12191,   459,  2966,  3166,   405,  5000,  9311,
-	 6404,  8986,  1551,  8175,  3630, 10766,  9265,   700,
-	 8573,  9508,  6630, 11437, 11595,  5850,  3950,  4775,
-	11941,  1446,  6018,  3386, 11470,  5310,  5476,   553,
-	 9474,  2586,  1431,  2741,   473, 11383,  4745,   836,
-	 4062, 10666,  7727, 11752,  5534,   312,  4307,  4351,
-	 5764,  8679,  8381,  8187,     5,  7395,  4363,  1152,
-	 5421,  5231,  6473,   436,  7567,  8603,  6229,  8230
-};
 
 
 static const uint32_t GMb_large[] = {
@@ -432,9 +160,12 @@ static const uint32_t iGMb_large[] = {
 string rawdb_file = "db6k.dat";
 string eidxdb_file = "EDB_test.csv";
 string bloomfilter_file = "bloom_filter.dat";
+string trapdoor_journal_file = "";         //Optional persistence journal for per-ID trapdoors, reloaded by later runs ("" disables it)
+
 
+XSet XS;
 
-unsigned char **BF;
+TrapdoorCache TDC;
 
 unsigned char *UIDX;
 
@@ -446,6 +177,29 @@ int N_words = N_keywords;
 int N_max_id_words = 1809;
 int N_kw_id_max = 80901;
 int N_threads = 1;
+int N_setup_threads = 0;                    //Setup workers (0 = one per available core)
+size_t setup_batch_pairs = 65536;           //(keyword, id) pairs processed per parallel batch
+unsigned int xtag_fp_coeffs = XTAG_FP_COEFFS;   //XSet fingerprint width in xtag coefficients (1..N_l)
+double bf_target_fpr = BF_DEFAULT_FPR;      //XSet false-positive target the filter is sized for
+unsigned int bf_n_hash = 0;                 //XSet k (0 = derived from bf_target_fpr)
+unsigned int bf_layout = BF_LAYOUT_BLOCKED; //XSet layout: blocked (one cache line per probe) or partitioned
+unsigned int xset_type = XSET_BLOOM;        //XSet backend: XSET_BLOOM, XSET_FUSE or XSET_CUCKOO
+int xset_telemetry = 0;                     //Also write the exact xtag side-set search uses for false-positive telemetry
+string xset_exact_file = "xset_exact.dat";
+int xset_build_shards = 1;                  //Bloom XSet: workers insert into private shards OR-merged at the end (0 = serial inserts)
+string redis_host = "127.0.0.1";           //TSet store (ignored when redis_unix_socket is set)
+int redis_port = 6379;
+string redis_unix_socket = "";              //Connect over this Unix socket instead of TCP when non-empty
+size_t redis_pool_size = 8;                 //Pooled connections shared by all TSet requests
+unsigned int tset_format = TSET_FORMAT_BINARY;  //TSet entry encoding in Redis: TSET_FORMAT_BINARY or TSET_FORMAT_HEX (setup and search must agree)
+unsigned int tset_layout = TSET_LAYOUT_ENTRY;   //TSET_LAYOUT_ENTRY: one key per id. TSET_LAYOUT_CHUNKED: tset_chunk_ids records per key
+unsigned int tset_chunk_ids = 64;           //Records per chunk (1..TSET_CHUNK_MAX_IDS)
+unsigned int tset_store = TSET_STORE_REDIS; //TSet backend: TSET_STORE_REDIS or TSET_STORE_FILE (mmap'd hash file, binary format only)
+string tset_store_file = "tset.dat";
+vector<string> tset_shard_endpoints = {"127.0.0.1:6379"};   //TSET_STORE_SHARDED: "host:port" or "unix:/path" per shard; order fixes the ring
+TSetStore TSTORE;
+size_t tset_write_batch = 1024;             //TSet entries per Redis pipeline
+unsigned int tset_write_inflight = 4;       //Pipelines outstanding at once during TSet setup
 
 
 
@@ -490,6 +244,11 @@ const char* KX1 = reinterpret_cast<const char *> (KX);
 const char* KR1 = reinterpret_cast<const char *> (KR);
 const char* KT1 = reinterpret_cast<const char *> (KT);
 
+//Client key store: Falcon key pair, expanded key and the symmetric keys above
+string keystore_file = "client_keys.dat";
+unsigned char keygen_seed[16] = {0x56,0x37,0xca,0x94,0xd5,0xe0,0xad,0x62,0x73,0x7c,0xba,0x48,0x8d,0x2d,0x4d,0xde};
+KeyStore KEYS;
+
 
 
 
@@ -521,15 +280,38 @@ sw::redis::ConnectionPoolOptions pool_options;
 int Sys_Init()
 {
     
-    connection_options.host = "127.0.0.1";  
-    BloomFilter_Init(BF);
+    if((tset_store == TSET_STORE_FILE) && (tset_format != TSET_FORMAT_BINARY)){
+        std::cerr << "The TSet file backend stores binary keys only" << std::endl;
+        exit(1);
+    }
+    RedisPool_Options(connection_options, pool_options, redis_host, redis_port, redis_unix_socket, redis_pool_size);
+    if((RedisPool_Init(connection_options, pool_options) != 0)
+       || ((tset_store == TSET_STORE_SHARDED) && (RedisPool_InitShards(tset_shard_endpoints, connection_options, pool_options) != 0))){
+        exit(1);
+    }
+    MQ_Init();
+
+    //Load the client keys before anything derives from KS/KZ/KT
+    KeyStoreSymKeys sym_keys = {KS, KI, KZ, KX, KR, KT};
+    if(KeyStore_Open(KEYS, keystore_file, keygen_seed, sizeof(keygen_seed), sym_keys) != 0){
+        exit(1);
+    }
+
+    if((xtag_fp_coeffs == 0) || (xtag_fp_coeffs > N_l)){
+        std::cerr << "xtag_fp_coeffs must be in 1.." << N_l << std::endl;
+        exit(1);
+    }
+    XTAG_FP.version = XTAG_FP_VERSION;
+    XTAG_FP.n_coeffs = xtag_fp_coeffs;
 
     return 0;
 }
 
 int Sys_Clear()
 {
-    BloomFilter_Clean(BF);
+    XSet_Clean(XS);
+    KeyStore_Clean(KEYS);
+    RedisPool_Clean();
 
     return 0;
 }
@@ -809,39 +591,6 @@ mq_div_12289(uint32_t x, uint32_t y)
 
 
 
-/*
- * Compute NTT on a ring element.
- */
-static void
-mq_NTT(uint16_t *a, unsigned logn)
-{
-	size_t n, t, m;
-
-	n = (size_t)1 << logn;
-	t = n;
-	for (m = 1; m < n; m <<= 1) {
-		size_t ht, i, j1;
-
-		ht = t >> 1;
-		for (i = 0, j1 = 0; i < m; i ++, j1 += t) {
-			size_t j, j2;
-			uint32_t s;
-
-			s = GMb[m + i];
-			j2 = j1 + ht;
-			for (j = j1; j < j2; j ++) {
-				uint32_t u, v;
-
-				u = a[j];
-				v = mq_montymul(a[j + ht], s);
-				a[j] = (uint16_t)mq_add(u, v);
-				a[j + ht] = (uint16_t)mq_sub(u, v);
-			}
-		}
-		t = ht;
-	}
-}
-
 
 static void
 mq_NTT_large(uint32_t *a, unsigned logn)
@@ -874,62 +623,6 @@ mq_NTT_large(uint32_t *a, unsigned logn)
 }
 
 
-/*
- * Compute the inverse NTT on a ring element, binary case.
- */
-static void
-mq_iNTT(uint16_t *a, unsigned logn)
-{
-	size_t n, t, m;
-	uint32_t ni;
-
-	n = (size_t)1 << logn;
-	t = 1;
-	m = n;
-	while (m > 1) {
-		size_t hm, dt, i, j1;
-
-		hm = m >> 1;
-		dt = t << 1;
-		for (i = 0, j1 = 0; i < hm; i ++, j1 += dt) {
-			size_t j, j2;
-			uint32_t s;
-
-			j2 = j1 + t;
-			s = iGMb[hm + i];
-			for (j = j1; j < j2; j ++) {
-				uint32_t u, v, w;
-
-				u = a[j];
-				v = a[j + t];
-				a[j] = (uint16_t)mq_add(u, v);
-				w = mq_sub(u, v);
-				a[j + t] = (uint16_t)
-					mq_montymul(w, s);
-			}
-		}
-		t = dt;
-		m = hm;
-	}
-
-	/*
-	 * To complete the inverse NTT, we must now divide all values by
-	 * n (the vector size). We thus need the inverse of n, i.e. we
-	 * need to divide 1 by 2 logn times. But we also want it in
-	 * Montgomery representation, i.e. we also want to multiply it
-	 * by R = 2^16. In the common case, this should be a simple right
-	 * shift. The loop below is generic and works also in corner cases;
-	 * its computation time is negligible.
-	 */
-	ni = R1;
-	for (m = n; m > 1; m >>= 1) {
-		ni = mq_rshift1(ni);
-	}
-	for (m = 0; m < n; m ++) {
-		a[m] = (uint16_t)mq_montymul(a[m], ni);
-	}
-}
-
 
 static void
 mq_iNTT_large(uint32_t *a, unsigned logn)
@@ -984,20 +677,6 @@ mq_iNTT_large(uint32_t *a, unsigned logn)
 }
 
 
-/*
- * Convert a polynomial (mod q) to Montgomery representation.
- */
-static void
-mq_poly_tomonty(uint16_t *f, unsigned logn)
-{
-	size_t u, n;
-
-	n = (size_t)1 << logn;
-	for (u = 0; u < n; u ++) {
-		f[u] = (uint16_t)mq_montymul(f[u], R2);
-	}
-}
-
 static void
 mq_poly_tomonty_large(uint32_t *f, unsigned logn)
 {
@@ -1010,21 +689,6 @@ mq_poly_tomonty_large(uint32_t *f, unsigned logn)
 }
 
 
-/*
- * Multiply two polynomials together (NTT representation, and using
- * a Montgomery multiplication). Result f*g is written over f.
- */
-static void
-mq_poly_montymul_ntt(uint16_t *f, const uint16_t *g, unsigned logn)
-{
-	size_t u, n;
-
-	n = (size_t)1 << logn;
-	for (u = 0; u < n; u ++) {
-		f[u] = (uint16_t)mq_montymul(f[u], g[u]);
-	}
-}
-
 static void
 mq_poly_montymul_ntt_large(uint32_t *f, const uint32_t *g, unsigned logn)
 {
@@ -1051,14 +715,6 @@ mq_poly_sub(uint16_t *f, const uint16_t *g, unsigned logn)
 }
 
 
-// void
-// Zf(to_ntt_monty)(uint16_t *h, unsigned logn)
-// {
-// 	mq_NTT(h, logn);
-// 	mq_poly_tomonty(h, logn);
-// }
-
-
 
 void
 Zf(to_ntt_monty_large)(uint32_t *h, unsigned logn)
@@ -1094,23 +750,6 @@ uint64_t round(uint64_t x, uint32_t q_bits, uint32_t p_bits) {
 
 
 
-void reduce_mod_phi(ZZX& poly, const ZZ& modulus, int reduction_degree) {
-    long degree_poly = deg(poly);  // Degree of the polynomial
-    if (degree_poly < reduction_degree) return;  // No reduction needed
-
-    for (long i = reduction_degree; i <= degree_poly; ++i) {
-        ZZ coeff_i = coeff(poly, i);
-        if (coeff_i != 0) {  // Only process non-zero terms
-            ZZ lower_coeff = coeff(poly, i - reduction_degree);
-            ZZ new_lower_coeff = (lower_coeff + coeff_i) % modulus;
-            SetCoeff(poly, i - reduction_degree, new_lower_coeff);  // Update lower degree
-            SetCoeff(poly, i, ZZ(0));  // Zero out higher degree
-        }
-    }
-
-    poly.normalize();  // Ensure no trailing zeros
-}
-
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -1184,7 +823,9 @@ int TSet_SetUp()
     N_words = (N_max_ids/N_threads) + ((N_max_ids%N_threads==0)?0:1);
     N_max_id_words = N_words * N_threads;
 
-    auto redis = Redis("tcp://127.0.0.1:6379");
+    if(TSetStore_OpenWrite(TSTORE, tset_store, tset_store_file, tset_write_batch, tset_write_inflight) != 0){
+        return -1;
+    }
     
     int datasize = (2*N_l) + 16;
 
@@ -1255,6 +896,9 @@ int TSet_SetUp()
     std::string db_in_key = "";
     std::string db_in_val = "";
 
+    int chunk_ids = (int)std::min(std::max(tset_chunk_ids, 1u), (unsigned int)TSET_CHUNK_MAX_IDS);
+    std::vector<unsigned char> TCHUNK(TSET_CHUNK_HEADER_BYTES + (size_t)chunk_ids*datasize);
+
     for(int n=0;n<n_rows;++n){
 
         ::memset(W,0x00,16*N_max_id_words);
@@ -1352,6 +996,30 @@ int TSet_SetUp()
 
         tw_local = TW;
         
+        if(tset_layout == TSET_LAYOUT_CHUNKED){
+            //Chunk c takes the label id c would get, so a keyword needs only n_chunks labels
+            int n_chunks = (n_row_ids + chunk_ids - 1)/chunk_ids;
+            for(int c=0;c<n_chunks;++c){
+                unsigned int n_chunk_ids = std::min(chunk_ids, n_row_ids - c*chunk_ids);
+                size_t n_bytes = TSetChunk_Pack(TCHUNK.data(), (c==(n_chunks-1)), TW+(size_t)datasize*c*chunk_ids, n_chunk_ids, datasize);
+
+                ::memcpy(TBIDX,(hashout+(64*c)),2);
+                ::memcpy(TLBL,(hashout+(64*c)+2),12);
+
+                freeb_idx = (TBIDX[1] << 8) + TBIDX[0];
+
+                bidx = (FreeB[freeb_idx]++);
+                TJIDX[0] =  bidx & 0xFF;
+                TJIDX[1] =  (bidx >> 8) & 0xFF;
+
+                TSetFormat_Key(tset_format, TBIDX, TJIDX, TLBL, db_in_key);
+                TSetFormat_Value(tset_format, TCHUNK.data(), n_bytes, db_in_val);
+                TSetStore_Put(TSTORE, db_in_key, db_in_val);
+
+                total_count += n_chunk_ids;
+            }
+            continue;
+        }
 
         for(int i=0;i<n_row_ids;++i){
             ::memcpy(TVAL+1,tw_local,datasize);
@@ -1376,9 +1044,9 @@ int TSet_SetUp()
             
             db_in_key.clear();
             db_in_val.clear();
-            db_in_key = HexToStr(TBIDX,2) + HexToStr(TJIDX,2) + HexToStr(TLBL,12);
-            db_in_val = HexToStr(TVAL,datasize+1);
-            redis.set(db_in_key.data(), db_in_val.data());
+            TSetFormat_Key(tset_format, TBIDX, TJIDX, TLBL, db_in_key);
+            TSetFormat_Value(tset_format, TVAL, datasize+1, db_in_val);
+            TSetStore_Put(TSTORE, db_in_key, db_in_val);
 
             tw_local += datasize;
             total_count++;
@@ -1386,7 +1054,10 @@ int TSet_SetUp()
     
     }
  
+    int write_status = TSetStore_Finish(TSTORE, tset_format, tset_layout, chunk_ids);
     std::cout << "Total ID Count: " << total_count << std::endl;
+    std::cout << "TSet writes (" << TSetStore_Name(tset_store) << "): " << TSTORE.n_written << " stored, " << TSTORE.n_failed << " failed" << std::endl;
+    TSetStore_Clean(TSTORE);
 
     delete [] TW;
     delete [] W;
@@ -1398,7 +1069,7 @@ int TSet_SetUp()
 
     delete [] FreeB;
 
-    return 0;
+    return write_status;
 }
 
 
@@ -1472,620 +1143,490 @@ int32_t mod_inverse(uint32_t value, uint32_t mod) {
 
 
 
-int main()   
+int Trapdoor_Compute(unsigned char *id, const fpr *expanded_key, const uint64_t *h_poly, int16_t *sig, uint8_t *tt_sign, TrapdoorEntry *entry)
 {
-    unsigned char *W;
-    unsigned char *ID;
-    uint16_t *XID;        
-
-    unsigned char *KE_temp;
-    unsigned char *KE;
-    unsigned char *EC;
-    
-    unsigned char *WC;
-    unsigned char *YID_char;
-
-
-	uint64_t *XTAG; 
-	uint64_t *XTAG_check;
-	uint64_t *XTOKEN;   
-    
-	unsigned char *bhash;
-
-    uint16_t *YID;
+    TEMPALLOC union {
+        uint16_t hm_xid[512];
+    } r_xid;
+    TEMPALLOC inner_shake256_context sc_xid;
 
+    inner_shake256_init(&sc_xid);
+    inner_shake256_inject(&sc_xid, id, 16);
+    inner_shake256_flip(&sc_xid);
+    Zf(hash_to_point_vartime)(&sc_xid, r_xid.hm_xid, 9);
 
-    ///////////////////////////////////////////////////////////////////
-    
-    W = new unsigned char[16];                                              //Holds the keyword 16B
-    ID = new unsigned char[N_max_id_words*16];                              //Maximum number of IDs in a row 16B
-    KE = new unsigned char[EVP_MAX_BLOCK_LENGTH];                           //ID encryption key 32B
-    KE_temp = new unsigned char[16];                                        //ID encryption key 16B
-    WC = new unsigned char[N_max_id_words*16];                              //IDs with counter value (for computing randomness R) 
-    EC = new unsigned char[N_max_id_words*16];                              //Encrypted IDs
-    bhash = new unsigned char[bhash_block_size];
-    
-   
-	XTAG = new uint64_t[N_max_id_words*N_l];
-	XTAG_check = new uint64_t[N_max_id_words*N_l];
-	XTOKEN = new uint64_t[N_max_id_words*N_l];
-
-    XID = new uint16_t[N_max_id_words*N_l];
-    YID_char = new unsigned char[N_max_id_words*N_l*2];                        
-    YID = new uint16_t [N_max_id_words*N_l];                                 //YID = n x 1 vector (short vector) for every (W-ID) pair    
-    
-    ///////////////////////////////////////////////////////////////////////////////////////////////////
-    
-   
-    ifstream rawdb_file_handle;
-    rawdb_file_handle.open(rawdb_file,ios_base::in|ios_base::binary);
-
-    ofstream eidxdb_file_handle;
-    eidxdb_file_handle.open(eidxdb_file,ios_base::out|ios_base::binary);
+    // Signature Computation
+    Zf(sign_tree)(sig, &sc_xid, expanded_key, r_xid.hm_xid, 9, tt_sign);
 
+    uint64_t s_poly[512];
+    ::memcpy(entry->s2, sig, N_l*sizeof(int16_t));
 
-    stringstream ss;
+    // xid = s2.h mod (q, x^N_l + 1)
+    PolyRing_FromInt16(s_poly, entry->s2, q_l_bits);
+    PolyRing_Mul(entry->xid, s_poly, h_poly, q_l_bits);
 
-    string rawdb_row;
-    vector<string> rawdb_data;
-    string rawdb_row_current;
-    string s;
+    return 0;
+}
 
-    
-    
-    //Bloom Filter Parameters
-    unsigned int bfidx = 0;
-    unsigned int bf_indices[N_HASH];
-    unsigned int indices[N_HASH];
 
-   
 
-    ::memset(W,0x00,16);
-    ::memset(ID,0x00,N_max_id_words*16);
-    ::memset(KE,0x00,EVP_MAX_BLOCK_LENGTH);
-    ::memset(KE_temp,0x00,16);
-	
 
-	::memset(XTAG,0x00,N_max_id_words*N_l);
-	::memset(XTAG_check,0x00,N_max_id_words*N_l);
-	::memset(XTOKEN,0x00,N_max_id_words*N_l);
+int SetupWorker_Init(SetupWorker &wk)
+{
+    wk.tt_sign = (uint8_t *)xmalloc(FALCON_SIGN_TREE_TEMP_9);
+    wk.sig = (int16_t *)xmalloc(N_l * sizeof(int16_t));
+    blake3_hasher_init(&wk.hasher);
 
+    //Reentrant replacement for srand/rand; glibc's rand() is random() on this state
+    ::memset(&wk.rng,0x00,sizeof(wk.rng));
+    initstate_r(1, wk.rng_state, sizeof(wk.rng_state), &wk.rng);
 
-    ::memset(XID,0x00,N_max_id_words*N_l);
-    ::memset(WC,0x00,N_max_id_words*16);
-    ::memset(EC,0x00,N_max_id_words*16);
-    ::memset(bhash,0x00,bhash_block_size);
+    //XS must be sized before workers are created
+    wk.xs_sharded = xset_build_shards && (XSet_InitShard(wk.xs_shard, XS) == 0);
 
-    ::memset(YID_char,0x00,N_max_id_words*2*N_l);
-    ::memset(YID,0x00,N_max_id_words*N_l);
-    
+    return 0;
+}
 
-    ///////////////////////////////////////////////////////////
-    
-    unsigned char *w_local = W;
-    unsigned char *id_local = ID;
-    unsigned char *ke_local = KE;
-    unsigned char *ke_temp_local = KE_temp;
-    
+int SetupWorker_Clean(SetupWorker &wk)
+{
+    free(wk.tt_sign);
+    free(wk.sig);
+    XSet_Clean(wk.xs_shard);
+    return 0;
+}
 
-	uint64_t *xtag_local = XTAG;
-	uint64_t *xtag_local_check = XTAG_check;
-	uint64_t *xtoken_local = XTOKEN;
 
-    int16_t *xid_local = XID;
-    
+int Setup_DeriveKE(unsigned char *W, unsigned char *KE)
+{
+    unsigned char KE_temp[16];
 
-    unsigned char *wc_local = WC;
-    unsigned char *ec_local = EC;
-    unsigned char *yid_char_local = YID_char;
+    //Generate KE from W and KS
+    /* Since each W is 8B output of AES-256 is 16B and KE needs to be 32B to be used as a key, thus we run the loop
+    four times to generate a block of 8B four times and concatenate in KE to form a block of 32B */                            
 
-    uint16_t *yid_local = YID;
-   
-    unsigned char *local_s;
-    int n_rows = 0;
-    int n_row_ids = 0;
+    ::memset(KE,0x00,EVP_MAX_BLOCK_LENGTH+1);
+    for(int i=0; i<4;i++) {
 
+        ::memset(KE_temp,0x00,16);
 
-    Sys_Init();
+        if(!PKCS5_PBKDF2_HMAC_SHA1(KS, strlen(KS),NULL,0,1000,32,KS1))
+        {
+            printf("Error in key generation\n");
+            exit(1);
+        }
 
+        ke = encrypt(W, 8, aad, sizeof(aad), KS1, iv_ks, KE_temp, tag_ks);       
 
-    rawdb_row.clear();
-    while(getline(rawdb_file_handle,rawdb_row)){
-        rawdb_data.push_back(rawdb_row);
-        rawdb_row.clear();
-        n_rows++;
+        ::memcpy(KE+(8*i),KE_temp,0x08);
     }
 
-    cout << "Number of Keywords: " << n_rows << endl;
-
-    rawdb_file_handle.close();
+    //AES key for the ids
+    const char* KE1 = reinterpret_cast<const char *> (KE);
+    if(!PKCS5_PBKDF2_HMAC_SHA1(KE, strlen(KE),NULL,0,1000,32,KE1))
+    {
+        printf("Error in key generation\n");
+        exit(1);
+    } 
 
-    auto start_time = std::chrono::high_resolution_clock::now();
+    return 0;
+}
 
 
-    //  Key Generation  //
-    unsigned char seed[16] = {0x56,0x37,0xca,0x94,0xd5,0xe0,0xad,0x62,0x73,0x7c,0xba,0x48,0x8d,0x2d,0x4d,0xde};
-    size_t n_keygen;
-    size_t tlen_keygen = 90112;
-    size_t tlen_sign = 178176;
-    unsigned logn_keygen = 9;
-    int8_t *f, *g, *F, *G;
-    uint16_t *h, *hm, *h2, *hm2, *h_mont;
-    int16_t *sig_keygen, *s1_keygen;
-    uint8_t *tt_keygen, *tt_sign, *temp_sign;
-    inner_shake256_context sc_keygen;
-    fpr *expanded_key;             
+int Mask_Derive(SetupWorker &wk, unsigned char *W, int16_t *mask_out, int16_t *inv_mask_out)
+{
+	// Generate random mask for each keyword
+	int c = 0;
+	unsigned char r[16];
+	int32_t rnd;
 
-    
+	int kr = encrypt(W, 8, aad, sizeof(aad), KZ1, iv_kz, r, wk.tag);
+	
+	int32_t temp;
+	memcpy(&temp, r, sizeof(uint32_t));
 
-    inner_shake256_init(&sc_keygen);
-    inner_shake256_inject(&sc_keygen, seed, sizeof(seed));
-    inner_shake256_flip(&sc_keygen);
-    
+	srandom_r(temp, &wk.rng);
+	random_r(&wk.rng, &rnd);
+	int16_t mask = (rnd%p_l);
 
-    temp_sign = xmalloc(tlen_sign);
-    h_mont = (uint16_t *)temp_sign;
-    n_keygen = (size_t)1 << logn_keygen;
-
-    f = xmalloc(tlen_keygen);
-    g = f + n_keygen;
-    F = g + n_keygen;
-    G = F + n_keygen;
-    h = (uint16_t *)(G + n_keygen);
-    h2 = h + n_keygen;
-    hm = h2 + n_keygen;
-    sig_keygen = (int16_t *)(hm + n_keygen);
-    s1_keygen = sig_keygen + n_keygen;
-    tt_keygen = (uint8_t *)(s1_keygen + n_keygen);
-    tt_sign = (uint8_t *)(s1_keygen + n_keygen);
-    if (logn_keygen == 1) {
-        tt_keygen += 4;
-        tt_sign += 4;
-    }
-    for (int i = 0; i < 12; i ++) {
-        Zf(keygen)(&sc_keygen, f, g, F, G, h, logn_keygen, tt_keygen);
-    }
-    
+	int32_t x, y;
+	int32_t gcd = extended_gcd(mask, p_l, x, y);
+	if (gcd != 1) {
+		mask += 1;
+	}
 
-    //Public key h in NTT-Montgomery Form
-    ::memcpy(h_mont, h, n_keygen * sizeof *h_mont);
+	int16_t inv_mask = mod_inverse(mask,p_l);
 
-	int16_t h_temp[512];
-	for(int i=0; i<512;i++)
-	{
-		h_temp[i] = h_mont[i];
+	if((mask * inv_mask)%p_l == 1){
+		c++;
 	}
-    
-    //Expanded private key for NTT operations
-    expanded_key = (fpr *)tt_sign;
-    tt_sign = (uint8_t *)expanded_key + (8 * logn_keygen + 40) * n_keygen;
-    Zf(expand_privkey)(expanded_key, f, g, F, G, logn_keygen, tt_sign);
+	
+	else{
+		
+		random_r(&wk.rng, &rnd);
+		mask = (rnd%p_l);
 
+		int32_t x, y;
+		int32_t gcd = extended_gcd(mask, p_l, x, y);
 		
-    
-    for(unsigned int n1=0; n1<n_rows; ++n1) 
-    {
-        
-        ::memset(ID,0x00,N_max_id_words*16);
-        ::memset(KE,0x00,EVP_MAX_BLOCK_LENGTH);
-        ::memset(KE_temp,0x00,16);
-        ::memset(EC,0x00,N_max_id_words*16);
+		if (gcd != 1) {
+			mask += 1;
+		}
 
-        
-        rawdb_row_current = rawdb_data.at(n1);
+		inv_mask = mod_inverse(mask,p_l);
+		if((mask * inv_mask)%p_l == 1){
+			c++;		
+		}
+	}
 
-        ss.str(std::string());
-        ss << rawdb_row_current;
-        std::getline(ss,s,',');             			
+	*mask_out = mask;
+	*inv_mask_out = inv_mask;
 
+	return 0;
+}
 
-        
-        DB_StrToHex8(W,s.data());           			
-        id_local = ID;
 
-        n_row_ids = 0;                                 
-        while(std::getline(ss,s,',') && !ss.eof()) {
-            if(!s.empty()){
-                DB_StrToHex8(id_local,s.data());        
-                
-                id_local += 16;
-                n_row_ids++;
-            }
-        }
-        ss.clear();
-        ss.seekg(0);
+int Setup_Keyword(SetupWorker &wk, SetupKeyword &kw, const uint64_t *h_poly)
+{
+    //Generate random polynomial wrt XW from Falcon specifications
+    TEMPALLOC union {
+        uint16_t hm_xw[512];
+    } r_xw;
+    TEMPALLOC inner_shake256_context sc_xw;
+
+    inner_shake256_init(&sc_xw); 		    
+    inner_shake256_inject(&sc_xw,kw.W, 16);	
+    inner_shake256_flip(&sc_xw);
+    Zf(hash_to_point_vartime)(&sc_xw, r_xw.hm_xw, 9);
+
+    for(int i=0; i<512; i++){
+        kw.xw[i] = (r_xw.hm_xw[i] << 14) % q_l;
+    }
 
-        id_local = ID;              //Set local id pointer to the beginning of the array
+    //xtoken = h.xw only depends on the keyword
+    PolyRing_Mul(kw.xtoken, h_poly, kw.xw, q_l_bits);
+    PolyRing_Round(kw.xtoken_round, kw.xtoken, q_l_bits, p_l_dash_bits);
 
-        
-       
-        //Generate KE from W and KS
-        /* Since each W is 8B output of AES-256 is 16B and KE needs to be 32B to be used as a key, thus we run the loop
-        four times to generate a block of 8B four times and concatenate in KE to form a block of 32B */                            
-        
-        for(int i=0; i<4;i++) {
+    Mask_Derive(wk, kw.W, &kw.mask, &kw.inv_mask);
 
-            ::memset(KE_temp,0x00,16);
+    return 0;
+}
 
-            if(!PKCS5_PBKDF2_HMAC_SHA1(KS, strlen(KS),NULL,0,1000,32,KS1))
-            {
-                printf("Error in key generation\n");
-                exit(1);
-            }
 
-            w_local = W;
-            ke_temp_local = KE_temp;
-            ke = encrypt(w_local, sizeof(w_local)/sizeof(w_local[0]), aad, sizeof(aad), KS1, iv_ks, ke_temp_local, tag_ks);       
-            w_local = W;
-            ke_temp_local = KE_temp;
+int Setup_Pair(SetupWorker &wk, SetupKeyword &kw, SetupPair &pr, SetupPairOut &out)
+{
+	const int16_t *tt_s2 = pr.td->s2;
+	const uint64_t *xid_poly = pr.td->xid;
+	uint64_t s_poly[512], xtag_poly[512], lhs_poly[512], xtag_round[512];
 
-            ::memcpy(KE+(8*i),KE_temp,0x08);
+	PolyRing_FromInt16(s_poly, tt_s2, q_l_bits);
 
-        }       
 
-        //Generate random polynomial wrt XW from Falcon specifications
-        TEMPALLOC union {
-            uint16_t hm_xw[512];
-        } r_xw;
-        TEMPALLOC inner_shake256_context sc_xw;
+    //yid = (s2 * inv_mask) % p_l, coefficient-wise
+    MQ_PolyMulScalar(reinterpret_cast<int16_t *>(out.yid), tt_s2, kw.inv_mask, N_l);
 
-        inner_shake256_init(&sc_xw); 		    
-        inner_shake256_inject(&sc_xw,W, 16);	
-        inner_shake256_flip(&sc_xw);
-        Zf(hash_to_point_vartime)(&sc_xw, r_xw.hm_xw, 9);
 
+	/*  (s2.h.xw) mod q = LHS of SIS equation mod q --> should be equal to (xid . xw) mod q  */
+	/*  Only the coefficients that feed the XSet fingerprint are computed and checked  */
 
-		
-		uint64_t xw[512];
-        size_t n_xw = (size_t)1 << 9;
+	unsigned int n_fp = XTAG_FP.n_coeffs;
+
+	PolyRing_MulPartial(lhs_poly, s_poly, kw.xtoken, q_l_bits, n_fp);
+	PolyRing_MulPartial(xtag_poly, xid_poly, kw.xw, q_l_bits, n_fp);
 
-        for(int i=0; i<512; i++){
-            xw[i] = (r_xw.hm_xw[i] << 14) % q_l;
+	//Runs inside the parallel pair loop: flag the pair and let main abort once the loop is done
+	out.eq_failed = false;
+	for(unsigned int i = 0; i < n_fp; i++){
+		if(lhs_poly[i] != xtag_poly[i]){
+			#pragma omp critical(setup_log)
+			{
+				cout << "Problem is equation mod q\n";
+				cout << i << " " << lhs_poly[i] << " " << xtag_poly[i] << endl;
+			}
+			out.eq_failed = true;
+			return -1;
 		}
+	}
 
-        
-    
-		
-		xid_local = XID;
-        yid_local = YID;
-        id_local = ID;
-        xtag_local = XTAG;
-		xtoken_local = XTOKEN;
-		xtag_local_check = XTAG_check;
-        for(unsigned int nword=0; nword<n_row_ids; nword++)
-        {
 
-            unsigned char array_xid[16];
-            inner_shake256_context sc_xid1;
-            size_t tlen_xid1 = 90112;
-            int32_t *f_xid1 = xmalloc(tlen_xid1);
-            int8_t logn_xid1 = 9;
-            size_t n_xid1 = (size_t)1 << logn_xid1;
-            uint16_t *hm_xid  = (uint16_t *) (f_xid1 +6*n_xid1);
-            uint32_t *hm_xid_check = f_xid1 +6*n_xid1;
+	// Check rounded version
 
+	PolyRing_Round(xtag_round, xtag_poly, q_l_bits, p_bits, n_fp);
 
-			// Generate random mask for each keyword-doc pair
-			w_local = W;
-			int c = 0;
-			unsigned char r[16];
-		
-			int kr = encrypt(w_local, sizeof(w_local)/sizeof(w_local[0]), aad, sizeof(aad), KZ1, iv_kz, r, tag_kz);
-			
-			
-			int32_t temp = r;
-			memcpy(&temp, r, sizeof(uint32_t));
-		
-			srand(temp);
-			int16_t mask = (rand()%p_l);
+	PolyRing_FromInt16(s_poly, tt_s2, p_l_dash_bits);
+	PolyRing_MulPartial(lhs_poly, s_poly, kw.xtoken_round, p_l_dash_bits, n_fp);
+	PolyRing_Round(lhs_poly, lhs_poly, p_l_dash_bits, p_bits, n_fp);
 
-			int32_t x, y;
-			int32_t gcd = extended_gcd(mask, p_l, x, y);
-			if (gcd != 1) {
-				mask += 1;
+	for(unsigned int i = 0; i < n_fp; i++){
+		if(lhs_poly[i] != xtag_round[i]){
+			#pragma omp critical(setup_log)
+			{
+				cout << "Problem with double rounding \n";
+				cout << i << " " << lhs_poly[i] << " " << xtag_round[i] << endl;
 			}
+		}
+	}
 
-			int16_t inv_mask = mod_inverse(mask,p_l);
 
-			if((mask * inv_mask)%p_l == 1){
-				c++;
-			}
-			
-			else{
-				
-				mask = (rand()%p_l);
-
-				int32_t x, y;
-				int32_t gcd = extended_gcd(mask, p_l, x, y);
-				
-				if (gcd != 1) {
-					mask += 1;
-				}
-
-				inv_mask = mod_inverse(mask,p_l);
-				if((mask * inv_mask)%p_l == 1){
-					c++;		
-				}
-			}
-			
+    //AES Encryption of id using KE
+    encrypt(pr.id, 8, aad, sizeof(aad), kw.KE, iv_ec, out.ec, wk.tag);
 
-            std::memcpy(array_xid,id_local,16);
-            inner_shake256_init(&sc_xid1); 		                            
-            inner_shake256_inject(&sc_xid1, id_local, 16);	
-            inner_shake256_flip(&sc_xid1);
-            Zf(hash_to_point_vartime)(&sc_xid1, hm_xid, logn_xid1);
-            
-            
-            // Signature Computation
-            Zf(sign_tree)(sig_keygen, &sc_xid1, expanded_key, hm_xid, logn_keygen, tt_sign);  
-
-			
-            int16_t tt_s1[512];
-			int16_t tt_s1_temp[512];
-			int16_t tt_s2[512];
-            int16_t tt_s2_temp[512]; 
-			int16_t s2h[512]; 
-			int16_t tt_xid[512]; 
-			int16_t xid_temp[512];
 
-        
-            for (int u = 0; u < 512; u ++) {
-				tt_s1[u] = sig_keygen[u];			//store s1
-				tt_s2[u] = sig_keygen[u];			//store s2
-				tt_xid[u] = hm_xid[u]; 				//store xid'
-            }
-			
-	
-			ZZ q = power2_ZZ(45);
+    //XSet entry for the rounded xtag
+    XSet_XTagIndices(XS, &wk.hasher, xtag_round, out.bf_indices);
+    out.xs_failed = wk.xs_sharded && (XSet_Add(wk.xs_shard, out.bf_indices) != 0);
+    if(xset_telemetry){
+        XTagFP_Digest(&wk.hasher, xtag_round, &out.exact);
+    }
 
-			ZZX tt_s1_NTL, tt_s1_temp_NTL, tt_s2_NTL, yid_NTL, tt_xid_NTL, xid_NTL, h_temp_NTL, s2h_NTL;
+    return 0;
+}
 
-			for(int i=0; i<512; i++){ 
-				SetCoeff(h_temp_NTL, i, ZZ(h_temp[i]));
-				SetCoeff(tt_s1_temp_NTL, i, ZZ(sig_keygen[i]));
-				SetCoeff(tt_s2_NTL, i, ZZ(sig_keygen[i]));
-				SetCoeff(yid_NTL, i, ZZ(sig_keygen[i]));
-				SetCoeff(tt_xid_NTL, i, ZZ(hm_xid[i]));
-			}
 
-		
-			s2h_NTL = tt_s1_temp_NTL * h_temp_NTL;
 
-			for(int i=0; i<=deg(s2h_NTL); i++){ 
-				int64_t x = conv<int64_t>((coeff(s2h_NTL, i)));
-				x = (x % q_l + q_l) % q_l;
-				SetCoeff(s2h_NTL, i, conv<ZZ>(x));
-			}
-			reduce_mod_phi(s2h_NTL, q, N_l); 		
-			
 
-			tt_s1_NTL = s2h_NTL - tt_xid_NTL;
+int main()   
+{
+    stringstream ss;
 
-			xid_NTL = tt_s1_NTL + tt_xid_NTL;
+    string rawdb_row;
+    vector<string> rawdb_data;
+    string rawdb_row_current;
+    string s;
 
+    int n_rows = 0;
 
-            for(int i = 0; i < 512; i++){
-                tt_s2_temp[i] = tt_s2[i];
-                yid_local[i] = (tt_s2[i] * inv_mask) % p_l;		
-	     	}
+   
+    ifstream rawdb_file_handle;
+    rawdb_file_handle.open(rawdb_file,ios_base::in|ios_base::binary);
 
+    ofstream eidxdb_file_handle;
+    eidxdb_file_handle.open(eidxdb_file,ios_base::out|ios_base::binary);
 
-		
-            for(int u=0; u<512; u++) {
-				xid_temp[u] = conv<int64_t>((coeff(xid_NTL, u)));
-				xid_local[u] = xid_temp[u] % p_l;					
-            }
 
+    Sys_Init();
 
-			/*  (s2.h.xw) mod q = LHS of SIS equation mod q --> should be equal to (xid . xw) mod q  */
-			
-			ZZ p1 = power2_ZZ(40);
-		
 
-			ZZX xw_NTL, temp_xid, LHS_q_NTLL;
-			ZZX lhs_final, rhs_final, xtag, xtoken;
+    rawdb_row.clear();
+    while(getline(rawdb_file_handle,rawdb_row)){
+        rawdb_data.push_back(rawdb_row);
+        rawdb_row.clear();
+        n_rows++;
+    }
 
-			for(int i=0; i<512; i++){ 
-				SetCoeff(xw_NTL, i, ZZ(xw[i]));
-			}
+    cout << "Number of Keywords: " << n_rows << endl;
 
-			
-			for (long i = 0; i <=deg(xid_NTL); i++) {
-				NTL::ZZ coeff = NTL::coeff(xid_NTL, i);
-				coeff = (coeff % q + q) % q;
-				NTL::SetCoeff(xid_NTL, i, coeff);
-			}
 
-			reduce_mod_phi(xid_NTL, q, N_l);
-			reduce_mod_phi(xw_NTL, q, N_l);	
+    //Size the XSet for one element per (keyword, id) pair; rows are "W,id,...,id,"
+    uint64_t n_xtags = 0;
+    for(const auto &row:rawdb_data){
+        size_t n_commas = std::count(row.begin(), row.end(), ',');
+        n_xtags += (n_commas > 0) ? (n_commas - 1) : 0;
+    }
 
-			xtoken = h_temp_NTL * xw_NTL;
-			for(long i=0; i<=deg(xtoken); i++){ 
-				NTL::ZZ coeff = NTL::coeff(xtoken, i);
-				coeff = (coeff % q + q) % q; 
-				NTL::SetCoeff(xtoken, i, coeff);
-			}
-			reduce_mod_phi(xtoken, q, N_l);
-
-			
-			lhs_final = yid_NTL * xtoken;
-			for(long i=0; i<=deg(lhs_final); i++){ 
-				NTL::ZZ coeff = NTL::coeff(lhs_final, i);
-				coeff = (coeff % q + q) % q; 
-				NTL::SetCoeff(lhs_final, i, coeff);
-			}
-			reduce_mod_phi(lhs_final, q, N_l);
+    if(XSet_Init(XS, xset_type, n_xtags, bf_target_fpr, bf_n_hash, bf_layout) != 0){
+        std::cerr << "bf_target_fpr must be in (0, 1)" << std::endl;
+        exit(1);
+    }
 
-			
-		
-			xtag = xid_NTL * xw_NTL;
-			for(long i=0; i<=deg(xtag); i++){ 
-				NTL::ZZ coeff = NTL::coeff(xtag, i);
-				coeff = (coeff % q + q) % q; 
-				NTL::SetCoeff(xtag, i, coeff);
-			}
-			reduce_mod_phi(xtag, q, N_l);
+    cout << "XSet filter (" << XSet_Name(XS.type) << "): " << XSet_Bytes(XS) << " bytes, "
+         << n_xtags << " xtags, " << 8.0*XSet_Bytes(XS)/std::max<uint64_t>(n_xtags,1) << " bits/xtag, expected FPR " << XSet_FPR(XS) << endl;
+    if(XS.type == XSET_BLOOM){
+        cout << "  k = " << XS.bf.n_hash << ", " << ((XS.bf.layout == BF_LAYOUT_BLOCKED) ? "512-bit blocks" : "partitioned") << endl;
+    }
 
-			rhs_final = xtag;
+    rawdb_file_handle.close();
 
-			lhs_final.normalize();
-			rhs_final.normalize();
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-			
-			for(int i = 0; i <= deg(rhs_final); i++){
-				if(lhs_final[i] != rhs_final[i]){
-					cout << "Problem is equation mod q\n";
-					exit(1);
-				}
-			}
 
-			
-			// Check rounded version
+    //  Client Keys  //
+    //Key pair and expanded private key come from the key store loaded in Sys_Init
+    const uint16_t *h = KEYS.data->h;
+    const fpr *expanded_key = KEYS.data->expanded_key;
 
-			for(int i = 0; i <= deg(xtag); i++){
-				xtag_local[i] = conv<int64_t>((coeff(xtag, i)) >> (45 - 5));
-				xtag_local[i] = xtag_local[i] % p;
-				SetCoeff(xtag, i, xtag_local[i]);
-			}
+	int16_t h_temp[512];
+	for(int i=0; i<512;i++)
+	{
+		h_temp[i] = h[i];
+	}
 
-			for(int i = 0; i <= deg(xtoken); i++){
-				xtoken_local[i] = conv<int64_t>((coeff(xtoken, i)) >> (45 - 40));
-				xtoken_local[i] = xtoken_local[i] % p_l_dash;
-				SetCoeff(xtoken, i, xtoken_local[i]);
-			}
+	uint64_t h_poly[512];
+	PolyRing_FromInt16(h_poly, h_temp, q_l_bits);
 
-			lhs_final = (yid_NTL * xtoken); 
-			for(int i=0; i<=deg(lhs_final); i++){ 
-				int64_t x = conv<int64_t>((coeff(lhs_final, i)));
-				x = x % p_l_dash;
-				SetCoeff(lhs_final, i, x);
-			}
-			reduce_mod_phi(lhs_final, p1, N_l);
+    if(TrapdoorCache_Init(TDC, h, trapdoor_journal_file) != 0){
+        exit(1);
+    }
 
+		
+    
+    //Per-thread Falcon scratch, hashing and AES tag buffers
+    int n_workers = (N_setup_threads > 0) ? N_setup_threads : omp_get_max_threads();
+    omp_set_num_threads(n_workers);
 
-			for(int i = 0; i <= deg(lhs_final); i++){
-				xtoken_local[i] = conv<int64_t>((coeff(lhs_final, i)));
-				xtoken_local[i] = xtoken_local[i] >> (40 - 5);
-				xtoken_local[i] = xtoken_local[i] % p;
-				SetCoeff(lhs_final, i, xtoken_local[i]);
-			}
-			rhs_final = xtag;
+    vector<SetupWorker> workers(n_workers);
+    for(auto &wk:workers){
+        SetupWorker_Init(wk);
+    }
 
-	
-			bool wrong_match = false;
-			for(int i = 0; i <= deg(lhs_final); i++){
-				if(lhs_final[i] != rhs_final[i]){
-						cout << "Problem with double rounding \n";
-						cout << i << " " << lhs_final[i] << " " << rhs_final[i] << endl;
-						wrong_match = true; 
-				}
-			}	
-			
-			
-
-            yid_local += N_l;
-            xid_local += N_l;
-            xtag_local += N_l;
-			xtoken_local += N_l;
-			xtag_local_check += N_l;
-            
-            
-            id_local += 16;
-			
-        
-        }
-        xid_local = XID;
-        yid_local = YID;
-        id_local = ID;
-        xtag_local = XTAG;
-		xtoken_local = XTOKEN;
-		xtag_local_check = XTAG_check;
+    bool xs_sharded = workers[0].xs_sharded;
+    vector<XTagDigest> exact_digests;
+    cout << "Setup workers: " << n_workers << (xs_sharded ? " (sharded XSet build)" : "") << endl;
 
-		
-        
-        //AES Encryption of id using KE
-        const char* KE1 = reinterpret_cast<const char *> (KE);
-        if(!PKCS5_PBKDF2_HMAC_SHA1(KE, strlen(KE),NULL,0,1000,32,KE1))
-        {
-            printf("Error in key generation\n");
-            exit(1);
-        } 
-        
-        id_local = ID;
-        ec_local = EC;
-        for(unsigned int nword=0; nword<n_row_ids; nword++)
-        {
-            kec = encrypt(id_local, sizeof(id_local)/sizeof(id_local[0]), aad, sizeof(aad), KE1, iv_ec, ec_local, tag_ec);
-            id_local += sym_block_size;
-            ec_local += 16;
-        }
-        id_local = ID;
-        ec_local = EC;
 
+    vector<SetupKeyword> kw_batch;
+    vector<SetupPair> pair_batch;
+    vector<SetupPairOut> out_batch;
+    vector<TrapdoorEntry> td_new;
+    vector<size_t> td_new_pair;
+    std::unordered_map<std::string, long> td_pending;
+    unsigned long total_pairs = 0;
 
+    int n1 = 0;
+    while(n1 < n_rows)
+    {
+        kw_batch.clear();
+        pair_batch.clear();
 
-        yid_local = YID;
-        yid_char_local = YID_char;
-        for(int n=0; n<n_row_ids; n++){   
-            for(int k=0; k<N_l; k++){
-                    yid_char_local[2*k] = static_cast<unsigned char>(yid_local[k] & 0xFF);          
-                    yid_char_local[2*k + 1] = static_cast<unsigned char>((yid_local[k] >> 8) & 0xFF); 
+        //Flatten a batch of keyword rows into (keyword, id) work items
+        while((n1 < n_rows) && (pair_batch.size() < setup_batch_pairs))
+        {
+            SetupKeyword kw = {};
+
+            rawdb_row_current = rawdb_data.at(n1);
+
+            ss.str(std::string());
+            ss << rawdb_row_current;
+            std::getline(ss,s,',');
+
+            DB_StrToHex8(kw.W,s.data());
+            kw.pair_begin = pair_batch.size();
+            kw.n_ids = 0;
+
+            while(std::getline(ss,s,',') && !ss.eof()) {
+                if(!s.empty()){
+                    SetupPair pr = {};
+                    DB_StrToHex8(pr.id,s.data());
+                    pr.kw = kw_batch.size();
+                    pr.td_new = -1;
+                    pair_batch.push_back(pr);
+                    kw.n_ids++;
+                }
             }
-            
-            yid_local += N_l;
-            yid_char_local += 2*N_l;
-        }
-        yid_local = YID;
-        yid_char_local = YID_char;
+            ss.clear();
+            ss.seekg(0);
 
+            //KS is re-derived in place on every call, so KE has to follow row order
+            Setup_DeriveKE(kw.W, kw.KE);
 
-        eidxdb_file_handle << DB_HexToStr8(W) << ",";            
-        for(int n_eidx=0;n_eidx < n_row_ids;++n_eidx){
-            eidxdb_file_handle << DB_HexToStr_N(YID_char+(2*N_l*n_eidx),2*N_l) << DB_HexToStr_N(EC+(16*n_eidx),16) + ",";
+            kw_batch.push_back(kw);
+            n1++;
         }
-       
-        eidxdb_file_handle << endl;
-        
-       
-        
-        xtag_local = XTAG;
-        for(int i=0;i<n_row_ids;++i)
-        {
 
-            ::memset(bhash,0x00,bhash_block_size);
-            ::memset(bf_indices,0x00,N_HASH);
 
-            unsigned char xtag_char[2*N_l];
-            ::memset(xtag_char,0x00,2*N_l);
+        //Per-keyword xw, xtoken and mask
+        #pragma omp parallel for schedule(dynamic,1)
+        for(size_t k=0;k<kw_batch.size();++k){
+            Setup_Keyword(workers[omp_get_thread_num()], kw_batch[k], h_poly);
+        }
 
 
-            unsigned char *xtag_char_local = xtag_char;
-            for(int k=0; k<N_l; k++){
-                
-                xtag_char[2*k] = static_cast<unsigned char>(xtag_local[k] & 0xFF);         
-                xtag_char[2*k + 1] = static_cast<unsigned char>((xtag_local[k] >> 8) & 0xFF);    
+        //Sign every id not yet in the trapdoor cache, once per distinct id
+        td_new.clear();
+        td_new_pair.clear();
+        td_pending.clear();
+        for(size_t i=0;i<pair_batch.size();++i){
+            SetupPair &pr = pair_batch[i];
+            if(TrapdoorCache_Lookup(TDC, pr.id, &pr.td) != 0){
+                auto res = td_pending.emplace(std::string(reinterpret_cast<char *>(pr.id),16), (long)td_new_pair.size());
+                if(res.second){
+                    td_new_pair.push_back(i);
+                }
+                pr.td_new = res.first->second;
             }
+        }
 
-            xtag_char_local = xtag_char;
+        td_new.resize(td_new_pair.size());
+        #pragma omp parallel for schedule(dynamic,1)
+        for(size_t m=0;m<td_new_pair.size();++m){
+            SetupWorker &wk = workers[omp_get_thread_num()];
+            Trapdoor_Compute(pair_batch[td_new_pair[m]].id, expanded_key, h_poly, wk.sig, wk.tt_sign, &td_new[m]);
+        }
 
+        for(size_t m=0;m<td_new_pair.size();++m){
+            TrapdoorCache_Insert(TDC, pair_batch[td_new_pair[m]].id, td_new[m], &(pair_batch[td_new_pair[m]].td));
+        }
+        for(auto &pr:pair_batch){
+            if(pr.td_new >= 0){
+                pr.td = pair_batch[td_new_pair[pr.td_new]].td;
+            }
+        }
 
-            BLOOM_HASH(xtag_char,bhash);
 
+        //(keyword, id) items are handed out dynamically so skewed keywords spread over all workers
+        out_batch.resize(pair_batch.size());
+        #pragma omp parallel for schedule(dynamic,16)
+        for(size_t i=0;i<pair_batch.size();++i){
+            SetupPair &pr = pair_batch[i];
+            Setup_Pair(workers[omp_get_thread_num()], kw_batch[pr.kw], pr, out_batch[i]);
+        }
+
+        for(size_t i=0;i<pair_batch.size();++i){
+            SetupPair &pr = pair_batch[i];
+            if(out_batch[i].eq_failed){
+                std::cerr << "SIS equation mod q failed for keyword " << DB_HexToStr8(kw_batch[pr.kw].W)
+                          << ", id " << DB_HexToStr8(pr.id) << std::endl;
+                exit(1);
+            }
+            if(out_batch[i].xs_failed){
+                std::cerr << "Cannot add the xtag of keyword " << DB_HexToStr8(kw_batch[pr.kw].W)
+                          << ", id " << DB_HexToStr8(pr.id) << " to the XSet shard" << std::endl;
+                exit(1);
+            }
+        }
 
-            for(int j=0;j<N_HASH;++j){
-                bf_indices[j] = BFIdxConv(bhash+(64*j),N_BF_BITS);
 
+        //Emit EDB rows and XSet entries in keyword order
+        for(auto &kw:kw_batch)
+        {
+            unsigned char yid_char[2*N_l];
+
+            eidxdb_file_handle << DB_HexToStr8(kw.W) << ",";
+            for(unsigned int n=0;n<kw.n_ids;++n){
+                SetupPairOut &out = out_batch[kw.pair_begin+n];
+
+                for(int k=0; k<N_l; k++){
+                    yid_char[2*k] = static_cast<unsigned char>(out.yid[k] & 0xFF);          
+                    yid_char[2*k + 1] = static_cast<unsigned char>((out.yid[k] >> 8) & 0xFF); 
+                }
+                eidxdb_file_handle << DB_HexToStr_N(yid_char,2*N_l) << DB_HexToStr_N(out.ec,16) + ",";
+
+                if(!xs_sharded && (XSet_Add(XS, out.bf_indices) != 0)){
+                    std::cerr << "XSet full after " << XS.n_keys << " of " << XS.n_items << " xtags (keyword " << DB_HexToStr8(kw.W)
+                              << "); the static backend was sized for fewer xtags than setup produced" << std::endl;
+                    exit(1);
+                }
+                if(xset_telemetry){
+                    exact_digests.push_back(out.exact);
+                }
             }
+            eidxdb_file_handle << endl;
+        }
 
-            BloomFilter_Set(BF, bf_indices);
+        total_pairs += pair_batch.size();
+    }
 
+    eidxdb_file_handle.close();
 
-            xtag_local += N_l;
+    if(xs_sharded){
+        vector<const XSet *> shards(n_workers);
+        for(int t=0;t<n_workers;++t){
+            shards[t] = &workers[t].xs_shard;
         }
-        
-        xtag_local = XTAG;
+        XSet_Merge(XS, shards.data(), n_workers);
+    }
 
-        
+    for(auto &wk:workers){
+        SetupWorker_Clean(wk);
     }
 
 
@@ -2093,15 +1634,40 @@ int main()
     
     cout << "TSet SetUp Starting!" << endl << endl;
 
-    TSet_SetUp();
+    if(TSet_SetUp() != 0){
+        std::cerr << "TSet setup left entries unwritten" << std::endl;
+        exit(1);
+    }
 
     
     cout << "TSet SetUp Done!" << endl;
 
+    //Fuse and cuckoo XSets are constructed here, so this stays inside the timed region
+    if(XSet_Build(XS) != 0){
+        exit(1);
+    }
+
     auto stop_time = chrono::high_resolution_clock::now();
 
-    std::cout << "Writing Bloom Filter to disk..." << std::endl;
-    BloomFilter_WriteBFtoFile(bloomfilter_file, BF); //Store bloom filter in file
+    std::cout << "Trapdoor cache: " << TDC.n_inserted << " IDs signed for " << total_pairs << " pairs" << std::endl;
+    TrapdoorCache_Clean(TDC);
+
+    if(XS.type == XSET_BLOOM){
+        std::cout << "XSet fill ratio " << BloomFilter_FillRatio(XS.bf) << ", fill-based FPR " << XSet_TermFPR(XS) << std::endl;
+    }
+
+    std::cout << "Writing XSet to disk..." << std::endl;
+    if(XSet_Write(bloomfilter_file, XS) != 0){ //Store XSet filter in file
+        std::cerr << "XSet was not written to " << bloomfilter_file << std::endl;
+        exit(1);
+    }
+    if(xset_telemetry){
+        if(XSetExact_Write(xset_exact_file, exact_digests) != 0){
+            std::cerr << "XSet exact side-set was not written to " << xset_exact_file << std::endl;
+            exit(1);
+        }
+        std::cout << "XSet exact side-set: " << exact_digests.size() << " distinct xtags" << std::endl;
+    }
 
 
     Sys_Clear();
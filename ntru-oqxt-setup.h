@@ -26,9 +26,8 @@
 #include <fcntl.h>
 #include <bits/stdc++.h>
 #include <stdio.h>
+#include <omp.h>
 
-#include <NTL/ZZX.h>
-#include <NTL/ZZ.h>
 
 
 
@@ -49,7 +48,15 @@
 
 #include "size_parameters.h"
 #include "rawdatautil.h"
-#include "bloom_filter.h"
+#include "xset.h"
+#include "xset_exact.h"
+#include "redis_pool.h"
+#include "tset_format.h"
+#include "tset_store.h"
+#include "poly_ring.h"
+#include "mq_ntt.h"
+#include "key_store.h"
+#include "trapdoor_cache.h"
 #include "utils.h"
 #include "AES_256GCM.h"
 #include "../../NTRU-OQXT/falcon-round3/Extra/c/falcon.h"
@@ -59,7 +66,6 @@ using namespace std;
 using namespace std::chrono;
 using namespace sw::redis;
 using namespace CryptoPP;
-using namespace NTL;
 
 extern sw::redis::ConnectionOptions connection_options;
 extern sw::redis::ConnectionPoolOptions pool_options;
@@ -86,6 +92,59 @@ int SHA3_HASH_K(blake3_hasher *hasher,unsigned char *msg, unsigned char *digest)
 
 unsigned int BFIdxConv(unsigned char *hex_arr, unsigned int n_bits);
 
+/*
+ * Setup engine. Keyword rows are flattened into (keyword, id) work items that
+ * workers pick up dynamically; each worker owns its Falcon signing scratch,
+ * BLAKE3 state, AES-GCM tag buffer and PRNG state.
+ */
+typedef struct {
+    uint8_t *tt_sign;                       //Falcon sign_tree scratch
+    int16_t *sig;
+    blake3_hasher hasher;
+    unsigned char tag[100];
+    struct random_data rng;
+    char rng_state[128];
+    XSet xs_shard;                          //Private XSet shard, merged after the last batch
+    bool xs_sharded;
+} SetupWorker;
+
+typedef struct {
+    unsigned char W[16];
+    unsigned char KE[EVP_MAX_BLOCK_LENGTH+1];
+    uint64_t xw[N_l];
+    uint64_t xtoken[N_l];                   //h.xw mod 2^q_l_bits
+    uint64_t xtoken_round[N_l];             //xtoken rounded to p_l_dash_bits
+    int16_t mask;
+    int16_t inv_mask;
+    size_t pair_begin;
+    unsigned int n_ids;
+} SetupKeyword;
+
+typedef struct {
+    unsigned char id[16];
+    size_t kw;
+    const TrapdoorEntry *td;
+    long td_new;
+} SetupPair;
+
+typedef struct {
+    uint16_t yid[N_l];
+    unsigned char ec[16];
+    unsigned int bf_indices[BF_MAX_HASH+1];
+    XTagDigest exact;                       //xset_telemetry only
+    bool eq_failed;                         //SIS equation mod q did not hold; setup aborts after the batch
+    bool xs_failed;                         //Could not be added to the worker's XSet shard
+} SetupPairOut;
+
+int SetupWorker_Init(SetupWorker &wk);
+int SetupWorker_Clean(SetupWorker &wk);
+int Setup_DeriveKE(unsigned char *W, unsigned char *KE);
+int Mask_Derive(SetupWorker &wk, unsigned char *W, int16_t *mask_out, int16_t *inv_mask_out);
+int Setup_Keyword(SetupWorker &wk, SetupKeyword &kw, const uint64_t *h_poly);
+int Setup_Pair(SetupWorker &wk, SetupKeyword &kw, SetupPair &pr, SetupPairOut &out);
+
+int Trapdoor_Compute(unsigned char *id, const fpr *expanded_key, const uint64_t *h_poly, int16_t *sig, uint8_t *tt_sign, TrapdoorEntry *entry);
+
 static void mk_rand_poly_oqxt(prng *p, fpr *f, unsigned logn);
 
 
@@ -0,0 +1,83 @@
+#include "poly_ring.h"
+
+static inline uint64_t PolyRing_Mask(unsigned k)
+{
+    return (k >= 64) ? ~0ULL : ((1ULL << k) - 1);
+}
+
+int PolyRing_FromInt16(uint64_t *a, const int16_t *s, unsigned k)
+{
+    // Sign-extend so negative coefficients land on 2^k - |s|
+    uint64_t mask = PolyRing_Mask(k);
+    for(int i=0;i<N_l;++i){
+        a[i] = static_cast<uint64_t>(static_cast<int64_t>(s[i])) & mask;
+    }
+    return 0;
+}
+
+int PolyRing_FromUint16(uint64_t *a, const uint16_t *s, unsigned k)
+{
+    uint64_t mask = PolyRing_Mask(k);
+    for(int i=0;i<N_l;++i){
+        a[i] = static_cast<uint64_t>(s[i]) & mask;
+    }
+    return 0;
+}
+
+int PolyRing_Mul(uint64_t *c, const uint64_t *a, const uint64_t *b, unsigned k)
+{
+    // Schoolbook negacyclic product: x^N_l wraps around as -1.
+    // The accumulator keeps c free to alias a or b.
+    uint64_t acc[N_l];
+    uint64_t mask = PolyRing_Mask(k);
+
+    ::memset(acc,0x00,sizeof(acc));
+    for(int i=0;i<N_l;++i){
+        uint64_t ai = a[i];
+        if(ai == 0) continue;
+
+        uint64_t *acc_lo = acc + i;
+        for(int j=0;j<N_l-i;++j){
+            acc_lo[j] += ai * b[j];
+        }
+
+        uint64_t *acc_hi = acc + i - N_l;
+        for(int j=N_l-i;j<N_l;++j){
+            acc_hi[j] -= ai * b[j];
+        }
+    }
+
+    for(int i=0;i<N_l;++i){
+        c[i] = acc[i] & mask;
+    }
+    return 0;
+}
+
+int PolyRing_MulPartial(uint64_t *c, const uint64_t *a, const uint64_t *b, unsigned k, unsigned n_out)
+{
+    // Only c[0..n_out) of the negacyclic product, at n_out*N_l multiply-adds.
+    // c must not alias a or b.
+    uint64_t mask = PolyRing_Mask(k);
+    for(unsigned i=0;i<n_out;++i){
+        uint64_t acc = 0;
+        for(unsigned j=0;j<=i;++j){
+            acc += a[j] * b[i-j];
+        }
+        for(unsigned j=i+1;j<N_l;++j){
+            acc -= a[j] * b[N_l+i-j];
+        }
+        c[i] = acc & mask;
+    }
+    return 0;
+}
+
+int PolyRing_Round(uint64_t *c, const uint64_t *a, unsigned from_bits, unsigned to_bits, unsigned n_out)
+{
+    // Keep the top to_bits of each from_bits coefficient
+    uint64_t mask = PolyRing_Mask(to_bits);
+    unsigned shift = from_bits - to_bits;
+    for(unsigned i=0;i<n_out;++i){
+        c[i] = (a[i] >> shift) & mask;
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef POLYRING_H
+#define POLYRING_H
+
+#include <cstdint>
+#include <cstring>
+#include "utils.h"
+
+/*
+ * Native arithmetic in Z_{2^k}[x]/(x^N_l + 1) on flat coefficient arrays.
+ * Coefficients are held in uint64_t and kept reduced to [0, 2^k); products
+ * wrap mod 2^64 and are masked at the end, which is exact for any k <= 64.
+ * The scheme uses k = q_l_bits (xid, xw, xtoken, xtag) and k = p_l_dash_bits
+ * (rounded xtoken times yid).
+ */
+
+int PolyRing_FromInt16(uint64_t *a, const int16_t *s, unsigned k);
+int PolyRing_FromUint16(uint64_t *a, const uint16_t *s, unsigned k);
+int PolyRing_Mul(uint64_t *c, const uint64_t *a, const uint64_t *b, unsigned k);
+int PolyRing_MulPartial(uint64_t *c, const uint64_t *a, const uint64_t *b, unsigned k, unsigned n_out);
+int PolyRing_Round(uint64_t *c, const uint64_t *a, unsigned from_bits, unsigned to_bits, unsigned n_out = N_l);
+
+#endif // POLYRING_H
@@ -0,0 +1,220 @@
+#include "poly_rns.h"
+
+static const uint32_t RNS_P[RNS_N_PRIMES] = {2013265921u, 1811939329u, 469762049u};
+static const uint32_t RNS_G[RNS_N_PRIMES] = {31u, 13u, 3u};     //generators of Z_p^*
+
+// Per prime: bit-reversed powers of psi (primitive 2*N_l-th root) and of psi^-1,
+// each with its Shoup quotient floor(w*2^32/p); N_l^-1; Barrett constant floor(2^64/p)
+static uint32_t psi_rev[RNS_N_PRIMES][N_l], psi_rev_sh[RNS_N_PRIMES][N_l];
+static uint32_t ipsi_rev[RNS_N_PRIMES][N_l], ipsi_rev_sh[RNS_N_PRIMES][N_l];
+static uint32_t n_inv[RNS_N_PRIMES], n_inv_sh[RNS_N_PRIMES];
+static uint64_t barrett_mu[RNS_N_PRIMES];
+
+// Garner constants: p0^-1 mod p1, (p0*p1)^-1 mod p2, and M = p0*p1*p2
+static uint64_t crt_p0_inv_p1, crt_p01_inv_p2;
+static unsigned __int128 crt_M, crt_M_half;
+
+static int rns_ready = 0;
+
+static uint32_t RNS_PowMod(uint64_t b, uint64_t e, uint32_t p)
+{
+    uint64_t r = 1;
+    b %= p;
+    while(e){
+        if(e & 1) r = (r * b) % p;
+        b = (b * b) % p;
+        e >>= 1;
+    }
+    return (uint32_t)r;
+}
+
+static inline uint32_t RNS_Shoup(uint32_t w, uint32_t p)
+{
+    return (uint32_t)(((uint64_t)w << 32) / p);
+}
+
+static inline uint32_t RNS_MulShoup(uint32_t x, uint32_t w, uint32_t w_sh, uint32_t p)
+{
+    // x*w mod p for x < 2^32; the estimate is off by at most one p
+    uint32_t q = (uint32_t)(((uint64_t)x * w_sh) >> 32);
+    uint32_t r = x * w - q * p;
+    return (r >= p) ? r - p : r;
+}
+
+static inline uint32_t RNS_MulMod(uint32_t a, uint32_t b, int t)
+{
+    uint64_t x = (uint64_t)a * b;
+    uint64_t q = (uint64_t)(((unsigned __int128)x * barrett_mu[t]) >> 64);
+    uint64_t r = x - q * RNS_P[t];
+    while(r >= RNS_P[t]) r -= RNS_P[t];
+    return (uint32_t)r;
+}
+
+static unsigned RNS_BitRev9(unsigned k)
+{
+    unsigned r = 0;
+    for(int i=0;i<9;++i){
+        r = (r << 1) | ((k >> i) & 1);
+    }
+    return r;
+}
+
+int PolyRNS_Init()
+{
+    if(rns_ready) return 0;
+
+    for(int t=0;t<RNS_N_PRIMES;++t){
+        uint32_t p = RNS_P[t];
+        uint32_t psi = RNS_PowMod(RNS_G[t], (p - 1) / (2 * N_l), p);
+        uint32_t ipsi = RNS_PowMod(psi, p - 2, p);
+
+        if(RNS_PowMod(psi, N_l, p) != p - 1){
+            return -1;
+        }
+
+        for(int k=0;k<N_l;++k){
+            unsigned e = RNS_BitRev9(k);
+            psi_rev[t][k] = RNS_PowMod(psi, e, p);
+            psi_rev_sh[t][k] = RNS_Shoup(psi_rev[t][k], p);
+            ipsi_rev[t][k] = RNS_PowMod(ipsi, e, p);
+            ipsi_rev_sh[t][k] = RNS_Shoup(ipsi_rev[t][k], p);
+        }
+        n_inv[t] = RNS_PowMod(N_l, p - 2, p);
+        n_inv_sh[t] = RNS_Shoup(n_inv[t], p);
+        barrett_mu[t] = (uint64_t)(((unsigned __int128)1 << 64) / p);
+    }
+
+    crt_p0_inv_p1 = RNS_PowMod(RNS_P[0], RNS_P[1] - 2, RNS_P[1]);
+    crt_p01_inv_p2 = RNS_PowMod(((uint64_t)RNS_P[0] * RNS_P[1]) % RNS_P[2], RNS_P[2] - 2, RNS_P[2]);
+    crt_M = (unsigned __int128)RNS_P[0] * RNS_P[1] * RNS_P[2];
+    crt_M_half = crt_M >> 1;
+
+    rns_ready = 1;
+    return 0;
+}
+
+static void RNS_NTT(uint32_t *a, int t)
+{
+    // Cooley-Tukey, natural order in, bit-reversed out; the psi twist makes it negacyclic
+    uint32_t p = RNS_P[t];
+    unsigned len = N_l;
+    for(unsigned m=1;m<(unsigned)N_l;m<<=1){
+        len >>= 1;
+        for(unsigned i=0;i<m;++i){
+            uint32_t w = psi_rev[t][m+i];
+            uint32_t w_sh = psi_rev_sh[t][m+i];
+            uint32_t *x = a + 2*i*len;
+            uint32_t *y = x + len;
+            for(unsigned j=0;j<len;++j){
+                uint32_t u = x[j];
+                uint32_t v = RNS_MulShoup(y[j], w, w_sh, p);
+                uint32_t s = u + v;
+                x[j] = (s >= p) ? s - p : s;
+                y[j] = (u >= v) ? u - v : u + p - v;
+            }
+        }
+    }
+}
+
+static void RNS_iNTT(uint32_t *a, int t)
+{
+    // Gentleman-Sande, bit-reversed in, natural order out, scaled by N_l^-1
+    uint32_t p = RNS_P[t];
+    unsigned len = 1;
+    for(unsigned m=N_l;m>1;m>>=1){
+        unsigned h = m >> 1;
+        for(unsigned i=0;i<h;++i){
+            uint32_t w = ipsi_rev[t][h+i];
+            uint32_t w_sh = ipsi_rev_sh[t][h+i];
+            uint32_t *x = a + 2*i*len;
+            uint32_t *y = x + len;
+            for(unsigned j=0;j<len;++j){
+                uint32_t u = x[j];
+                uint32_t v = y[j];
+                uint32_t s = u + v;
+                x[j] = (s >= p) ? s - p : s;
+                y[j] = RNS_MulShoup((u >= v) ? u - v : u + p - v, w, w_sh, p);
+            }
+        }
+        len <<= 1;
+    }
+    for(int j=0;j<N_l;++j){
+        a[j] = RNS_MulShoup(a[j], n_inv[t], n_inv_sh[t], p);
+    }
+}
+
+int PolyRNS_FromInt16(RNSPoly *r, const int16_t *s)
+{
+    for(int t=0;t<RNS_N_PRIMES;++t){
+        uint32_t p = RNS_P[t];
+        for(int i=0;i<N_l;++i){
+            int32_t v = s[i];
+            r->c[t][i] = (v < 0) ? (uint32_t)(p + v) : (uint32_t)v;
+        }
+        RNS_NTT(r->c[t], t);
+    }
+    return 0;
+}
+
+int PolyRNS_FromRing(RNSPoly *r, const uint64_t *a, unsigned k)
+{
+    // Lift each coefficient mod 2^k to its centred representative first;
+    // the bound in poly_rns.h holds for k <= p_l_dash_bits
+    if((k == 0) || (k > (unsigned)p_l_dash_bits)) return -1;
+
+    uint64_t half = 1ULL << (k - 1);
+    uint64_t full = (k >= 64) ? 0 : (1ULL << k);
+    for(int t=0;t<RNS_N_PRIMES;++t){
+        uint32_t p = RNS_P[t];
+        for(int i=0;i<N_l;++i){
+            uint64_t v = a[i] & (full - 1);
+            if(v >= half){
+                uint32_t m = (uint32_t)((full - v) % p);
+                r->c[t][i] = (m == 0) ? 0 : p - m;
+            }
+            else{
+                r->c[t][i] = (uint32_t)(v % p);
+            }
+        }
+        RNS_NTT(r->c[t], t);
+    }
+    return 0;
+}
+
+int PolyRNS_MulPoint(RNSPoly *c, const RNSPoly *a, const RNSPoly *b)
+{
+    for(int t=0;t<RNS_N_PRIMES;++t){
+        for(int i=0;i<N_l;++i){
+            c->c[t][i] = RNS_MulMod(a->c[t][i], b->c[t][i], t);
+        }
+    }
+    return 0;
+}
+
+int PolyRNS_ToRing(uint64_t *c, RNSPoly *a, unsigned k, unsigned n_out)
+{
+    // Inverse transforms in place, then Garner CRT on the first n_out coefficients only.
+    // a is left in coefficient form.
+    uint64_t mask = (k >= 64) ? ~0ULL : ((1ULL << k) - 1);
+    uint32_t p0 = RNS_P[0], p1 = RNS_P[1], p2 = RNS_P[2];
+
+    for(int t=0;t<RNS_N_PRIMES;++t){
+        RNS_iNTT(a->c[t], t);
+    }
+
+    for(unsigned i=0;i<n_out;++i){
+        uint64_t r0 = a->c[0][i], r1 = a->c[1][i], r2 = a->c[2][i];
+
+        uint64_t t1 = ((r1 + p1 - (r0 % p1)) % p1) * crt_p0_inv_p1 % p1;
+        uint64_t x01 = (r0 + (uint64_t)p0 * t1) % p2;      //r0 + p0*t1 < 2^62
+        uint64_t t2 = ((r2 + p2 - x01) % p2) * crt_p01_inv_p2 % p2;
+
+        unsigned __int128 v = (unsigned __int128)r0 + (unsigned __int128)p0 * t1
+                            + (unsigned __int128)p0 * p1 * t2;
+        if(v > crt_M_half){
+            v -= crt_M;                                     //negative: wraps mod 2^128
+        }
+        c[i] = (uint64_t)v & mask;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef POLYRNS_H
+#define POLYRNS_H
+
+#include <cstdint>
+#include <cstring>
+#include "utils.h"
+
+/*
+ * Transform-domain representation of Z[x]/(x^N_l + 1): a residue number
+ * system over three NTT-friendly primes (p = 1 mod 2*N_l), each residue
+ * held in negacyclic NTT form so ring products are pointwise. The moduli
+ * span about 2^90, which covers the exact integer product of a centred
+ * 16-bit polynomial and a centred p_l_dash_bits polynomial
+ * (|c| < N_l * 2^15 * 2^39 = 2^63), so mapping back and masking to 2^k
+ * reproduces PolyRing_Mul for any k <= 64.
+ */
+
+#define RNS_N_PRIMES 3
+
+typedef struct {
+    uint32_t c[RNS_N_PRIMES][N_l];
+} RNSPoly;
+
+int PolyRNS_Init();
+int PolyRNS_FromInt16(RNSPoly *r, const int16_t *s);
+int PolyRNS_FromRing(RNSPoly *r, const uint64_t *a, unsigned k);
+int PolyRNS_MulPoint(RNSPoly *c, const RNSPoly *a, const RNSPoly *b);
+int PolyRNS_ToRing(uint64_t *c, RNSPoly *a, unsigned k, unsigned n_out = N_l);
+
+#endif // POLYRNS_H
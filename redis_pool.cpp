@@ -0,0 +1,131 @@
+#include "redis_pool.h"
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+
+static std::unique_ptr<sw::redis::Redis> REDIS_POOL;
+static std::vector<std::unique_ptr<sw::redis::Redis>> REDIS_SHARDS;
+static std::vector<std::unique_ptr<sw::redis::Redis>> REDIS_REPLICAS;
+
+int RedisPool_Options(sw::redis::ConnectionOptions &co, sw::redis::ConnectionPoolOptions &po,
+                      const std::string &host, int port, const std::string &unix_socket, size_t pool_size)
+{
+    // A non-empty socket path selects a Unix domain socket over TCP
+    if(!unix_socket.empty()){
+        co.type = sw::redis::ConnectionType::UNIX;
+        co.path = unix_socket;
+    }
+    else{
+        co.type = sw::redis::ConnectionType::TCP;
+        co.host = host;
+        co.port = port;
+    }
+    co.keep_alive = true;
+    po.size = (pool_size == 0) ? 1 : pool_size;
+    return 0;
+}
+
+int RedisPool_Init(const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po)
+{
+    // Connections are opened lazily by redis++, on first use by each borrower
+    try{
+        REDIS_POOL.reset(new sw::redis::Redis(co, po));
+    }
+    catch(const std::exception &e){
+        std::cerr << "Cannot create Redis connection pool: " << e.what() << std::endl;
+        REDIS_POOL.reset();
+        return -1;
+    }
+    return 0;
+}
+
+sw::redis::Redis &RedisPool_Get()
+{
+    return *REDIS_POOL;
+}
+
+int RedisPool_ParseEndpoint(const std::string &endpoint, sw::redis::ConnectionOptions &co)
+{
+    if(endpoint.compare(0,5,"unix:") == 0){
+        co.type = sw::redis::ConnectionType::UNIX;
+        co.path = endpoint.substr(5);
+        return co.path.empty() ? -1 : 0;
+    }
+    size_t colon = endpoint.rfind(':');
+    co.type = sw::redis::ConnectionType::TCP;
+    co.host = endpoint.substr(0,colon);
+    co.port = 6379;
+    if(colon != std::string::npos){
+        char *end = nullptr;
+        long port = strtol(endpoint.c_str()+colon+1,&end,10);
+        if((end == endpoint.c_str()+colon+1) || (*end != '\0') || (port <= 0) || (port > 65535)){
+            return -1;
+        }
+        co.port = (int)port;
+    }
+    return co.host.empty() ? -1 : 0;
+}
+
+static int RedisPool_Build(std::vector<std::unique_ptr<sw::redis::Redis>> &pools, const char *role, const std::vector<std::string> &endpoints,
+                           const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po)
+{
+    pools.clear();
+    for(size_t i=0;i<endpoints.size();++i){
+        sw::redis::ConnectionOptions endpoint_co = co;
+        if(RedisPool_ParseEndpoint(endpoints[i], endpoint_co) != 0){
+            std::cerr << "Invalid Redis " << role << " endpoint " << endpoints[i] << std::endl;
+            pools.clear();
+            return -1;
+        }
+        try{
+            pools.emplace_back(new sw::redis::Redis(endpoint_co, po));
+        }
+        catch(const std::exception &e){
+            std::cerr << "Cannot create Redis pool for " << role << " " << endpoints[i] << ": " << e.what() << std::endl;
+            pools.clear();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int RedisPool_InitShards(const std::vector<std::string> &endpoints, const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po)
+{
+    if(RedisPool_Build(REDIS_SHARDS, "shard", endpoints, co, po) != 0){
+        return -1;
+    }
+    return REDIS_SHARDS.empty() ? -1 : 0;
+}
+
+int RedisPool_InitReplicas(const std::vector<std::string> &endpoints, const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po)
+{
+    return RedisPool_Build(REDIS_REPLICAS, "replica", endpoints, co, po);
+}
+
+size_t RedisPool_NumReplicas()
+{
+    return REDIS_REPLICAS.size();
+}
+
+sw::redis::Redis &RedisPool_Replica(size_t replica)
+{
+    return *REDIS_REPLICAS[replica];
+}
+
+size_t RedisPool_NumShards()
+{
+    return REDIS_SHARDS.size();
+}
+
+sw::redis::Redis &RedisPool_Shard(size_t shard)
+{
+    return *REDIS_SHARDS[shard];
+}
+
+int RedisPool_Clean()
+{
+    REDIS_REPLICAS.clear();
+    REDIS_SHARDS.clear();
+    REDIS_POOL.reset();
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef REDISPOOL_H
+#define REDISPOOL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include </usr/local/include/sw/redis++/redis++.h>
+
+/*
+ * Process-wide Redis handle for the TSet. sw::redis::Redis is itself a
+ * thread-safe connection pool, so one instance is built at Sys_Init from
+ * the tool's connection_options/pool_options and every TSet read or write
+ * borrows from it instead of connecting per request. A sharded TSet adds
+ * one such pool per endpoint ("host:port" or "unix:/path"), each built
+ * from the same options with only the address replaced. Read replicas of
+ * the primary are set up the same way and only ever read from.
+ */
+int RedisPool_Options(sw::redis::ConnectionOptions &co, sw::redis::ConnectionPoolOptions &po,
+                      const std::string &host, int port, const std::string &unix_socket, size_t pool_size);
+int RedisPool_Init(const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po);
+sw::redis::Redis &RedisPool_Get();
+int RedisPool_ParseEndpoint(const std::string &endpoint, sw::redis::ConnectionOptions &co);
+int RedisPool_InitShards(const std::vector<std::string> &endpoints, const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po);
+size_t RedisPool_NumShards();
+sw::redis::Redis &RedisPool_Shard(size_t shard);
+int RedisPool_InitReplicas(const std::vector<std::string> &endpoints, const sw::redis::ConnectionOptions &co, const sw::redis::ConnectionPoolOptions &po);
+size_t RedisPool_NumReplicas();
+sw::redis::Redis &RedisPool_Replica(size_t replica);
+int RedisPool_Clean();
+
+#endif // REDISPOOL_H
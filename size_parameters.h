@@ -6,8 +6,10 @@ extern int N_max_ids;
 extern int N_row_ids;
 extern int BF_length;
 
-#define N_HASH 1                            //Equal to N_Threads     (Also change in BloomFilter.h)
-#define MAX_BF_BIN_SIZE 131072              //17 bits                (Also change in BloomFilter.h)
+//Shape of the original fixed-size XSet filter (BF_LEGACY_PARAMS); the filter itself is sized at runtime
+#define N_HASH 1
+#define MAX_BF_BIN_SIZE 131072
+#define N_BF_BITS 17
 
 
 #endif // SIZEPARAMETERS_H
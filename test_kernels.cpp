@@ -0,0 +1,479 @@
+#include <iostream>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "poly_ring.h"
+#include "poly_rns.h"
+#include "mq_ntt.h"
+#include "bloom_filter.h"
+#include "fuse_filter.h"
+#include "cuckoo_filter.h"
+#include "xset.h"
+#include "tset_format.h"
+#include "tset_file.h"
+
+/*
+ * Self-checks for the optimised kernels against their reference paths:
+ * RNS ring products against PolyRing_Mul(Partial), the AVX2 MQ kernels
+ * against the scalar ones, sizing and no false negatives for the XSet
+ * backends, and round-trips through the TSet file and chunk codecs. Each
+ * test notes the change request it covers. Run with make test.
+ */
+
+static int n_fail = 0;
+
+#define CHECK(cond, what) do{ if(!(cond)){ std::cerr << "FAIL " << what << std::endl; n_fail++; } }while(0)
+
+static void Test_PolyRNS()
+{
+    //user-007: the transform-domain product must reproduce PolyRing_Mul(Partial) on p_l_dash_bits inputs
+    std::mt19937_64 g(1);
+    std::vector<int16_t> s(N_l);
+    std::vector<uint64_t> a(N_l), b(N_l), c_ref(N_l), c_rns(N_l);
+    RNSPoly A, B, C;
+
+    CHECK(PolyRNS_Init() == 0, "PolyRNS_Init");
+    CHECK(PolyRNS_FromRing(&B,b.data(),p_l_dash_bits+1) != 0, "PolyRNS_FromRing accepts inputs wider than p_l_dash_bits");
+    for(int it=0;it<50;++it){
+        for(int i=0;i<N_l;++i){
+            s[i] = (it == 0) ? -32768 : (int16_t)g();
+            b[i] = (it == 0) ? (1ULL << (p_l_dash_bits-1)) : (g() & ((1ULL << p_l_dash_bits)-1));
+        }
+        PolyRing_FromInt16(a.data(),s.data(),p_l_dash_bits);
+        PolyRNS_FromInt16(&A,s.data());
+        CHECK(PolyRNS_FromRing(&B,b.data(),p_l_dash_bits) == 0, "PolyRNS_FromRing");
+        PolyRNS_MulPoint(&C,&A,&B);
+
+        PolyRing_Mul(c_ref.data(),a.data(),b.data(),p_l_dash_bits);
+        PolyRNS_ToRing(c_rns.data(),&C,p_l_dash_bits);
+        CHECK(c_ref == c_rns, "PolyRNS vs PolyRing_Mul, round " << it);
+
+        //ToRing leaves C in coefficient form, so redo the pointwise product; narrower k only masks
+        for(unsigned int n_out : {1u, 16u, (unsigned int)N_l-1}){
+            for(unsigned int k : {16u, (unsigned int)p_l_dash_bits}){
+                PolyRNS_MulPoint(&C,&A,&B);
+                PolyRing_MulPartial(c_ref.data(),a.data(),b.data(),p_l_dash_bits,n_out);
+                PolyRNS_ToRing(c_rns.data(),&C,k,n_out);
+                bool same = true;
+                for(unsigned int i=0;i<n_out;++i){
+                    same = same && (c_rns[i] == (c_ref[i] & ((1ULL << k)-1)));
+                }
+                CHECK(same, "PolyRNS vs PolyRing_MulPartial, n_out " << n_out << ", k " << k << ", round " << it);
+            }
+        }
+    }
+}
+
+static void Test_MQ()
+{
+    //user-008: AVX2 and scalar MQ kernels give bit-identical results
+    MQ_Init();
+    if(!MQ_HasAVX2()){
+        std::cout << "No AVX2 on this CPU; MQ kernels checked against the reference only" << std::endl;
+    }
+
+    std::mt19937 g(5);
+    uint16_t a[N_l], b[N_l], c[N_l];
+    int16_t s[N_l+7], o_avx[N_l+7], o_ref[N_l+7];
+
+    for(int it=0;it<200;++it){
+        for(int i=0;i<N_l;++i){
+            a[i] = (it == 0) ? p_l-1 : g() % p_l;
+            c[i] = (it == 0) ? p_l-1 : g() % p_l;
+        }
+        ::memcpy(b,a,sizeof(a));
+
+        MQ_SetAVX2(1);
+        MQ_NTT(a,9); MQ_PolyToMonty(a,9); MQ_PolyMontymulNTT(a,c,9); MQ_iNTT(a,9);
+        MQ_SetAVX2(0);
+        MQ_NTT(b,9); MQ_PolyToMonty(b,9); MQ_PolyMontymulNTT(b,c,9); MQ_iNTT(b,9);
+        CHECK(::memcmp(a,b,sizeof(a)) == 0, "MQ NTT product AVX2 vs scalar, round " << it);
+
+        //Odd length exercises the scalar tail of the vector kernel
+        int32_t cc = (it == 1) ? p_l-1 : ((it == 2) ? -1 : (int32_t)(g() % (2*p_l)) - p_l);
+        for(int i=0;i<N_l+7;++i){
+            s[i] = (int16_t)g();
+        }
+        s[0] = -32768; s[1] = 32767; s[2] = 0;
+        MQ_SetAVX2(1);
+        MQ_PolyMulScalar(o_avx,s,cc,N_l+7);
+        MQ_SetAVX2(0);
+        MQ_PolyMulScalar(o_ref,s,cc,N_l+7);
+        for(int i=0;i<N_l+7;++i){
+            if((o_avx[i] != o_ref[i]) || (o_ref[i] != (int16_t)((s[i]*(cc % p_l)) % p_l))){
+                CHECK(false, "MQ_PolyMulScalar at " << i << ", round " << it);
+                break;
+            }
+        }
+    }
+    MQ_Init();
+}
+
+static void Test_BloomFilter(unsigned int layout)
+{
+    //user-011/012: no false negatives in either Bloom layout
+    BloomParams P;
+    BloomFilter BF;
+    blake3_hasher hasher;
+    uint64_t xtag[N_l] = {0};
+    unsigned int idx[BF_MAX_HASH+1];
+    bool present;
+    uint64_t n_fn = 0;
+
+    BloomParams_Size(P,20000,1e-4,0,layout);
+    BloomFilter_Init(BF,P);
+    for(uint64_t i=0;i<20000;++i){
+        xtag[0] = i;
+        BloomFilter_XTagIndices(BF,&hasher,xtag,idx);
+        BloomFilter_Set(BF,idx);
+    }
+    for(uint64_t i=0;i<20000;++i){
+        xtag[0] = i;
+        BloomFilter_XTagIndices(BF,&hasher,xtag,idx);
+        BloomFilter_Match(BF,idx,&present);
+        n_fn += !present;
+    }
+    CHECK(n_fn == 0, "BloomFilter layout " << layout << ": " << n_fn << " false negatives");
+    BloomFilter_Clean(BF);
+}
+
+static void Test_BloomSizing()
+{
+    //user-011: runtime sizing meets the target FPR, and a sized filter survives the file round trip
+    BloomParams P;
+    BloomFilter BF, RF;
+    blake3_hasher hasher;
+    uint64_t xtag[N_l] = {0};
+    unsigned int idx[BF_MAX_HASH+1];
+    bool present;
+    uint64_t n_fp = 0, n_fn = 0;
+    const uint64_t n_items = 20000, n_probe = 200000;
+    const double target = 1e-3;
+    std::string path = "test_kernels_bf.dat";
+
+    CHECK(BF_LEGACY_PARAMS.layout == BF_LAYOUT_PARTITIONED, "BF_LEGACY_PARAMS layout");
+    CHECK(BloomParams_Size(P,n_items,0.0) != 0, "BloomParams_Size accepts FPR 0");
+    CHECK((BloomParams_Size(P,n_items,target,0,BF_LAYOUT_PARTITIONED) == 0) && (BloomParams_FPR(P,n_items) <= target),
+          "BloomParams_Size estimate above target");
+
+    BloomFilter_Init(BF,P);
+    for(uint64_t i=0;i<n_items;++i){
+        xtag[0] = i;
+        BloomFilter_XTagIndices(BF,&hasher,xtag,idx);
+        BloomFilter_Set(BF,idx);
+    }
+    //Only the low 16 bits of a coefficient are hashed; coefficient 2 keeps the probes disjoint from the members
+    xtag[2] = 1;
+    for(uint64_t i=0;i<n_probe;++i){
+        xtag[0] = i & 0xFFFF;
+        xtag[1] = i >> 16;
+        BloomFilter_XTagIndices(BF,&hasher,xtag,idx);
+        BloomFilter_Match(BF,idx,&present);
+        n_fp += present;
+    }
+    //Loose bound: the estimate is already below target and 200k probes keep the noise well under 2x
+    CHECK((double)n_fp/n_probe <= 2*target, "Bloom measured FPR " << (double)n_fp/n_probe << " for target " << target);
+
+    xtag[1] = 0;
+    xtag[2] = 0;
+    CHECK(BloomFilter_WriteBFtoFile(path,BF) == 0, "BloomFilter_WriteBFtoFile");
+    CHECK(BloomFilter_ReadBFfromFile(path,RF) == 0, "BloomFilter_ReadBFfromFile");
+    CHECK((RF.n_hash == BF.n_hash) && (RF.n_bits == BF.n_bits) && (RF.layout == BF.layout), "Bloom file geometry");
+    for(uint64_t i=0;i<n_items;++i){
+        xtag[0] = i;
+        BloomFilter_XTagIndices(RF,&hasher,xtag,idx);
+        BloomFilter_Match(RF,idx,&present);
+        n_fn += !present;
+    }
+    CHECK(n_fn == 0, "Bloom file round trip: " << n_fn << " false negatives");
+    BloomFilter_Clean(BF);
+    BloomFilter_Clean(RF);
+    unlink(path.c_str());
+}
+
+static void Test_BloomBatch(unsigned int layout)
+{
+    //user-012: the blocked layout keeps every probe in one line, and the batched and
+    //conjunctive lookups agree with probing each term of each candidate on its own
+    BloomParams P;
+    BloomFilter BF;
+    blake3_hasher hasher;
+    uint64_t xtag[N_l] = {0};
+    unsigned int idx[BF_MAX_HASH+1];
+    const unsigned int n_cand = 100, n_words = 3;
+    std::mt19937_64 g(5);
+    bool line_ok = true;
+
+    BloomParams_Size(P,2000,1e-3,0,layout);
+    BloomFilter_Init(BF,P);
+    for(uint64_t i=0;i<2000;++i){
+        xtag[0] = i;
+        BloomFilter_XTagIndices(BF,&hasher,xtag,idx);
+        BloomFilter_Set(BF,idx);
+    }
+
+    unsigned int n_idx = BloomFilter_IndexCount(BF);
+    std::vector<std::vector<unsigned int>> rows(n_idx, std::vector<unsigned int>(n_cand*n_words));
+    std::vector<std::vector<bool>> term(n_cand, std::vector<bool>(n_words));
+    unsigned int *cols[BF_MAX_HASH+1];
+    for(unsigned int j=0;j<n_idx;++j){
+        cols[j] = rows[j].data();
+    }
+    for(unsigned int c=0;c<n_cand;++c){
+        for(unsigned int l=0;l<n_words;++l){
+            //About a third of the terms are absent
+            xtag[0] = (g() % 3 == 0) ? 5000 + g() % 100 : g() % 2000;
+            BloomFilter_XTagIndices(BF,&hasher,xtag,idx);
+            for(unsigned int j=0;j<n_idx;++j){
+                rows[j][c*n_words+l] = idx[j];
+                line_ok = line_ok && ((layout != BF_LAYOUT_BLOCKED) || (j == 0) || (idx[j] < BF_BLOCK_BITS));
+            }
+            bool present;
+            BloomFilter_Match(BF,idx,&present);
+            term[c][l] = present;
+        }
+    }
+    CHECK(line_ok, "Blocked Bloom offset outside its line");
+
+    uint64_t survivors[(n_cand+63)/64];
+    BloomFilter_Match_Batch(BF,cols,n_words,n_cand,survivors);
+    unsigned int n_bad = 0;
+    for(unsigned int c=0;c<n_cand;++c){
+        unsigned int *cand[BF_MAX_HASH+1];
+        for(unsigned int j=0;j<n_idx;++j){
+            cand[j] = cols[j] + c*n_words;
+        }
+        bool all = term[c][0] && term[c][1] && term[c][2];
+        bool match_n;
+        BloomFilter_Match_N(BF,cand,n_words,&match_n);
+        bool batch = (survivors[c >> 6] >> (c & 63)) & 1;
+        n_bad += (match_n != all) || (batch != all);
+    }
+    CHECK(n_bad == 0, "Bloom layout " << layout << ": " << n_bad << " candidates where Match_N/Match_Batch disagree with Match");
+    BloomFilter_Clean(BF);
+}
+
+static void Test_FuseCuckoo()
+{
+    //user-014: no false negatives from the raw fuse and cuckoo filters
+    std::mt19937_64 g(7);
+    for(unsigned int fp_bits : {8u, 16u}){
+        for(size_t n : {(size_t)1, (size_t)100, (size_t)100000}){
+            std::vector<uint64_t> keys(n);
+            for(auto &k : keys) k = g();
+            size_t n_fn = 0;
+
+            FuseFilter FF;
+            FuseFilter_Init(FF,n,fp_bits);
+            CHECK(FuseFilter_Populate(FF,keys.data(),n) == 0, "FuseFilter_Populate n " << n);
+            for(auto k : keys) n_fn += !FuseFilter_Contain(FF,k);
+            CHECK(n_fn == 0, "FuseFilter fp_bits " << fp_bits << " n " << n << ": " << n_fn << " false negatives");
+            FuseFilter_Clean(FF);
+
+            n_fn = 0;
+            CuckooFilter CF;
+            CuckooFilter_Init(CF,CuckooFilter_BucketBits(n),fp_bits);
+            CHECK(CuckooFilter_Populate(CF,keys.data(),n) == 0, "CuckooFilter_Populate n " << n);
+            for(auto k : keys) n_fn += !CuckooFilter_Contain(CF,k);
+            CHECK(n_fn == 0, "CuckooFilter fp_bits " << fp_bits << " n " << n << ": " << n_fn << " false negatives");
+            CuckooFilter_Clean(CF);
+        }
+    }
+}
+
+static void Test_XSet()
+{
+    //user-014: each backend sized for the target keeps every member through build, write and read,
+    //and its measured FPR stays near the target (cuckoo lowers its load to meet 1e-4)
+    blake3_hasher hasher;
+    uint64_t xtag[N_l] = {0};
+    unsigned int idx[BF_MAX_HASH+1];
+    bool present;
+    const uint64_t n_items = 50000, n_probe = 200000;
+    const double target = 1e-4;
+    std::string path = "test_kernels_xset.dat";
+
+    for(unsigned int type : {XSET_BLOOM, XSET_FUSE, XSET_CUCKOO}){
+        XSet XS = {}, RS = {};
+        uint64_t n_fn = 0, n_fp = 0;
+
+        CHECK(XSet_Init(XS,type,n_items,target) == 0, "XSet_Init " << XSet_Name(type));
+        for(uint64_t i=0;i<n_items;++i){
+            xtag[0] = i & 0xFFFF;
+            xtag[1] = i >> 16;
+            XSet_XTagIndices(XS,&hasher,xtag,idx);
+            CHECK(XSet_Add(XS,idx) == 0, "XSet_Add " << XSet_Name(type));
+        }
+        CHECK(XSet_Build(XS) == 0, "XSet_Build " << XSet_Name(type));
+        CHECK(XSet_Write(path,XS) == 0, "XSet_Write " << XSet_Name(type));
+        CHECK(XSet_Read(path,RS) == 0, "XSet_Read " << XSet_Name(type));
+
+        for(uint64_t i=0;i<n_items;++i){
+            xtag[0] = i & 0xFFFF;
+            xtag[1] = i >> 16;
+            XSet_XTagIndices(RS,&hasher,xtag,idx);
+            XSet_Probe(RS,idx,&present);
+            n_fn += !present;
+        }
+        xtag[2] = 1;
+        for(uint64_t i=0;i<n_probe;++i){
+            xtag[0] = i & 0xFFFF;
+            xtag[1] = i >> 16;
+            XSet_XTagIndices(RS,&hasher,xtag,idx);
+            XSet_Probe(RS,idx,&present);
+            n_fp += present;
+        }
+        xtag[2] = 0;
+        CHECK(n_fn == 0, "XSet " << XSet_Name(type) << ": " << n_fn << " false negatives");
+        CHECK((double)n_fp/n_probe <= 2*target, "XSet " << XSet_Name(type) << " measured FPR " << (double)n_fp/n_probe << " for target " << target);
+        CHECK(XSet_FPR(RS) <= target*1.01, "XSet " << XSet_Name(type) << " estimated FPR " << XSet_FPR(RS) << " for target " << target);
+        XSet_Clean(XS);
+        XSet_Clean(RS);
+    }
+    unlink(path.c_str());
+}
+
+static void Test_TSetFile()
+{
+    //user-022: every entry put into a TSet file is read back after mapping
+    std::string path = "test_kernels_tset.dat";
+    std::vector<std::string> keys;
+    TSetFile TF{};
+    const unsigned char *val;
+    uint32_t len;
+
+    CHECK(TSetFile_Create(TF,path) == 0, "TSetFile_Create");
+    for(int i=0;i<5000;++i){
+        std::string key(TSET_KEY_BYTES,'\0');
+        for(int b=0;b<TSET_KEY_BYTES;++b){
+            key[b] = (char)((i*131 + b*7) ^ (i >> 3));
+        }
+        key[0] = (char)i;
+        key[1] = (char)(i >> 8);
+        keys.push_back(key);
+        TSetFile_Put(TF,key,std::string(i%50+1,(char)i));
+    }
+    CHECK(TSetFile_Finish(TF,TSET_FORMAT_BINARY,TSET_LAYOUT_CHUNKED,64) == 0, "TSetFile_Finish");
+    TSetFile_Clean(TF);
+
+    CHECK(TSetFile_Open(TF,path) == 0, "TSetFile_Open");
+    CHECK((TF.format == TSET_FORMAT_BINARY) && (TF.layout == TSET_LAYOUT_CHUNKED) && (TF.chunk_ids == 64), "TSetFile header");
+    for(int i=0;i<5000;++i){
+        bool ok = (TSetFile_Get(TF,keys[i],&val,&len) == 0) && (std::string((const char *)val,len) == std::string(i%50+1,(char)i));
+        if(!ok){
+            CHECK(false, "TSetFile_Get entry " << i);
+            break;
+        }
+    }
+    CHECK(TSetFile_Get(TF,std::string(TSET_KEY_BYTES,'x'),&val,&len) != 0, "TSetFile_Get absent key");
+    TSetFile_Clean(TF);
+    unlink(path.c_str());
+}
+
+static void Test_TSetFileEdges()
+{
+    //user-022: a later put of the same key wins, an empty store opens, and a damaged or missing file is refused
+    std::string path = "test_kernels_tset_edges.dat";
+    std::string key(TSET_KEY_BYTES,'k');
+    TSetFile TF{};
+    const unsigned char *val;
+    uint32_t len;
+
+    CHECK(TSetFile_Create(TF,path) == 0, "TSetFile_Create");
+    CHECK(TSetFile_Put(TF,std::string(TSET_KEY_BYTES-1,'k'),"short") != 0, "TSetFile_Put accepts a short key");
+    TSetFile_Put(TF,key,"first");
+    TSetFile_Put(TF,key,"second");
+    CHECK(TSetFile_Finish(TF,TSET_FORMAT_BINARY,TSET_LAYOUT_ENTRY,0) == 0, "TSetFile_Finish");
+    TSetFile_Clean(TF);
+    CHECK(TSetFile_Open(TF,path) == 0, "TSetFile_Open");
+    CHECK((TF.n_entries == 1) && (TSetFile_Get(TF,key,&val,&len) == 0) && (std::string((const char *)val,len) == "second"),
+          "TSetFile repeated put");
+    TSetFile_Clean(TF);
+
+    CHECK(TSetFile_Create(TF,path) == 0, "TSetFile_Create empty");
+    CHECK(TSetFile_Finish(TF,TSET_FORMAT_BINARY,TSET_LAYOUT_ENTRY,0) == 0, "TSetFile_Finish empty");
+    TSetFile_Clean(TF);
+    CHECK((TSetFile_Open(TF,path) == 0) && (TF.n_entries == 0) && (TSetFile_Get(TF,key,&val,&len) != 0), "TSetFile empty store");
+    TSetFile_Clean(TF);
+
+    //Damaged copies: one byte short, then a bad magic
+    struct stat st;
+    stat(path.c_str(),&st);
+    CHECK(truncate(path.c_str(),st.st_size-1) == 0, "truncate");
+    CHECK(TSetFile_Open(TF,path) != 0, "TSetFile_Open accepts a truncated file");
+    TSetFile_Clean(TF);
+    CHECK(truncate(path.c_str(),st.st_size) == 0, "truncate");
+    FILE *fp = fopen(path.c_str(),"r+b");
+    if(fp != NULL){
+        fputc('X',fp);
+        fclose(fp);
+    }
+    CHECK(TSetFile_Open(TF,path) != 0, "TSetFile_Open accepts a bad magic");
+    TSetFile_Clean(TF);
+
+    unlink(path.c_str());
+    CHECK(TSetFile_Open(TF,path) != 0, "TSetFile_Open accepts a missing file");
+    TSetFile_Clean(TF);
+}
+
+static void Test_TSetChunk()
+{
+    //user-021: a chunk survives packing and the value encoding search decodes it through,
+    //and a chunk whose length disagrees with its record count is refused
+    const unsigned int record_bytes = 12;
+    std::vector<unsigned char> records(TSET_CHUNK_MAX_IDS*record_bytes);
+    std::vector<unsigned char> chunk(TSET_CHUNK_HEADER_BYTES + records.size());
+    bool last;
+    unsigned int n_records;
+
+    for(size_t i=0;i<records.size();++i){
+        records[i] = (unsigned char)(i*29);
+    }
+    for(unsigned int n : {0u, 1u, 64u, (unsigned int)TSET_CHUNK_MAX_IDS}){
+        size_t n_bytes = TSetChunk_Pack(chunk.data(),n != 64,records.data(),n,record_bytes);
+        CHECK(n_bytes == TSET_CHUNK_HEADER_BYTES + (size_t)n*record_bytes, "TSetChunk_Pack size, n " << n);
+        CHECK(TSetChunk_Unpack(chunk.data(),n_bytes,record_bytes,&last,&n_records) == 0, "TSetChunk_Unpack, n " << n);
+        CHECK((n_records == n) && (last == (n != 64)), "TSetChunk header, n " << n);
+        CHECK(::memcmp(chunk.data()+TSET_CHUNK_HEADER_BYTES,records.data(),(size_t)n*record_bytes) == 0, "TSetChunk records, n " << n);
+        CHECK(TSetChunk_Unpack(chunk.data(),n_bytes+1,record_bytes,&last,&n_records) != 0, "TSetChunk_Unpack trailing byte, n " << n);
+        if(n > 0){
+            CHECK(TSetChunk_Unpack(chunk.data(),n_bytes-1,record_bytes,&last,&n_records) != 0, "TSetChunk_Unpack short record, n " << n);
+        }
+
+        for(unsigned int format : {(unsigned int)TSET_FORMAT_HEX, (unsigned int)TSET_FORMAT_BINARY}){
+            std::string value;
+            std::vector<unsigned char> decoded(n_bytes);
+            TSetFormat_Value(format,chunk.data(),n_bytes,value);
+            bool ok = (TSetFormat_ValueBytes(format,value) == n_bytes)
+                   && (TSetFormat_DecodeValue(format,value,decoded.data(),n_bytes) == 0)
+                   && (::memcmp(decoded.data(),chunk.data(),n_bytes) == 0);
+            CHECK(ok, "TSet chunk value encoding, format " << format << ", n " << n);
+        }
+    }
+    CHECK(TSetChunk_Unpack(chunk.data(),TSET_CHUNK_HEADER_BYTES-1,record_bytes,&last,&n_records) != 0, "TSetChunk_Unpack truncated header");
+}
+
+int main()
+{
+    Test_PolyRNS();
+    Test_MQ();
+    Test_BloomFilter(BF_LAYOUT_PARTITIONED);
+    Test_BloomFilter(BF_LAYOUT_BLOCKED);
+    Test_BloomSizing();
+    Test_BloomBatch(BF_LAYOUT_PARTITIONED);
+    Test_BloomBatch(BF_LAYOUT_BLOCKED);
+    Test_FuseCuckoo();
+    Test_XSet();
+    Test_TSetFile();
+    Test_TSetFileEdges();
+    Test_TSetChunk();
+
+    if(n_fail != 0){
+        std::cerr << n_fail << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All kernel checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "trapdoor_cache.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * Journal file layout: 8B magic, 32B BLAKE3 fingerprint of h, then a sequence of
+ * (16B id, TrapdoorEntry, 32B BLAKE3 of both) records. A file written under a
+ * different key is discarded and rewritten; reading stops at the first record
+ * whose checksum fails, and the file is cut back to the records before it.
+ */
+
+#define TDC_HEADER_BYTES (8 + BLAKE3_OUT_LEN)
+#define TDC_RECORD_BYTES (16 + sizeof(TrapdoorEntry) + BLAKE3_OUT_LEN)
+
+static void TrapdoorCache_Checksum(const unsigned char *id, const TrapdoorEntry &entry, unsigned char *digest)
+{
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, id, 16);
+    blake3_hasher_update(&hasher, &entry, sizeof(TrapdoorEntry));
+    blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+}
+
+static long TrapdoorCache_ReadJournal(TrapdoorCache &TC, FILE *fp)
+{
+    //Returns the number of intact records
+    unsigned char id[16];
+    unsigned char checksum[BLAKE3_OUT_LEN];
+    unsigned char expected[BLAKE3_OUT_LEN];
+    TrapdoorEntry entry;
+    long n_records = 0;
+
+    while((fread(id,1,16,fp) == 16) && (fread(&entry,sizeof(TrapdoorEntry),1,fp) == 1)
+          && (fread(checksum,1,BLAKE3_OUT_LEN,fp) == BLAKE3_OUT_LEN)){
+        TrapdoorCache_Checksum(id, entry, expected);
+        if(::memcmp(checksum,expected,BLAKE3_OUT_LEN) != 0) break;
+        TC.entries.emplace(std::string(reinterpret_cast<char *>(id),16), entry);
+        n_records++;
+    }
+    return n_records;
+}
+
+static void TrapdoorCache_StopJournal(TrapdoorCache &TC)
+{
+    std::cerr << "Cannot write the trapdoor journal file; trapdoors from here on are kept in memory only" << std::endl;
+    fclose(TC.journal);
+    TC.journal = NULL;
+}
+
+int TrapdoorCache_Init(TrapdoorCache &TC, const uint16_t *h, std::string journal_file)
+{
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, h, N_l*sizeof(uint16_t));
+    blake3_hasher_finalize(&hasher, TC.key_fp, BLAKE3_OUT_LEN);
+
+    TC.entries.clear();
+    TC.journal = NULL;
+    TC.n_hits = 0;
+    TC.n_misses = 0;
+    TC.n_inserted = 0;
+
+    if(journal_file.empty()) return 0;
+
+    long n_records = 0;
+    FILE *fp = fopen(journal_file.c_str(),"rb");
+    if(fp != NULL){
+        char magic[8];
+        unsigned char key_fp[BLAKE3_OUT_LEN];
+        bool valid = (fread(magic,1,8,fp) == 8) && (::memcmp(magic,TDC_MAGIC,8) == 0)
+                  && (fread(key_fp,1,BLAKE3_OUT_LEN,fp) == BLAKE3_OUT_LEN)
+                  && (::memcmp(key_fp,TC.key_fp,BLAKE3_OUT_LEN) == 0);
+        if(valid){
+            n_records = TrapdoorCache_ReadJournal(TC, fp);
+        }
+        fclose(fp);
+    }
+
+    //The records are client-secret, so the file is owner-only from creation
+    int fd;
+    if(TC.entries.empty()){
+        if((unlink(journal_file.c_str()) != 0) && (errno != ENOENT)){
+            std::cerr << "Cannot replace trapdoor journal file " << journal_file << std::endl;
+            return -1;
+        }
+        fd = open(journal_file.c_str(), O_WRONLY|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR);
+    }
+    else{
+        fd = open(journal_file.c_str(), O_WRONLY);
+        if((fd >= 0) && ((fchmod(fd, S_IRUSR|S_IWUSR) != 0) || (ftruncate(fd, TDC_HEADER_BYTES + n_records*TDC_RECORD_BYTES) != 0)
+                         || (lseek(fd, 0, SEEK_END) < 0))){
+            close(fd);
+            fd = -1;
+        }
+    }
+    if((fd < 0) || ((TC.journal = fdopen(fd,"wb")) == NULL)){
+        std::cerr << "Cannot open trapdoor journal file " << journal_file << std::endl;
+        if(fd >= 0) close(fd);
+        return -1;
+    }
+
+    if(TC.entries.empty()){
+        if((fwrite(TDC_MAGIC,1,8,TC.journal) != 8) || (fwrite(TC.key_fp,1,BLAKE3_OUT_LEN,TC.journal) != BLAKE3_OUT_LEN)){
+            TrapdoorCache_StopJournal(TC);
+        }
+    }
+    else{
+        std::cout << "Loaded " << TC.entries.size() << " cached trapdoors from " << journal_file << std::endl;
+    }
+
+    return 0;
+}
+
+int TrapdoorCache_Lookup(TrapdoorCache &TC, const unsigned char *id, const TrapdoorEntry **entry)
+{
+    auto it = TC.entries.find(std::string(reinterpret_cast<const char *>(id),16));
+    if(it == TC.entries.end()){
+        TC.n_misses++;
+        *entry = nullptr;
+        return 1;
+    }
+    TC.n_hits++;
+    *entry = &(it->second);
+    return 0;
+}
+
+int TrapdoorCache_Insert(TrapdoorCache &TC, const unsigned char *id, const TrapdoorEntry &entry, const TrapdoorEntry **stored)
+{
+    auto res = TC.entries.emplace(std::string(reinterpret_cast<const char *>(id),16), entry);
+
+    if(res.second){
+        TC.n_inserted++;
+    }
+    if(res.second && (TC.journal != NULL)){
+        unsigned char checksum[BLAKE3_OUT_LEN];
+        TrapdoorCache_Checksum(id, entry, checksum);
+        if((fwrite(id,1,16,TC.journal) != 16) || (fwrite(&entry,sizeof(TrapdoorEntry),1,TC.journal) != 1)
+           || (fwrite(checksum,1,BLAKE3_OUT_LEN,TC.journal) != BLAKE3_OUT_LEN)){
+            TrapdoorCache_StopJournal(TC);
+        }
+    }
+
+    if(stored != nullptr){
+        *stored = &(res.first->second);
+    }
+    return 0;
+}
+
+int TrapdoorCache_Clean(TrapdoorCache &TC)
+{
+    if((TC.journal != NULL) && (fclose(TC.journal) != 0)){
+        std::cerr << "Cannot write the trapdoor journal file; its last records are dropped on reload" << std::endl;
+    }
+    TC.journal = NULL;
+    TC.entries.clear();
+    return 0;
+}
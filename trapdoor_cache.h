@@ -0,0 +1,41 @@
+#ifndef TRAPDOORCACHE_H
+#define TRAPDOORCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include "utils.h"
+#include "./blake3/blake3.h"
+
+#define TDC_MAGIC "OQXTTDC2"
+
+/*
+ * Per-ID trapdoor material. The Falcon preimage s2 of H(id) and xid = s2.h
+ * depend only on the ID and the client key, so setup computes them once per
+ * distinct ID and reuses them for every keyword the ID appears under. All
+ * entries stay in memory for the whole run (about 5 KiB per ID). The
+ * optional journal file is a persistence journal, not a spill: each new
+ * entry is appended to it so a later run under the same key reloads it
+ * instead of signing again.
+ */
+typedef struct {
+    int16_t s2[N_l];
+    uint64_t xid[N_l];                      //s2.h mod (2^q_l_bits, x^N_l + 1)
+} TrapdoorEntry;
+
+typedef struct {
+    std::unordered_map<std::string, TrapdoorEntry> entries;   //16B ID -> entry
+    unsigned char key_fp[BLAKE3_OUT_LEN];   //Fingerprint of the public key the entries belong to
+    FILE *journal;                          //Append-only persistence journal, NULL when disabled
+    unsigned long n_hits;
+    unsigned long n_misses;
+    unsigned long n_inserted;               //Entries added this run, excluding those reloaded from the journal
+} TrapdoorCache;
+
+int TrapdoorCache_Init(TrapdoorCache &TC, const uint16_t *h, std::string journal_file = "");
+int TrapdoorCache_Lookup(TrapdoorCache &TC, const unsigned char *id, const TrapdoorEntry **entry);
+int TrapdoorCache_Insert(TrapdoorCache &TC, const unsigned char *id, const TrapdoorEntry &entry, const TrapdoorEntry **stored = nullptr);
+int TrapdoorCache_Clean(TrapdoorCache &TC);
+
+#endif // TRAPDOORCACHE_H
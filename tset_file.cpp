@@ -0,0 +1,212 @@
+#include "tset_file.h"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(TSetFileHeader) == 64, "TSet file header must stay 64 bytes");
+static_assert(sizeof(TSetFileSlot) == 32, "TSet file slots must pack two per cache line");
+
+static inline uint64_t TSetFile_Hash(const unsigned char *key)
+{
+    // Labels are hash outputs already; fold in bidx/jidx so colliding labels still spread
+    uint64_t lbl, ij;
+    uint32_t bj;
+    ::memcpy(&lbl,key+4,8);
+    ::memcpy(&bj,key,4);
+    ij = (uint64_t)bj * 0x9e3779b97f4a7c15ULL;
+    return lbl ^ ij ^ (ij >> 29);
+}
+
+static inline uint64_t TSetFile_Find(const TSetFileSlot *slots, uint64_t n_slots, const unsigned char *key)
+{
+    // Slot holding key, or the empty slot ending its probe sequence
+    uint64_t i = TSetFile_Hash(key) & (n_slots - 1);
+    while(slots[i].used && (::memcmp(slots[i].key,key,TSET_KEY_BYTES) != 0)){
+        i = (i + 1) & (n_slots - 1);
+    }
+    return i;
+}
+
+int TSetFile_Create(TSetFile &TF, std::string tset_file)
+{
+    TSetFile_Clean(TF);
+    TF.path = tset_file;
+    std::string tmp_file = tset_file + ".tmp";
+    TF.fp = fopen(tmp_file.c_str(),"wb");
+    if(TF.fp == NULL){
+        std::cerr << "Cannot open TSet file " << tmp_file << std::endl;
+        return -1;
+    }
+    TSetFileHeader hdr;
+    ::memset(&hdr,0x00,sizeof(hdr));
+    if(fwrite(&hdr,sizeof(hdr),1,TF.fp) != 1){
+        return -1;
+    }
+    return 0;
+}
+
+int TSetFile_Put(TSetFile &TF, const std::string &key, const std::string &val)
+{
+    if((TF.fp == NULL) || (key.size() != TSET_KEY_BYTES)){
+        return -1;
+    }
+    if(fwrite(val.data(),1,val.size(),TF.fp) != val.size()){
+        return -1;
+    }
+    TSetFileSlot slot;
+    ::memcpy(slot.key,key.data(),TSET_KEY_BYTES);
+    slot.offset = TF.data_bytes;
+    slot.len = (uint32_t)val.size();
+    slot.used = 1;
+    TF.pending.push_back(slot);
+    TF.data_bytes += val.size();
+    return 0;
+}
+
+int TSetFile_Finish(TSetFile &TF, unsigned int format, unsigned int layout, unsigned int chunk_ids)
+{
+    if(TF.fp == NULL){
+        return -1;
+    }
+    uint64_t n_slots = TSET_FILE_MIN_SLOTS;
+    while(n_slots < 2*TF.pending.size()){
+        n_slots <<= 1;
+    }
+
+    //A later put of the same key replaces the earlier one, as a Redis SET would
+    std::vector<TSetFileSlot> table(n_slots);
+    ::memset(table.data(),0x00,n_slots*sizeof(TSetFileSlot));
+    uint64_t n_entries = 0;
+    for(size_t p=0;p<TF.pending.size();++p){
+        uint64_t i = TSetFile_Find(table.data(), n_slots, TF.pending[p].key);
+        n_entries += !table[i].used;
+        table[i] = TF.pending[p];
+    }
+
+    uint64_t table_offset = (sizeof(TSetFileHeader) + TF.data_bytes + 63) & ~(uint64_t)63;
+    static const unsigned char pad[64] = {0};
+    size_t n_pad = table_offset - sizeof(TSetFileHeader) - TF.data_bytes;
+
+    TSetFileHeader hdr;
+    ::memset(&hdr,0x00,sizeof(hdr));
+    ::memcpy(hdr.magic,TSET_FILE_MAGIC,8);
+    hdr.version = TSET_FILE_VERSION;
+    hdr.format = format;
+    hdr.layout = layout;
+    hdr.chunk_ids = chunk_ids;
+    hdr.n_slots = n_slots;
+    hdr.n_entries = n_entries;
+    hdr.data_bytes = TF.data_bytes;
+    hdr.table_offset = table_offset;
+
+    bool ok = (fwrite(pad,1,n_pad,TF.fp) == n_pad)
+           && (fwrite(table.data(),sizeof(TSetFileSlot),n_slots,TF.fp) == n_slots)
+           && (fseek(TF.fp,0,SEEK_SET) == 0)
+           && (fwrite(&hdr,sizeof(hdr),1,TF.fp) == 1);
+    ok = (fclose(TF.fp) == 0) && ok;
+    TF.fp = NULL;
+    TF.pending.clear();
+    TF.pending.shrink_to_fit();
+
+    std::string tmp_file = TF.path + ".tmp";
+    if(!ok || (rename(tmp_file.c_str(),TF.path.c_str()) != 0)){
+        std::cerr << "Cannot write TSet file " << TF.path << std::endl;
+        unlink(tmp_file.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int TSetFile_Open(TSetFile &TF, std::string tset_file)
+{
+    TSetFile_Clean(TF);
+
+    int fd = open(tset_file.c_str(), O_RDONLY);
+    if(fd < 0){
+        std::cerr << "Cannot open TSet file " << tset_file << std::endl;
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd,&st) != 0){
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        std::cerr << "Cannot map TSet file " << tset_file << std::endl;
+        return -1;
+    }
+
+    const TSetFileHeader *hdr = (const TSetFileHeader *)map;
+    bool valid = ((size_t)st.st_size >= sizeof(TSetFileHeader))
+              && (::memcmp(hdr->magic,TSET_FILE_MAGIC,8) == 0) && (hdr->version == TSET_FILE_VERSION)
+              && (hdr->n_slots >= TSET_FILE_MIN_SLOTS) && ((hdr->n_slots & (hdr->n_slots - 1)) == 0)
+              && (hdr->table_offset >= sizeof(TSetFileHeader) + hdr->data_bytes) && ((hdr->table_offset & 63) == 0)
+              && ((uint64_t)st.st_size == hdr->table_offset + hdr->n_slots*sizeof(TSetFileSlot));
+    if(!valid){
+        std::cerr << "TSet file " << tset_file << " has an invalid header or size" << std::endl;
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    TF.format = hdr->format;
+    TF.layout = hdr->layout;
+    TF.chunk_ids = hdr->chunk_ids;
+    TF.n_slots = hdr->n_slots;
+    TF.n_entries = hdr->n_entries;
+    TF.data = (const unsigned char *)map + sizeof(TSetFileHeader);
+    TF.data_bytes = hdr->data_bytes;
+    TF.slots = (const TSetFileSlot *)((const unsigned char *)map + hdr->table_offset);
+    TF.map = map;
+    TF.map_len = st.st_size;
+    return 0;
+}
+
+void TSetFile_Prefetch(const TSetFile &TF, const std::string &key)
+{
+    if(key.size() == TSET_KEY_BYTES){
+        __builtin_prefetch(TF.slots + (TSetFile_Hash((const unsigned char *)key.data()) & (TF.n_slots - 1)), 0, 1);
+    }
+}
+
+int TSetFile_Get(const TSetFile &TF, const std::string &key, const unsigned char **val, uint32_t *len)
+{
+    if((TF.slots == nullptr) || (key.size() != TSET_KEY_BYTES)){
+        return -1;
+    }
+    const TSetFileSlot &slot = TF.slots[TSetFile_Find(TF.slots, TF.n_slots, (const unsigned char *)key.data())];
+    if(!slot.used || (slot.offset + slot.len > TF.data_bytes)){
+        return -1;
+    }
+    *val = TF.data + slot.offset;
+    *len = slot.len;
+    return 0;
+}
+
+int TSetFile_Clean(TSetFile &TF)
+{
+    if(TF.fp != NULL){
+        fclose(TF.fp);
+        unlink((TF.path + ".tmp").c_str());
+    }
+    if(TF.map != NULL){
+        munmap(TF.map, TF.map_len);
+    }
+    TF.format = 0;
+    TF.layout = 0;
+    TF.chunk_ids = 0;
+    TF.n_slots = 0;
+    TF.n_entries = 0;
+    TF.slots = nullptr;
+    TF.data = nullptr;
+    TF.map = NULL;
+    TF.map_len = 0;
+    TF.fp = NULL;
+    TF.pending.clear();
+    TF.data_bytes = 0;
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef TSETFILE_H
+#define TSETFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "tset_format.h"
+
+#define TSET_FILE_MAGIC "OQXTTS01"
+#define TSET_FILE_VERSION 1
+#define TSET_FILE_MIN_SLOTS 64
+
+/*
+ * Local TSet backend: a flat open-addressed hash file over 16-byte binary
+ * TSet keys (bidx | jidx | label), built in bulk by setup and mapped
+ * read-only by search. Layout: this 64B header, the values back to back,
+ * then a power-of-two table of 32B slots (64B-aligned) probed linearly
+ * from the label bits. The table is kept at most half full.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;                        //TSET_FORMAT_* of the stored entries (always binary keys)
+    uint32_t layout;                        //TSET_LAYOUT_*
+    uint32_t chunk_ids;
+    uint64_t n_slots;
+    uint64_t n_entries;
+    uint64_t data_bytes;
+    uint64_t table_offset;
+    uint64_t reserved;
+} TSetFileHeader;
+
+typedef struct {
+    unsigned char key[TSET_KEY_BYTES];
+    uint64_t offset;                        //From the start of the value region
+    uint32_t len;
+    uint32_t used;
+} TSetFileSlot;
+
+typedef struct {
+    uint32_t format;
+    uint32_t layout;
+    uint32_t chunk_ids;
+    uint64_t n_slots;
+    uint64_t n_entries;
+    const TSetFileSlot *slots;
+    const unsigned char *data;
+    void *map;
+    size_t map_len;
+    FILE *fp;                               //Build: values are streamed here, slots kept until TSetFile_Finish
+    std::string path;
+    std::vector<TSetFileSlot> pending;
+    uint64_t data_bytes;
+} TSetFile;
+
+int TSetFile_Create(TSetFile &TF, std::string tset_file);
+int TSetFile_Put(TSetFile &TF, const std::string &key, const std::string &val);
+int TSetFile_Finish(TSetFile &TF, unsigned int format, unsigned int layout, unsigned int chunk_ids);
+int TSetFile_Open(TSetFile &TF, std::string tset_file);
+void TSetFile_Prefetch(const TSetFile &TF, const std::string &key);
+int TSetFile_Get(const TSetFile &TF, const std::string &key, const unsigned char **val, uint32_t *len);
+int TSetFile_Clean(TSetFile &TF);
+
+#endif // TSETFILE_H
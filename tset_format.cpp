@@ -0,0 +1,167 @@
+#include "tset_format.h"
+#include <cstring>
+#include <iostream>
+
+static const char TSET_HEX_DIGITS[] = "0123456789abcdef";
+
+static inline void TSet_HexAppend(std::string &out, const unsigned char *in, size_t n_bytes)
+{
+    size_t off = out.size();
+    out.resize(off + 2*n_bytes);
+    for(size_t i=0;i<n_bytes;++i){
+        out[off+2*i] = TSET_HEX_DIGITS[in[i] >> 4];
+        out[off+2*i+1] = TSET_HEX_DIGITS[in[i] & 0x0F];
+    }
+}
+
+static inline int TSet_HexNibble(char c)
+{
+    if((c >= '0') && (c <= '9')) return c - '0';
+    if((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+static std::string TSetFormat_Name(unsigned int format, unsigned int layout, unsigned int chunk_ids)
+{
+    // Entry-layout names are those of stores written before chunking existed
+    std::string name = (format == TSET_FORMAT_BINARY) ? "binary" : "hex";
+    if(layout == TSET_LAYOUT_CHUNKED){
+        name += ":chunk" + std::to_string(chunk_ids);
+    }
+    return name;
+}
+
+int TSetFormat_Key(unsigned int format, const unsigned char *bidx, const unsigned char *jidx, const unsigned char *lbl, std::string &key)
+{
+    key.clear();
+    if(format == TSET_FORMAT_BINARY){
+        key.resize(TSET_KEY_BYTES);
+        ::memcpy(&key[0],bidx,2);
+        ::memcpy(&key[2],jidx,2);
+        ::memcpy(&key[4],lbl,12);
+        return 0;
+    }
+    key.reserve(2*TSET_KEY_BYTES);
+    TSet_HexAppend(key, bidx, 2);
+    TSet_HexAppend(key, jidx, 2);
+    TSet_HexAppend(key, lbl, 12);
+    return 0;
+}
+
+int TSetFormat_Value(unsigned int format, const unsigned char *val, size_t n_bytes, std::string &out)
+{
+    out.clear();
+    if(format == TSET_FORMAT_BINARY){
+        out.assign(reinterpret_cast<const char *>(val), n_bytes);
+        return 0;
+    }
+    TSet_HexAppend(out, val, n_bytes);
+    return 0;
+}
+
+int TSetFormat_DecodeValue(unsigned int format, const std::string &in, unsigned char *val, size_t n_bytes)
+{
+    if(format == TSET_FORMAT_BINARY){
+        if(in.size() != n_bytes){
+            return -1;
+        }
+        ::memcpy(val,in.data(),n_bytes);
+        return 0;
+    }
+    if(in.size() != 2*n_bytes){
+        return -1;
+    }
+    for(size_t i=0;i<n_bytes;++i){
+        int hi = TSet_HexNibble(in[2*i]);
+        int lo = TSet_HexNibble(in[2*i+1]);
+        if((hi < 0) || (lo < 0)){
+            return -1;
+        }
+        val[i] = (unsigned char)((hi << 4) | lo);
+    }
+    return 0;
+}
+
+int TSetFormat_KeyBucket(const std::string &key, unsigned int *bucket)
+{
+    // The 2-byte bucket index of a key in either format, as setup's FreeB index
+    unsigned char bidx[2];
+    if(key.size() == TSET_KEY_BYTES){
+        ::memcpy(bidx,key.data(),2);
+    }
+    else if((key.size() != 2*TSET_KEY_BYTES) || (TSetFormat_DecodeValue(TSET_FORMAT_HEX, key.substr(0,4), bidx, 2) != 0)){
+        return -1;
+    }
+    *bucket = (bidx[1] << 8) + bidx[0];
+    return 0;
+}
+
+size_t TSetFormat_ValueBytes(unsigned int format, const std::string &in)
+{
+    return (format == TSET_FORMAT_BINARY) ? in.size() : in.size()/2;
+}
+
+size_t TSetChunk_Pack(unsigned char *out, bool last, const unsigned char *records, unsigned int n_records, unsigned int record_bytes)
+{
+    out[0] = last ? 0x01 : 0x00;
+    out[1] = n_records & 0xFF;
+    out[2] = (n_records >> 8) & 0xFF;
+    ::memcpy(out+TSET_CHUNK_HEADER_BYTES,records,(size_t)n_records*record_bytes);
+    return TSET_CHUNK_HEADER_BYTES + (size_t)n_records*record_bytes;
+}
+
+int TSetChunk_Unpack(const unsigned char *in, size_t n_bytes, unsigned int record_bytes, bool *last, unsigned int *n_records)
+{
+    if(n_bytes < TSET_CHUNK_HEADER_BYTES){
+        return -1;
+    }
+    *last = (in[0] == 0x01);
+    *n_records = in[1] | ((unsigned int)in[2] << 8);
+    return (n_bytes == TSET_CHUNK_HEADER_BYTES + (size_t)(*n_records)*record_bytes) ? 0 : -1;
+}
+
+int TSetFormat_Mark(sw::redis::Redis &redis, unsigned int format, unsigned int layout, unsigned int chunk_ids)
+{
+    try{
+        redis.set(TSET_FORMAT_KEY, TSetFormat_Name(format, layout, chunk_ids));
+    }
+    catch(const std::exception &e){
+        std::cerr << "Cannot record the TSet format: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int TSetFormat_Clear(sw::redis::Redis &redis)
+{
+    try{
+        redis.del(TSET_FORMAT_KEY);
+    }
+    catch(const std::exception &e){
+        std::cerr << "Cannot clear the TSet format: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int TSetFormat_Check(sw::redis::Redis &redis, unsigned int format, unsigned int layout, unsigned int chunk_ids)
+{
+    std::string expected = TSetFormat_Name(format, layout, chunk_ids);
+    std::string stored = TSetFormat_Name(TSET_FORMAT_HEX, TSET_LAYOUT_ENTRY, 0);
+    try{
+        auto val = redis.get(TSET_FORMAT_KEY);
+        if(val){
+            stored = *val;
+        }
+    }
+    catch(const std::exception &e){
+        std::cerr << "Cannot read the TSet format: " << e.what() << std::endl;
+        return -1;
+    }
+    if(stored != expected){
+        std::cerr << "TSet was stored in " << stored << " format, search expects " << expected << std::endl;
+        return -1;
+    }
+    return 0;
+}
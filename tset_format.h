@@ -0,0 +1,38 @@
+#ifndef TSETFORMAT_H
+#define TSETFORMAT_H
+
+#include <cstddef>
+#include <string>
+#include </usr/local/include/sw/redis++/redis++.h>
+
+#define TSET_FORMAT_HEX 0                   //Lower-case hex text: 32-char keys, 2 chars per value byte
+#define TSET_FORMAT_BINARY 1                //Raw bytes: 16-byte keys, values stored as is
+
+#define TSET_KEY_BYTES 16                   //bidx(2) | jidx(2) | label(12)
+#define TSET_FORMAT_KEY "OQXT:TSET:FORMAT"  //Marker written by setup; absent on stores predating it (hex)
+
+#define TSET_LAYOUT_ENTRY 0                 //One key per (keyword, id): flag byte | record
+#define TSET_LAYOUT_CHUNKED 1               //One key per chunk of consecutive records of a keyword
+#define TSET_CHUNK_HEADER_BYTES 3           //flag(1) | record count(2, little-endian)
+#define TSET_CHUNK_MAX_IDS 65535
+
+/*
+ * Encoding of TSet entries in Redis, shared by setup and search so both
+ * agree on the byte layout. Hex output is identical to the former
+ * HexToStr encoding; the binary format halves memory and network bytes.
+ * In the chunked layout chunk c of a keyword is stored under the label
+ * setup would give id c, and carries up to chunk_ids records; the flag
+ * byte is set on the keyword's last chunk.
+ */
+int TSetFormat_Key(unsigned int format, const unsigned char *bidx, const unsigned char *jidx, const unsigned char *lbl, std::string &key);
+int TSetFormat_Value(unsigned int format, const unsigned char *val, size_t n_bytes, std::string &out);
+int TSetFormat_DecodeValue(unsigned int format, const std::string &in, unsigned char *val, size_t n_bytes);
+int TSetFormat_KeyBucket(const std::string &key, unsigned int *bucket);
+size_t TSetFormat_ValueBytes(unsigned int format, const std::string &in);
+size_t TSetChunk_Pack(unsigned char *out, bool last, const unsigned char *records, unsigned int n_records, unsigned int record_bytes);
+int TSetChunk_Unpack(const unsigned char *in, size_t n_bytes, unsigned int record_bytes, bool *last, unsigned int *n_records);
+int TSetFormat_Mark(sw::redis::Redis &redis, unsigned int format, unsigned int layout, unsigned int chunk_ids);
+int TSetFormat_Clear(sw::redis::Redis &redis);
+int TSetFormat_Check(sw::redis::Redis &redis, unsigned int format, unsigned int layout, unsigned int chunk_ids);
+
+#endif // TSETFORMAT_H
@@ -0,0 +1,541 @@
+#include "tset_store.h"
+#include "redis_pool.h"
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <future>
+#include <utility>
+
+// KEYS: labels in list order. ARGV[1]: "hex" or "binary". Returns the values up to and
+// including the first whose flag byte is set, or up to the first missing key
+static const char TSET_WALK_SCRIPT[] =
+    "local hex = (ARGV[1] == 'hex')\n"
+    "local out = {}\n"
+    "for i = 1, #KEYS do\n"
+    "  local v = redis.call('GET', KEYS[i])\n"
+    "  if not v then break end\n"
+    "  out[#out+1] = v\n"
+    "  local last\n"
+    "  if hex then last = (string.sub(v, 1, 2) == '01') else last = (string.byte(v, 1) == 1) end\n"
+    "  if last then break end\n"
+    "end\n"
+    "return out\n";
+
+static inline bool TSetStore_EndsList(unsigned int format, const std::string &val)
+{
+    if(format == TSET_FORMAT_BINARY){
+        return !val.empty() && (val[0] == 0x01);
+    }
+    return (val.size() >= 2) && (val[0] == '0') && (val[1] == '1');
+}
+
+static inline uint64_t TSetStore_Mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static int TSetStore_BuildRing(TSetStore &TS)
+{
+    // Adding or removing one shard moves only about 1/n of the buckets
+    std::vector<std::pair<uint32_t, uint16_t>> ring;
+    for(size_t sh=0;sh<TS.shards.size();++sh){
+        for(unsigned int v=0;v<TSET_RING_VNODES;++v){
+            ring.push_back(std::make_pair((uint32_t)(TSetStore_Mix((sh << 32) | v) >> 32), (uint16_t)sh));
+        }
+    }
+    std::sort(ring.begin(), ring.end());
+
+    TS.bucket_shard.resize(TSET_BUCKETS);
+    for(unsigned int b=0;b<TSET_BUCKETS;++b){
+        uint32_t h = (uint32_t)(TSetStore_Mix(0x5453455442554b54ULL ^ b) >> 32);
+        auto it = std::lower_bound(ring.begin(), ring.end(), std::make_pair(h, (uint16_t)0));
+        TS.bucket_shard[b] = (it == ring.end()) ? ring[0].second : it->second;
+    }
+    return 0;
+}
+
+static int TSetStore_Route(const TSetStore &TS, const std::string &key)
+{
+    unsigned int bucket;
+    if(TSetFormat_KeyBucket(key, &bucket) != 0){
+        return -1;
+    }
+    return TS.bucket_shard[bucket];
+}
+
+static size_t TSetStore_PickReplica(TSetStore &TS)
+{
+    size_t n = TS.replicas.size();
+    size_t best = TS.replica_next.fetch_add(1, std::memory_order_relaxed) % n;
+    int best_load = TS.replica_load[best].load(std::memory_order_relaxed);
+    for(size_t i=1;(i<n) && (best_load > 0);++i){
+        size_t r = (best + i) % n;
+        int load = TS.replica_load[r].load(std::memory_order_relaxed);
+        if(load < best_load){
+            best = r;
+            best_load = load;
+        }
+    }
+    TS.replica_load[best].fetch_add(1, std::memory_order_relaxed);
+    return best;
+}
+
+static void TSetShardReader_Run(TSetShardReader *SR)
+{
+    for(;;){
+        std::packaged_task<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(SR->lock);
+            SR->wake.wait(lock, [SR](){ return SR->stop || !SR->jobs.empty(); });
+            if(SR->jobs.empty()){
+                return;
+            }
+            job = std::move(SR->jobs.front());
+            SR->jobs.pop_front();
+        }
+        job();
+    }
+}
+
+static std::future<void> TSetShardReader_Submit(TSetShardReader &SR, std::packaged_task<void()> job)
+{
+    std::future<void> done = job.get_future();
+    {
+        std::lock_guard<std::mutex> lock(SR.lock);
+        SR.jobs.push_back(std::move(job));
+    }
+    SR.wake.notify_one();
+    return done;
+}
+
+static int TSetStore_StopReaders(TSetStore &TS)
+{
+    for(auto &SR:TS.shard_readers){
+        {
+            std::lock_guard<std::mutex> lock(SR.lock);
+            SR.stop = true;
+        }
+        SR.wake.notify_one();
+        SR.thread.join();
+    }
+    TS.shard_readers.clear();
+    return 0;
+}
+
+static int TSetStore_ShardMGet(sw::redis::Redis *redis, size_t sh, const std::vector<std::string> &keys, std::vector<sw::redis::OptionalString> &out)
+{
+    try{
+        redis->mget(keys.begin(), keys.end(), std::back_inserter(out));
+    }
+    catch(const std::exception &e){
+        std::cerr << "TSet read from shard " << sh << " failed: " << e.what() << std::endl;
+        out.clear();
+        return -1;
+    }
+    return 0;
+}
+
+static int TSetStore_OpenShards(TSetStore &TS)
+{
+    TS.shards.clear();
+    for(size_t sh=0;sh<RedisPool_NumShards();++sh){
+        TS.shards.push_back(&RedisPool_Shard(sh));
+    }
+    if(TS.shards.empty() || (TS.shards.size() > 65536)){
+        std::cerr << "Sharded TSet needs 1..65536 Redis shards, " << TS.shards.size() << " configured" << std::endl;
+        return -1;
+    }
+    return TSetStore_BuildRing(TS);
+}
+
+const char *TSetStore_Name(unsigned int type)
+{
+    switch(type){
+        case TSET_STORE_FILE:
+            return "file";
+        case TSET_STORE_SHARDED:
+            return "sharded redis";
+        default:
+            return "redis";
+    }
+}
+
+int TSetStore_OpenWrite(TSetStore &TS, unsigned int type, std::string tset_file, size_t batch_entries, unsigned int max_inflight)
+{
+    TS.type = type;
+    TS.n_written = 0;
+    TS.n_failed = 0;
+    if(type == TSET_STORE_FILE){
+        TS.redis = nullptr;
+        return TSetFile_Create(TS.file, tset_file);
+    }
+    if(type == TSET_STORE_SHARDED){
+        TS.redis = nullptr;
+        if(TSetStore_OpenShards(TS) != 0){
+            return -1;
+        }
+        //Drop the markers of any earlier run first, so a half-written store never passes TSetStore_Check
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            if(TSetFormat_Clear(*TS.shards[sh]) != 0){
+                return -1;
+            }
+            try{
+                TS.shards[sh]->del(TSET_SHARDS_KEY);
+            }
+            catch(const std::exception &e){
+                std::cerr << "Cannot clear TSet shard " << sh << ": " << e.what() << std::endl;
+                return -1;
+            }
+        }
+        TS.shard_writers.resize(TS.shards.size());
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            TSetWriter_Init(TS.shard_writers[sh], *TS.shards[sh], batch_entries, max_inflight);
+        }
+        return 0;
+    }
+    TS.redis = &RedisPool_Get();
+    if(TSetFormat_Clear(*TS.redis) != 0){
+        return -1;
+    }
+    return TSetWriter_Init(TS.writer, *TS.redis, batch_entries, max_inflight);
+}
+
+int TSetStore_Put(TSetStore &TS, const std::string &key, const std::string &val)
+{
+    if(TS.type == TSET_STORE_FILE){
+        if(TSetFile_Put(TS.file, key, val) != 0){
+            TS.n_failed++;
+            return -1;
+        }
+        TS.n_written++;
+        return 0;
+    }
+    if(TS.type == TSET_STORE_SHARDED){
+        int sh = TSetStore_Route(TS, key);
+        if(sh < 0){
+            TS.n_failed++;
+            return -1;
+        }
+        return TSetWriter_Put(TS.shard_writers[sh], key, val);
+    }
+    return TSetWriter_Put(TS.writer, key, val);
+}
+
+int TSetStore_Finish(TSetStore &TS, unsigned int format, unsigned int layout, unsigned int chunk_ids)
+{
+    // Completes every write, then records the format; -1 if any entry was lost
+    if(TS.type == TSET_STORE_FILE){
+        if(TSetFile_Finish(TS.file, format, layout, chunk_ids) != 0){
+            TS.n_failed += TS.n_written;
+            TS.n_written = 0;
+        }
+        return (TS.n_failed == 0) ? 0 : -1;
+    }
+    if(TS.type == TSET_STORE_SHARDED){
+        //Drain every shard before checking, so one failing shard does not leave others in flight
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            TSetWriter_Flush(TS.shard_writers[sh]);
+            TS.n_written += TS.shard_writers[sh].n_written;
+            TS.n_failed += TS.shard_writers[sh].n_failed;
+        }
+        if(TS.n_failed != 0){
+            return -1;
+        }
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            if(TSetFormat_Mark(*TS.shards[sh], format, layout, chunk_ids) != 0){
+                return -1;
+            }
+            try{
+                TS.shards[sh]->set(TSET_SHARDS_KEY, std::to_string(sh) + "/" + std::to_string(TS.shards.size()));
+            }
+            catch(const std::exception &e){
+                std::cerr << "Cannot record TSet shard " << sh << ": " << e.what() << std::endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+    int status = TSetWriter_Flush(TS.writer);
+    TS.n_written = TS.writer.n_written;
+    TS.n_failed = TS.writer.n_failed;
+    if(status != 0){
+        return -1;
+    }
+    return TSetFormat_Mark(*TS.redis, format, layout, chunk_ids);
+}
+
+int TSetStore_OpenRead(TSetStore &TS, unsigned int type, std::string tset_file)
+{
+    TS.type = type;
+    if(type == TSET_STORE_FILE){
+        TS.redis = nullptr;
+        return TSetFile_Open(TS.file, tset_file);
+    }
+    if(type == TSET_STORE_SHARDED){
+        TS.redis = nullptr;
+        if(TSetStore_OpenShards(TS) != 0){
+            return -1;
+        }
+        TSetStore_StopReaders(TS);
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            TS.shard_readers.emplace_back();
+            TSetShardReader &SR = TS.shard_readers.back();
+            SR.stop = false;
+            SR.thread = std::thread(TSetShardReader_Run, &SR);
+        }
+        return 0;
+    }
+    TS.redis = &RedisPool_Get();
+    TS.replicas.clear();
+    for(size_t r=0;r<RedisPool_NumReplicas();++r){
+        TS.replicas.push_back(&RedisPool_Replica(r));
+    }
+    TS.replica_load.reset(new std::atomic<int>[TS.replicas.size() + 1]);
+    for(size_t r=0;r<TS.replicas.size();++r){
+        TS.replica_load[r].store(0);
+    }
+    TS.replica_next.store(0);
+    return 0;
+}
+
+int TSetStore_Check(TSetStore &TS, unsigned int format, unsigned int layout, unsigned int chunk_ids)
+{
+    if(TS.type == TSET_STORE_SHARDED){
+        //A reordered or resized shard list would route buckets to the wrong instances
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            if(TSetFormat_Check(*TS.shards[sh], format, layout, chunk_ids) != 0){
+                return -1;
+            }
+            std::string expected = std::to_string(sh) + "/" + std::to_string(TS.shards.size());
+            try{
+                auto stored = TS.shards[sh]->get(TSET_SHARDS_KEY);
+                if(!stored || (*stored != expected)){
+                    std::cerr << "TSet shard " << sh << " holds " << (stored ? *stored : std::string("no shard record")) << ", expected " << expected << std::endl;
+                    return -1;
+                }
+            }
+            catch(const std::exception &e){
+                std::cerr << "Cannot read TSet shard " << sh << ": " << e.what() << std::endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if(TS.type != TSET_STORE_FILE){
+        //Setup deletes the marker before its first put and writes it last, so a replica holding it has replicated the whole TSet
+        for(size_t r=0;r<TS.replicas.size();++r){
+            if(TSetFormat_Check(*TS.replicas[r], format, layout, chunk_ids) != 0){
+                std::cerr << "TSet read replica " << r << " is not in sync with the primary" << std::endl;
+                return -1;
+            }
+        }
+        return TSetFormat_Check(*TS.redis, format, layout, chunk_ids);
+    }
+    bool match = (TS.file.format == format) && (TS.file.layout == layout)
+              && ((layout != TSET_LAYOUT_CHUNKED) || (TS.file.chunk_ids == chunk_ids));
+    if(!match){
+        std::cerr << "TSet file was built with format " << TS.file.format << ", layout " << TS.file.layout
+                  << ", chunk " << TS.file.chunk_ids << "; search expects " << format << ", " << layout << ", " << chunk_ids << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int TSetStore_MGet(TSetStore &TS, const std::vector<std::string> &keys, std::vector<sw::redis::OptionalString> &vals)
+{
+    vals.clear();
+    if(TS.type == TSET_STORE_SHARDED){
+        std::vector<std::vector<size_t>> slots(TS.shards.size());
+        std::vector<std::vector<std::string>> shard_keys(TS.shards.size());
+        vals.resize(keys.size());
+        for(size_t k=0;k<keys.size();++k){
+            int sh = TSetStore_Route(TS, keys[k]);
+            if(sh >= 0){
+                slots[sh].push_back(k);
+                shard_keys[sh].push_back(keys[k]);
+            }
+        }
+
+        //One MGET per shard on the shard readers, the first one on this thread; unroutable keys stay missing
+        std::vector<std::vector<sw::redis::OptionalString>> replies(TS.shards.size());
+        std::vector<int> shard_rc(TS.shards.size(), 0);
+        std::vector<std::future<void>> done;
+        size_t inline_shard = TS.shards.size();
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            if(shard_keys[sh].empty()){
+                continue;
+            }
+            if(inline_shard == TS.shards.size()){
+                inline_shard = sh;
+                continue;
+            }
+            sw::redis::Redis *redis = TS.shards[sh];
+            const std::vector<std::string> *sk = &shard_keys[sh];
+            std::vector<sw::redis::OptionalString> *out = &replies[sh];
+            int *rc = &shard_rc[sh];
+            done.push_back(TSetShardReader_Submit(TS.shard_readers[sh], std::packaged_task<void()>([redis, sh, sk, out, rc](){
+                *rc = TSetStore_ShardMGet(redis, sh, *sk, *out);
+            })));
+        }
+        if(inline_shard < TS.shards.size()){
+            shard_rc[inline_shard] = TSetStore_ShardMGet(TS.shards[inline_shard], inline_shard, shard_keys[inline_shard], replies[inline_shard]);
+        }
+        for(auto &d:done){
+            d.wait();
+        }
+        //A failed shard would otherwise read as missing keys and cut the list short
+        if(std::find(shard_rc.begin(), shard_rc.end(), -1) != shard_rc.end()){
+            vals.clear();
+            return -1;
+        }
+        for(size_t sh=0;sh<TS.shards.size();++sh){
+            for(size_t i=0;(i<replies[sh].size()) && (i<slots[sh].size());++i){
+                vals[slots[sh][i]] = std::move(replies[sh][i]);
+            }
+        }
+        return 0;
+    }
+    if(TS.type != TSET_STORE_FILE){
+        if(!TS.replicas.empty()){
+            size_t r = TSetStore_PickReplica(TS);
+            bool ok = true;
+            try{
+                TS.replicas[r]->mget(keys.begin(), keys.end(), std::back_inserter(vals));
+            }
+            catch(const std::exception &e){
+                std::cerr << "TSet read replica " << r << " failed, reading from the primary: " << e.what() << std::endl;
+                ok = false;
+            }
+            TS.replica_load[r].fetch_sub(1, std::memory_order_relaxed);
+            if(ok){
+                return 0;
+            }
+            vals.clear();
+        }
+        try{
+            TS.redis->mget(keys.begin(), keys.end(), std::back_inserter(vals));
+        }
+        catch(const std::exception &e){
+            std::cerr << "TSet read from the primary failed: " << e.what() << std::endl;
+            vals.clear();
+            return -1;
+        }
+        return 0;
+    }
+    vals.reserve(keys.size());
+    for(size_t k=0;k<keys.size();++k){
+        TSetFile_Prefetch(TS.file, keys[k]);
+    }
+    for(size_t k=0;k<keys.size();++k){
+        const unsigned char *val;
+        uint32_t len;
+        if(TSetFile_Get(TS.file, keys[k], &val, &len) == 0){
+            vals.emplace_back(std::string(reinterpret_cast<const char *>(val), len));
+        }
+        else{
+            vals.emplace_back();
+        }
+    }
+    return 0;
+}
+
+static void TSetStore_WalkOn(TSetStore &TS, sw::redis::Redis *redis, unsigned int format, const std::vector<std::string> &keys, std::vector<sw::redis::OptionalString> &vals)
+{
+    // The script SHA is that of its text, so one value serves the primary and every replica.
+    // Only NOSCRIPT (a restarted, flushed or never-loaded server) reloads; other errors throw
+    std::string sha;
+    {
+        std::lock_guard<std::mutex> lock(TS.walk_lock);
+        if(TS.walk_sha.empty()){
+            TS.walk_sha = redis->script_load(TSET_WALK_SCRIPT);
+        }
+        sha = TS.walk_sha;
+    }
+    std::vector<std::string> args(1, (format == TSET_FORMAT_BINARY) ? "binary" : "hex");
+    std::vector<std::string> out;
+    for(int attempt=0;;++attempt){
+        try{
+            redis->evalsha(sha, keys.begin(), keys.end(), args.begin(), args.end(), std::back_inserter(out));
+            break;
+        }
+        catch(const sw::redis::ReplyError &e){
+            if((attempt > 0) || (std::string(e.what()).compare(0, 8, "NOSCRIPT") != 0)){
+                throw;
+            }
+            out.clear();
+            redis->script_load(TSET_WALK_SCRIPT);
+        }
+    }
+    vals.clear();
+    for(size_t i=0;i<out.size();++i){
+        vals.emplace_back(std::move(out[i]));
+    }
+}
+
+int TSetStore_Walk(TSetStore &TS, unsigned int format, const std::vector<std::string> &keys, std::vector<sw::redis::OptionalString> &vals)
+{
+    if((TS.type != TSET_STORE_FILE) && (TS.type != TSET_STORE_SHARDED)){
+        if(!TS.replicas.empty()){
+            size_t r = TSetStore_PickReplica(TS);
+            bool ok = true;
+            try{
+                TSetStore_WalkOn(TS, TS.replicas[r], format, keys, vals);
+            }
+            catch(const std::exception &e){
+                std::cerr << "TSet walk on read replica " << r << " failed, walking on the primary: " << e.what() << std::endl;
+                ok = false;
+            }
+            TS.replica_load[r].fetch_sub(1, std::memory_order_relaxed);
+            if(ok){
+                return 0;
+            }
+        }
+        try{
+            TSetStore_WalkOn(TS, TS.redis, format, keys, vals);
+        }
+        catch(const std::exception &e){
+            std::cerr << "TSet walk on the primary failed: " << e.what() << std::endl;
+            vals.clear();
+            return -1;
+        }
+        return 0;
+    }
+
+    //Stores without a server-side walk: fetch everything and cut the list here
+    if(TSetStore_MGet(TS, keys, vals) != 0){
+        return -1;
+    }
+    for(size_t k=0;k<vals.size();++k){
+        if(!vals[k]){
+            vals.resize(k);
+            break;
+        }
+        if(TSetStore_EndsList(format, *vals[k])){
+            vals.resize(k+1);
+            break;
+        }
+    }
+    return 0;
+}
+
+int TSetStore_Clean(TSetStore &TS)
+{
+    if(TS.type != TSET_STORE_FILE){
+        TSetWriter_Clean(TS.writer);
+    }
+    for(size_t sh=0;sh<TS.shard_writers.size();++sh){
+        TSetWriter_Clean(TS.shard_writers[sh]);
+    }
+    TS.shard_writers.clear();
+    TSetStore_StopReaders(TS);
+    TS.shards.clear();
+    TS.replicas.clear();
+    TS.replica_load.reset();
+    TS.walk_sha.clear();
+    TSetFile_Clean(TS.file);
+    TS.redis = nullptr;
+    return 0;
+}
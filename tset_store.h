@@ -0,0 +1,85 @@
+#ifndef TSETSTORE_H
+#define TSETSTORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include </usr/local/include/sw/redis++/redis++.h>
+#include "tset_format.h"
+#include "tset_writer.h"
+#include "tset_file.h"
+
+#define TSET_STORE_REDIS 0
+#define TSET_STORE_FILE 1
+#define TSET_STORE_SHARDED 2
+
+#define TSET_BUCKETS 65536                  //2-byte bucket index space
+#define TSET_RING_VNODES 128                //Ring points per shard
+#define TSET_SHARDS_KEY "OQXT:TSET:SHARD"   //"<shard>/<n_shards>", written to every shard by setup
+
+/*
+ * TSet storage behind one interface, selected by the tools' tset_store:
+ *  - Redis: entries go through the pipelined TSetWriter from the pooled
+ *    connection and are read back with MGET. With RedisPool replicas
+ *    configured, reads go to the replica with the fewest outstanding
+ *    requests (falling back to the primary on error); writes stay on the
+ *    primary.
+ *  - File: tset_file.h, written in bulk by setup and mapped by search; no
+ *    network on the query path. Needs binary keys (TSET_FORMAT_BINARY).
+ *  - Sharded: the RedisPool_Shard instances, placed on a consistent-hash
+ *    ring that the 2-byte bucket index of each key is routed over. Every
+ *    shard has its own pipelined writer. A batch read hands one MGET per
+ *    shard to that shard's long-lived reader thread, so the MGETs run
+ *    concurrently. The shard list order fixes the ring.
+ * Each store also records the entry format so search can refuse a
+ * mismatched one. TSetStore_Walk reads keys in list order and stops at
+ * the first missing entry or the one carrying the end-of-list flag; on
+ * the Redis store this runs server-side as a Lua script, on a replica
+ * when any are configured, so entries past the end of the list never
+ * cross the network. MGet and Walk return -1 when the store could not be
+ * read at all, as distinct from keys that are simply missing.
+ */
+typedef struct {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::packaged_task<void()>> jobs;
+    bool stop;
+} TSetShardReader;
+
+typedef struct {
+    unsigned int type;                      //TSET_STORE_*
+    sw::redis::Redis *redis;
+    std::vector<sw::redis::Redis *> replicas;
+    std::unique_ptr<std::atomic<int>[]> replica_load;   //Reads in flight per replica
+    std::atomic<unsigned int> replica_next;             //Rotating scan start, so ties spread
+    std::mutex walk_lock;
+    std::string walk_sha;                   //SHA1 of the loaded walk script, empty until first use
+    TSetWriter writer;
+    TSetFile file;
+    std::vector<sw::redis::Redis *> shards;
+    std::deque<TSetWriter> shard_writers;   //Deque, as writers holding futures cannot be relocated
+    std::vector<uint16_t> bucket_shard;     //Sharded: ring owner of every bucket index
+    std::deque<TSetShardReader> shard_readers;  //Sharded search: one reader thread per shard
+    uint64_t n_written;
+    uint64_t n_failed;
+} TSetStore;
+
+const char *TSetStore_Name(unsigned int type);
+int TSetStore_OpenWrite(TSetStore &TS, unsigned int type, std::string tset_file, size_t batch_entries, unsigned int max_inflight);
+int TSetStore_Put(TSetStore &TS, const std::string &key, const std::string &val);
+int TSetStore_Finish(TSetStore &TS, unsigned int format, unsigned int layout, unsigned int chunk_ids);
+int TSetStore_OpenRead(TSetStore &TS, unsigned int type, std::string tset_file);
+int TSetStore_Check(TSetStore &TS, unsigned int format, unsigned int layout, unsigned int chunk_ids);
+int TSetStore_MGet(TSetStore &TS, const std::vector<std::string> &keys, std::vector<sw::redis::OptionalString> &vals);
+int TSetStore_Walk(TSetStore &TS, unsigned int format, const std::vector<std::string> &keys, std::vector<sw::redis::OptionalString> &vals);
+int TSetStore_Clean(TSetStore &TS);
+
+#endif // TSETSTORE_H
@@ -0,0 +1,108 @@
+#include "tset_writer.h"
+#include <iostream>
+
+static TSetBatchResult TSetWriter_Exec(sw::redis::Redis *redis, std::vector<std::string> keys, std::vector<std::string> vals)
+{
+    TSetBatchResult res = {0, 0};
+    for(int attempt=0;attempt<=TSET_WRITE_RETRIES;++attempt){
+        try{
+            // Borrow a pooled connection rather than opening a new one per batch
+            auto pipe = redis->pipeline(false);
+            for(size_t i=0;i<keys.size();++i){
+                pipe.set(keys[i], vals[i]);
+            }
+            auto replies = pipe.exec();
+            res.n_written = 0;
+            res.n_failed = 0;
+            for(size_t i=0;i<keys.size();++i){
+                if(replies.get<bool>(i)){
+                    res.n_written++;
+                }
+                else{
+                    res.n_failed++;
+                }
+            }
+            return res;
+        }
+        catch(const std::exception &e){
+            std::cerr << "TSet batch of " << keys.size() << " entries failed (attempt " << (attempt+1) << "): " << e.what() << std::endl;
+        }
+    }
+    res.n_written = 0;
+    res.n_failed = keys.size();
+    return res;
+}
+
+static int TSetWriter_Retire(TSetWriter &TW)
+{
+    TSetBatchResult res = TW.inflight.front().get();
+    TW.inflight.pop_front();
+    TW.n_written += res.n_written;
+    TW.n_failed += res.n_failed;
+    return 0;
+}
+
+static int TSetWriter_Submit(TSetWriter &TW)
+{
+    if(TW.keys.empty()){
+        return 0;
+    }
+    while(TW.inflight.size() >= TW.max_inflight){
+        TSetWriter_Retire(TW);
+    }
+    TW.inflight.push_back(std::async(std::launch::async, TSetWriter_Exec, TW.redis, std::move(TW.keys), std::move(TW.vals)));
+    TW.n_batches++;
+    TW.keys.clear();
+    TW.vals.clear();
+    TW.keys.reserve(TW.batch_entries);
+    TW.vals.reserve(TW.batch_entries);
+    return 0;
+}
+
+int TSetWriter_Init(TSetWriter &TW, sw::redis::Redis &redis, size_t batch_entries, unsigned int max_inflight)
+{
+    TW.redis = &redis;
+    TW.batch_entries = (batch_entries == 0) ? 1 : batch_entries;
+    TW.max_inflight = (max_inflight == 0) ? 1 : max_inflight;
+    TW.keys.clear();
+    TW.vals.clear();
+    TW.keys.reserve(TW.batch_entries);
+    TW.vals.reserve(TW.batch_entries);
+    TW.inflight.clear();
+    TW.n_batches = 0;
+    TW.n_written = 0;
+    TW.n_failed = 0;
+    return 0;
+}
+
+int TSetWriter_Put(TSetWriter &TW, const std::string &key, const std::string &val)
+{
+    TW.keys.push_back(key);
+    TW.vals.push_back(val);
+    if(TW.keys.size() >= TW.batch_entries){
+        return TSetWriter_Submit(TW);
+    }
+    return 0;
+}
+
+int TSetWriter_Flush(TSetWriter &TW)
+{
+    // Ships the partial batch and waits for every outstanding one
+    TSetWriter_Submit(TW);
+    while(!TW.inflight.empty()){
+        TSetWriter_Retire(TW);
+    }
+    return (TW.n_failed == 0) ? 0 : -1;
+}
+
+int TSetWriter_Clean(TSetWriter &TW)
+{
+    while(!TW.inflight.empty()){
+        TSetWriter_Retire(TW);
+    }
+    TW.keys.clear();
+    TW.vals.clear();
+    TW.keys.shrink_to_fit();
+    TW.vals.shrink_to_fit();
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef TSETWRITER_H
+#define TSETWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include </usr/local/include/sw/redis++/redis++.h>
+
+#define TSET_WRITE_RETRIES 2                //Extra attempts for a batch whose pipeline failed
+
+/*
+ * Batching TSet writer: TSetWriter_Put queues (key, value) entries and ships
+ * every batch_entries of them as one Redis pipeline, executed asynchronously
+ * on a connection borrowed from the pool. At most max_inflight batches are
+ * outstanding; Put blocks on the oldest once that bound is reached. Entries
+ * of a batch that still fails after the retries are counted in n_failed.
+ */
+typedef struct {
+    uint64_t n_written;
+    uint64_t n_failed;
+} TSetBatchResult;
+
+typedef struct {
+    sw::redis::Redis *redis;
+    size_t batch_entries;
+    unsigned int max_inflight;
+    std::vector<std::string> keys;          //Batch being filled
+    std::vector<std::string> vals;
+    std::deque<std::future<TSetBatchResult>> inflight;
+    uint64_t n_batches;
+    uint64_t n_written;
+    uint64_t n_failed;
+} TSetWriter;
+
+int TSetWriter_Init(TSetWriter &TW, sw::redis::Redis &redis, size_t batch_entries, unsigned int max_inflight);
+int TSetWriter_Put(TSetWriter &TW, const std::string &key, const std::string &val);
+int TSetWriter_Flush(TSetWriter &TW);
+int TSetWriter_Clean(TSetWriter &TW);
+
+#endif // TSETWRITER_H
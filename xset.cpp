@@ -0,0 +1,418 @@
+#include "xset.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+static inline uint64_t XSet_Key(unsigned int *indices)
+{
+    return (uint64_t)indices[0] | ((uint64_t)indices[1] << 32);
+}
+
+static inline bool XSet_StaticContain(const XSet &XS, uint64_t key)
+{
+    return (XS.type == XSET_FUSE) ? FuseFilter_Contain(XS.fuse, key) : CuckooFilter_Contain(XS.cuckoo, key);
+}
+
+static inline void XSet_StaticPrefetch(const XSet &XS, uint64_t key)
+{
+    if(XS.type == XSET_FUSE){
+        FuseFilter_Prefetch(XS.fuse, key);
+    }
+    else{
+        CuckooFilter_Prefetch(XS.cuckoo, key);
+    }
+}
+
+const char *XSet_Name(unsigned int type)
+{
+    switch(type){
+        case XSET_BLOOM: return "bloom";
+        case XSET_FUSE: return "binary fuse";
+        case XSET_CUCKOO: return "cuckoo";
+    }
+    return "unknown";
+}
+
+int XSet_Init(XSet &XS, unsigned int type, uint64_t n_items, double target_fpr, unsigned int n_hash, unsigned int bf_layout)
+{
+    // Static backends use 8-bit fingerprints when they meet the target, else 16-bit
+    if((target_fpr <= 0.0) || (target_fpr >= 1.0)){
+        return -1;
+    }
+
+    XSet_Clean(XS);
+    XS.type = type;
+    XS.n_items = n_items;
+
+    int rc = -1;
+    switch(type){
+        case XSET_BLOOM:
+        {
+            BloomParams P;
+            rc = BloomParams_Size(P, n_items, target_fpr, n_hash, bf_layout);
+            if(rc == 0){
+                rc = BloomFilter_Init(XS.bf, P);
+            }
+            return rc;
+        }
+        case XSET_FUSE:
+            rc = FuseFilter_Init(XS.fuse, n_items, (target_fpr >= 1.0/256.0) ? 8 : 16);
+            break;
+        case XSET_CUCKOO:
+        {
+            //16-bit fingerprints at full load give about 1.16e-4, so tighter targets lower the load instead
+            unsigned int fp_bits = (target_fpr >= 2.0*CUCKOO_BUCKET_SLOTS*CUCKOO_MAX_LOAD/255.0) ? 8 : 16;
+            double load = CuckooFilter_DesignLoad(target_fpr, fp_bits);
+            double fpr = 2.0*CUCKOO_BUCKET_SLOTS*load/(double)((1u << fp_bits) - 1);
+            if(fpr > target_fpr*(1.0 + 1e-9)){
+                std::cerr << "Cuckoo XSet cannot reach FPR " << target_fpr << " with " << fp_bits
+                          << "-bit fingerprints; sized for load " << load << ", FPR about " << fpr << std::endl;
+            }
+            rc = CuckooFilter_Init(XS.cuckoo, CuckooFilter_BucketBits(n_items, load), fp_bits);
+            break;
+        }
+    }
+    if(rc == 0){
+        XS.keys = new uint64_t[std::max<uint64_t>(n_items,1)];
+        XS.n_keys = 0;
+    }
+    return rc;
+}
+
+unsigned int XSet_ElementWords(const XSet &XS)
+{
+    return (XS.type == XSET_BLOOM) ? BloomFilter_IndexCount(XS.bf) : XSET_KEY_WORDS;
+}
+
+int XSet_XTagIndices(const XSet &XS, blake3_hasher *hasher, const uint64_t *xtag, unsigned int *indices)
+{
+    if(XS.type == XSET_BLOOM){
+        return BloomFilter_XTagIndices(XS.bf, hasher, xtag, indices);
+    }
+
+    unsigned char msg[XTAG_FP_MAX_MSG_BYTES];
+    unsigned char digest[8];
+    unsigned int n_bytes = XTagFP_Message(xtag, msg);
+
+    blake3_hasher_init(hasher);
+    blake3_hasher_update(hasher,msg,n_bytes);
+    blake3_hasher_finalize(hasher,digest,8);
+
+    uint64_t key = 0;
+    for(int b=7;b>=0;--b){
+        key = (key << 8) | digest[b];
+    }
+    indices[0] = (unsigned int)key;
+    indices[1] = (unsigned int)(key >> 32);
+    return 0;
+}
+
+int XSet_Add(XSet &XS, unsigned int *indices)
+{
+    if(XS.type == XSET_BLOOM){
+        return BloomFilter_Set(XS.bf, indices);
+    }
+    if((XS.keys == nullptr) || (XS.n_keys >= XS.n_items)){
+        return -1;
+    }
+    XS.keys[XS.n_keys++] = XSet_Key(indices);
+    return 0;
+}
+
+int XSet_InitShard(XSet &shard, const XSet &XS)
+{
+    // Only Bloom XSets shard; static filters are built once from the full key set
+    if(XS.type != XSET_BLOOM){
+        return -1;
+    }
+    XSet_Clean(shard);
+    shard.type = XSET_BLOOM;
+    return BloomFilter_InitShard(shard.bf, XS.bf);
+}
+
+int XSet_Merge(XSet &XS, const XSet *const *shards, unsigned int n_shards)
+{
+    std::vector<const BloomFilter *> bf_shards(n_shards);
+    for(unsigned int s=0;s<n_shards;++s){
+        if((XS.type != XSET_BLOOM) || (shards[s]->type != XSET_BLOOM)){
+            return -1;
+        }
+        bf_shards[s] = &shards[s]->bf;
+    }
+    return BloomFilter_Merge(XS.bf, bf_shards.data(), n_shards);
+}
+
+int XSet_Build(XSet &XS)
+{
+    if(XS.type == XSET_BLOOM){
+        return 0;
+    }
+
+    //Repeated xtags collapse to one entry; the cuckoo filter could not hold more than 8 copies anyway
+    std::sort(XS.keys, XS.keys + XS.n_keys);
+    XS.n_keys = std::unique(XS.keys, XS.keys + XS.n_keys) - XS.keys;
+
+    int rc;
+    if(XS.type == XSET_FUSE){
+        rc = FuseFilter_Populate(XS.fuse, XS.keys, XS.n_keys);
+    }
+    else{
+        //A failed eviction walk leaves the table unusable: rebuild with twice the buckets
+        rc = CuckooFilter_Populate(XS.cuckoo, XS.keys, XS.n_keys);
+        while((rc != 0) && (XS.cuckoo.bucket_bits < CUCKOO_MAX_BUCKET_BITS)){
+            unsigned int bucket_bits = XS.cuckoo.bucket_bits + 1;
+            unsigned int fp_bits = XS.cuckoo.fp_bits;
+            CuckooFilter_Clean(XS.cuckoo);
+            CuckooFilter_Init(XS.cuckoo, bucket_bits, fp_bits);
+            rc = CuckooFilter_Populate(XS.cuckoo, XS.keys, XS.n_keys);
+        }
+    }
+    if(rc != 0){
+        std::cerr << "XSet construction failed for " << XS.n_keys << " keys (" << XSet_Name(XS.type) << ")" << std::endl;
+    }
+
+    delete [] XS.keys;
+    XS.keys = nullptr;
+    return rc;
+}
+
+int XSet_Probe(const XSet &XS, unsigned int *indices, bool *is_present)
+{
+    if(XS.type == XSET_BLOOM){
+        return BloomFilter_Match(XS.bf, indices, is_present);
+    }
+    *is_present = XSet_StaticContain(XS, XSet_Key(indices));
+    return 0;
+}
+
+int XSet_ProbeBatch(const XSet &XS, unsigned int **indices, unsigned int n_words, unsigned int n_cand, uint64_t *survivors)
+{
+    // Same contract as BloomFilter_Match_Batch
+    if(XS.type == XSET_BLOOM){
+        return BloomFilter_Match_Batch(XS.bf, indices, n_words, n_cand, survivors);
+    }
+
+    size_t n_probes = (size_t)n_cand*n_words;
+    size_t p_ahead = std::min<size_t>(BF_PREFETCH_DIST, n_probes);
+
+    ::memset(survivors,0x00,((n_cand + 63) >> 6)*sizeof(uint64_t));
+    for(size_t p=0;p<p_ahead;++p){
+        XSet_StaticPrefetch(XS, (uint64_t)indices[0][p] | ((uint64_t)indices[1][p] << 32));
+    }
+
+    size_t p = 0;
+    for(unsigned int c=0;c<n_cand;++c){
+        bool is_in_part = true;
+        for(unsigned int l=0;l<n_words;++l,++p){
+            if(p_ahead < n_probes){
+                XSet_StaticPrefetch(XS, (uint64_t)indices[0][p_ahead] | ((uint64_t)indices[1][p_ahead] << 32));
+                p_ahead++;
+            }
+            if(is_in_part){
+                is_in_part = XSet_StaticContain(XS, (uint64_t)indices[0][p] | ((uint64_t)indices[1][p] << 32));
+            }
+        }
+        if(is_in_part){
+            survivors[c >> 6] |= (1ULL << (c & 63));
+        }
+    }
+    return 0;
+}
+
+double XSet_FPR(const XSet &XS)
+{
+    switch(XS.type){
+        case XSET_BLOOM:
+        {
+            BloomParams P = {XS.bf.n_hash, XS.bf.index_bits, XS.bf.n_bits, XS.bf.layout};
+            return BloomParams_FPR(P, XS.n_items);
+        }
+        case XSET_FUSE:
+            return std::ldexp(1.0, -(int)XS.fuse.fp_bits);
+        case XSET_CUCKOO:
+        {
+            CuckooFilter CF = XS.cuckoo;
+            if(CF.n_items == 0){
+                CF.n_items = XS.n_items;        //Not built yet: assume every element is stored
+            }
+            return CuckooFilter_FPR(CF);
+        }
+    }
+    return 1.0;
+}
+
+double XSet_TermFPR(const XSet &XS)
+{
+    // Per-term FPR of the filter as built: from the actual bits for Bloom, by construction otherwise
+    return (XS.type == XSET_BLOOM) ? BloomFilter_FillFPR(XS.bf) : XSet_FPR(XS);
+}
+
+uint64_t XSet_Bytes(const XSet &XS)
+{
+    switch(XS.type){
+        case XSET_BLOOM:
+            return ((XS.bf.layout == BF_LAYOUT_BLOCKED) ? 1 : XS.bf.n_hash) * (XS.bf.n_bits >> 3);
+        case XSET_FUSE:
+            return FuseFilter_Bytes(XS.fuse);
+        case XSET_CUCKOO:
+            return CuckooFilter_Bytes(XS.cuckoo);
+    }
+    return 0;
+}
+
+int XSet_Write(std::string xset_file, const XSet &XS)
+{
+    if(XS.type == XSET_BLOOM){
+        return BloomFilter_WriteBFtoFile(xset_file, XS.bf);
+    }
+
+    XSetFileHeader hdr;
+    ::memset(&hdr,0x00,sizeof(hdr));
+    ::memcpy(hdr.magic,XSET_FILE_MAGIC,8);
+    hdr.version = XSET_FILE_VERSION;
+    hdr.type = XS.type;
+    hdr.fp_version = XTAG_FP.version;
+    hdr.fp_coeffs = XTAG_FP.n_coeffs;
+    hdr.payload_bytes = XSet_Bytes(XS);
+
+    const void *payload;
+    if(XS.type == XSET_FUSE){
+        hdr.fp_bits = XS.fuse.fp_bits;
+        hdr.n_items = XS.fuse.n_items;
+        hdr.seed = XS.fuse.seed;
+        payload = XS.fuse.fingerprints;
+    }
+    else{
+        hdr.fp_bits = XS.cuckoo.fp_bits;
+        hdr.shape = XS.cuckoo.bucket_bits;
+        hdr.n_items = XS.cuckoo.n_items;
+        payload = XS.cuckoo.table;
+    }
+
+    //Write aside and rename, so a search mapping the old file keeps a consistent view
+    std::string tmp_file = xset_file + ".tmp";
+    FILE *fp = fopen(tmp_file.c_str(),"wb");
+    if(fp == NULL){
+        std::cerr << "Cannot open XSet file " << tmp_file << std::endl;
+        return -1;
+    }
+    bool ok = (fwrite(&hdr,sizeof(hdr),1,fp) == 1)
+           && (fwrite(payload,1,hdr.payload_bytes,fp) == hdr.payload_bytes);
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || (rename(tmp_file.c_str(),xset_file.c_str()) != 0)){
+        std::cerr << "Cannot write XSet file " << xset_file << std::endl;
+        unlink(tmp_file.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static int XSet_MapFile(std::string xset_file, int fd, XSet &XS)
+{
+    struct stat st;
+    if(fstat(fd,&st) != 0){
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED){
+        std::cerr << "Cannot map XSet file " << xset_file << std::endl;
+        return -1;
+    }
+
+    const XSetFileHeader *hdr = (const XSetFileHeader *)map;
+    void *payload = (unsigned char *)map + sizeof(XSetFileHeader);
+    bool valid = ((size_t)st.st_size >= sizeof(XSetFileHeader)) && (hdr->version == XSET_FILE_VERSION)
+              && ((size_t)st.st_size == sizeof(XSetFileHeader) + hdr->payload_bytes);
+    if(valid && (hdr->type == XSET_FUSE)){
+        valid = (FuseFilter_Geometry(XS.fuse, hdr->n_items, hdr->fp_bits) == 0)
+             && (FuseFilter_Bytes(XS.fuse) == hdr->payload_bytes);
+        XS.fuse.seed = hdr->seed;
+        XS.fuse.fingerprints = payload;
+        XS.fuse.owned = false;
+    }
+    else if(valid && (hdr->type == XSET_CUCKOO)){
+        valid = (hdr->shape >= 1) && (hdr->shape <= CUCKOO_MAX_BUCKET_BITS) && ((hdr->fp_bits == 8) || (hdr->fp_bits == 16));
+        if(valid){
+            XS.cuckoo.bucket_bits = hdr->shape;
+            XS.cuckoo.fp_bits = hdr->fp_bits;
+            XS.cuckoo.n_buckets = 1ULL << hdr->shape;
+            XS.cuckoo.n_items = hdr->n_items;
+            XS.cuckoo.table = payload;
+            XS.cuckoo.owned = false;
+            valid = (CuckooFilter_Bytes(XS.cuckoo) == hdr->payload_bytes);
+        }
+    }
+    else{
+        valid = false;
+    }
+    if(!valid){
+        std::cerr << "XSet file " << xset_file << " has an invalid header or size" << std::endl;
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    XTAG_FP.version = hdr->fp_version;
+    XTAG_FP.n_coeffs = hdr->fp_coeffs;
+    if(XTagFP_Check(xset_file) != 0){
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    madvise(map, st.st_size, MADV_WILLNEED);
+
+    XS.type = hdr->type;
+    XS.n_items = hdr->n_items;
+    XS.map = map;
+    XS.map_len = st.st_size;
+    return 0;
+}
+
+int XSet_Read(std::string xset_file, XSet &XS)
+{
+    // XSet files of the static backends are mapped here; anything else is a Bloom filter file
+    XSet_Clean(XS);
+
+    int fd = open(xset_file.c_str(), O_RDONLY);
+    if(fd < 0){
+        std::cerr << "Cannot open XSet file " << xset_file << std::endl;
+        return -1;
+    }
+
+    char magic[8];
+    bool is_static = (pread(fd, magic, 8, 0) == 8) && (::memcmp(magic,XSET_FILE_MAGIC,8) == 0);
+
+    int rc;
+    if(is_static){
+        rc = XSet_MapFile(xset_file, fd, XS);
+    }
+    else{
+        XS.type = XSET_BLOOM;
+        rc = BloomFilter_ReadBFfromFile(xset_file, XS.bf);
+        XS.n_items = XS.bf.n_items;
+    }
+    close(fd);
+
+    return rc;
+}
+
+int XSet_Clean(XSet &XS)
+{
+    BloomFilter_Clean(XS.bf);
+    FuseFilter_Clean(XS.fuse);
+    CuckooFilter_Clean(XS.cuckoo);
+    delete [] XS.keys;
+    XS.keys = nullptr;
+    XS.n_keys = 0;
+    if(XS.map != NULL){
+        munmap(XS.map, XS.map_len);
+    }
+    XS.map = NULL;
+    XS.map_len = 0;
+    return 0;
+}
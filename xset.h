@@ -0,0 +1,78 @@
+#ifndef XSET_H
+#define XSET_H
+
+#include <cstdint>
+#include <string>
+#include "bloom_filter.h"
+#include "fuse_filter.h"
+#include "cuckoo_filter.h"
+
+#define XSET_BLOOM 0
+#define XSET_FUSE 1
+#define XSET_CUCKOO 2
+
+#define XSET_KEY_WORDS 2                    //Static backends: 64-bit key as two index words, low first
+
+#define XSET_FILE_MAGIC "OQXTXS01"
+#define XSET_FILE_VERSION 1
+
+/*
+ * XSet membership structure behind one interface, selected at setup:
+ *  - Bloom: bloom_filter.h, built incrementally from per-element indices.
+ *  - Fuse / Cuckoo: static filters over a 64-bit key per xtag (the first
+ *    8 bytes of BLAKE3 over the fingerprint message). Keys are collected by
+ *    XSet_Add and the filter is constructed once by XSet_Build.
+ * An element is handed around as XSet_ElementWords index words, so search
+ * batches candidates the same way whatever the backend. A Bloom XSet can
+ * also be built from per-thread shards (XSet_InitShard) that XSet_Merge
+ * ORs together before XSet_Build.
+ */
+typedef struct {
+    unsigned int type;                      //XSET_*
+    uint64_t n_items;                       //Elements sized for, or stored in a loaded filter
+    BloomFilter bf;
+    FuseFilter fuse;
+    CuckooFilter cuckoo;
+    uint64_t *keys;                         //Static backends: keys pending XSet_Build
+    size_t n_keys;
+    void *map;                              //Mapped XSet file of a static backend, else NULL
+    size_t map_len;
+} XSet;
+
+/*
+ * Binary file of a static backend: this 64B header, then the fingerprint
+ * table (64B-aligned), mapped read-only by search. Bloom XSets keep the
+ * bloom_filter.h file format.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t type;
+    uint32_t fp_version;                    //XTagFPParams in effect at setup
+    uint32_t fp_coeffs;
+    uint32_t fp_bits;
+    uint32_t shape;                         //Cuckoo: bucket_bits
+    uint64_t n_items;                       //Fuse: geometry size. Cuckoo: fingerprints stored
+    uint64_t seed;                          //Fuse
+    uint64_t payload_bytes;
+    uint64_t reserved;
+} XSetFileHeader;
+
+const char *XSet_Name(unsigned int type);
+int XSet_Init(XSet &XS, unsigned int type, uint64_t n_items, double target_fpr, unsigned int n_hash = 0, unsigned int bf_layout = BF_LAYOUT_BLOCKED);
+unsigned int XSet_ElementWords(const XSet &XS);
+int XSet_XTagIndices(const XSet &XS, blake3_hasher *hasher, const uint64_t *xtag, unsigned int *indices);
+int XSet_Add(XSet &XS, unsigned int *indices);
+int XSet_InitShard(XSet &shard, const XSet &XS);
+int XSet_Merge(XSet &XS, const XSet *const *shards, unsigned int n_shards);
+int XSet_Build(XSet &XS);
+int XSet_Probe(const XSet &XS, unsigned int *indices, bool *is_present);
+int XSet_ProbeBatch(const XSet &XS, unsigned int **indices, unsigned int n_words, unsigned int n_cand, uint64_t *survivors);
+double XSet_FPR(const XSet &XS);
+double XSet_TermFPR(const XSet &XS);
+uint64_t XSet_Bytes(const XSet &XS);
+int XSet_Write(std::string xset_file, const XSet &XS);
+int XSet_Read(std::string xset_file, XSet &XS);
+int XSet_Clean(XSet &XS);
+
+#endif // XSET_H
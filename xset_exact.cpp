@@ -0,0 +1,131 @@
+#include "xset_exact.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+static inline bool XTagDigest_Less(const XTagDigest &a, const XTagDigest &b)
+{
+    return (a.w[0] < b.w[0]) || ((a.w[0] == b.w[0]) && (a.w[1] < b.w[1]));
+}
+
+static inline bool XTagDigest_Equal(const XTagDigest &a, const XTagDigest &b)
+{
+    return (a.w[0] == b.w[0]) && (a.w[1] == b.w[1]);
+}
+
+int XTagFP_Digest(blake3_hasher *hasher, const uint64_t *xtag, XTagDigest *digest)
+{
+    unsigned char msg[XTAG_FP_MAX_MSG_BYTES];
+    unsigned char out[16];
+    unsigned int n_bytes = XTagFP_Message(xtag, msg);
+
+    blake3_hasher_init(hasher);
+    blake3_hasher_update(hasher,msg,n_bytes);
+    blake3_hasher_finalize(hasher,out,16);
+
+    for(int j=0;j<2;++j){
+        uint64_t v = 0;
+        for(int b=7;b>=0;--b){
+            v = (v << 8) | out[8*j+b];
+        }
+        digest->w[j] = v;
+    }
+    return 0;
+}
+
+int XSetExact_Write(std::string exact_file, std::vector<XTagDigest> &digests)
+{
+    // Sorts and deduplicates digests in place
+    std::sort(digests.begin(), digests.end(), XTagDigest_Less);
+    digests.erase(std::unique(digests.begin(), digests.end(), XTagDigest_Equal), digests.end());
+
+    XSetExactHeader hdr;
+    ::memset(&hdr,0x00,sizeof(hdr));
+    ::memcpy(hdr.magic,XSET_EXACT_MAGIC,8);
+    hdr.version = XSET_EXACT_VERSION;
+    hdr.fp_version = XTAG_FP.version;
+    hdr.fp_coeffs = XTAG_FP.n_coeffs;
+    hdr.n_digests = digests.size();
+
+    std::string tmp_file = exact_file + ".tmp";
+    FILE *fp = fopen(tmp_file.c_str(),"wb");
+    if(fp == NULL){
+        std::cerr << "Cannot open XSet exact file " << tmp_file << std::endl;
+        return -1;
+    }
+    bool ok = (fwrite(&hdr,sizeof(hdr),1,fp) == 1)
+           && (fwrite(digests.data(),sizeof(XTagDigest),digests.size(),fp) == digests.size());
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || (rename(tmp_file.c_str(),exact_file.c_str()) != 0)){
+        std::cerr << "Cannot write XSet exact file " << exact_file << std::endl;
+        unlink(tmp_file.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int XSetExact_Read(std::string exact_file, XSetExact &XE)
+{
+    // The digests must have been taken under the fingerprint definition of the loaded XSet
+    XSetExact_Clean(XE);
+
+    int fd = open(exact_file.c_str(), O_RDONLY);
+    if(fd < 0){
+        std::cerr << "Cannot open XSet exact file " << exact_file << std::endl;
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd,&st) != 0){
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        std::cerr << "Cannot map XSet exact file " << exact_file << std::endl;
+        return -1;
+    }
+
+    const XSetExactHeader *hdr = (const XSetExactHeader *)map;
+    bool valid = ((size_t)st.st_size >= sizeof(XSetExactHeader))
+              && (::memcmp(hdr->magic,XSET_EXACT_MAGIC,8) == 0) && (hdr->version == XSET_EXACT_VERSION)
+              && ((size_t)st.st_size == sizeof(XSetExactHeader) + hdr->n_digests*sizeof(XTagDigest));
+    if(!valid){
+        std::cerr << "XSet exact file " << exact_file << " has an invalid header or size" << std::endl;
+        munmap(map, st.st_size);
+        return -1;
+    }
+    if((hdr->fp_version != XTAG_FP.version) || (hdr->fp_coeffs != XTAG_FP.n_coeffs)){
+        std::cerr << "XSet exact file " << exact_file << " was built for a different xtag fingerprint" << std::endl;
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    XE.digests = (const XTagDigest *)((unsigned char *)map + sizeof(XSetExactHeader));
+    XE.n_digests = hdr->n_digests;
+    XE.map = map;
+    XE.map_len = st.st_size;
+    return 0;
+}
+
+bool XSetExact_Contains(const XSetExact &XE, const XTagDigest &digest)
+{
+    const XTagDigest *end = XE.digests + XE.n_digests;
+    const XTagDigest *it = std::lower_bound(XE.digests, end, digest, XTagDigest_Less);
+    return (it != end) && XTagDigest_Equal(*it, digest);
+}
+
+int XSetExact_Clean(XSetExact &XE)
+{
+    if(XE.map != NULL){
+        munmap(XE.map, XE.map_len);
+    }
+    XE.digests = nullptr;
+    XE.n_digests = 0;
+    XE.map = NULL;
+    XE.map_len = 0;
+    return 0;
+}
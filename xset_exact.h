@@ -0,0 +1,45 @@
+#ifndef XSETEXACT_H
+#define XSETEXACT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bloom_filter.h"
+
+#define XSET_EXACT_MAGIC "OQXTEX01"
+#define XSET_EXACT_VERSION 1
+
+/*
+ * Exact side-set of the XSet for false-positive telemetry: the sorted,
+ * distinct 128-bit BLAKE3 digests of every xtag fingerprint message
+ * inserted at setup. Distinct fingerprints collide with probability about
+ * n^2 / 2^129, so membership here is treated as ground truth. Written by
+ * setup and mapped read-only by search only when telemetry is enabled.
+ */
+typedef struct {
+    uint64_t w[2];
+} XTagDigest;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t fp_version;                    //XTagFPParams the digests were taken under
+    uint32_t fp_coeffs;
+    uint32_t reserved;
+    uint64_t n_digests;
+} XSetExactHeader;
+
+typedef struct {
+    const XTagDigest *digests;
+    uint64_t n_digests;
+    void *map;
+    size_t map_len;
+} XSetExact;
+
+int XTagFP_Digest(blake3_hasher *hasher, const uint64_t *xtag, XTagDigest *digest);
+int XSetExact_Write(std::string exact_file, std::vector<XTagDigest> &digests);
+int XSetExact_Read(std::string exact_file, XSetExact &XE);
+bool XSetExact_Contains(const XSetExact &XE, const XTagDigest &digest);
+int XSetExact_Clean(XSetExact &XE);
+
+#endif // XSETEXACT_H